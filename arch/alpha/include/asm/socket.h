@@ -72,6 +72,12 @@
 #define SO_WIFI_STATUS		41
 #define SCM_WIFI_STATUS		SO_WIFI_STATUS
 
+#define SO_BUSY_POLL		42
+
+#define SO_ZEROCOPY		43
+
+#define SO_ATTACH_BPF		44
+
 /* O_NONBLOCK clashes with the bits used for socket types.  Therefore we
  * have to define SOCK_NONBLOCK to a different value here.
  */
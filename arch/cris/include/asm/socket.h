@@ -67,6 +67,12 @@
 #define SO_WIFI_STATUS		41
 #define SCM_WIFI_STATUS		SO_WIFI_STATUS
 
+#define SO_BUSY_POLL		42
+
+#define SO_ZEROCOPY		43
+
+#define SO_ATTACH_BPF		44
+
 #endif /* _ASM_SOCKET_H */
 
 
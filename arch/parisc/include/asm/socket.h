@@ -64,6 +64,12 @@
 #define SO_WIFI_STATUS		0x4022
 #define SCM_WIFI_STATUS		SO_WIFI_STATUS
 
+#define SO_BUSY_POLL		0x4023
+
+#define SO_ZEROCOPY		0x4024
+
+#define SO_ATTACH_BPF		0x4025
+
 /* O_NONBLOCK clashes with the bits used for socket types.  Therefore we
  * have to define SOCK_NONBLOCK to a different value here.
  */
@@ -76,6 +76,13 @@ static netdev_tx_t loopback_xmit(struct sk_buff *skb,
 	struct pcpu_lstats *lb_stats;
 	int len;
 
+	/* Don't let the receiver hold on to the sender's user pages */
+	if (skb_orphan_frags_rx(skb, GFP_ATOMIC)) {
+		kfree_skb(skb);
+		atomic_long_inc(&dev->rx_dropped);
+		return NETDEV_TX_OK;
+	}
+
 	skb_orphan(skb);
 
 	skb->protocol = eth_type_trans(skb, dev);
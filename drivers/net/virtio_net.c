@@ -139,6 +139,11 @@ static void skb_xmit_done(struct virtqueue *svq)
 
 	/* We were probably waiting for more output buffers. */
 	netif_wake_queue(vi->dev);
+
+	/* If byte queue limits stopped the queue, nobody will come back
+	 * into start_xmit to free the completed skbs: let NAPI do it. */
+	if (unlikely(netif_xmit_stopped(netdev_get_tx_queue(vi->dev, 0))))
+		napi_schedule(&vi->napi);
 }
 
 static void set_skb_frag(struct sk_buff *skb, struct page *page,
@@ -512,12 +517,56 @@ static void refill_work(struct work_struct *work)
 		queue_delayed_work(system_nrt_wq, &vi->refill, HZ/2);
 }
 
+static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
+{
+	struct sk_buff *skb;
+	unsigned int len, tot_sgs = 0;
+	unsigned int pkts_compl = 0, bytes_compl = 0;
+	struct virtnet_stats __percpu *stats = this_cpu_ptr(vi->stats);
+
+	while ((skb = virtqueue_get_buf(vi->svq, &len)) != NULL) {
+		pr_debug("Sent skb %p\n", skb);
+
+		u64_stats_update_begin(&stats->syncp);
+		stats->tx_bytes += skb->len;
+		stats->tx_packets++;
+		u64_stats_update_end(&stats->syncp);
+
+		pkts_compl++;
+		bytes_compl += skb->len;
+		tot_sgs += skb_vnet_hdr(skb)->num_sg;
+		dev_kfree_skb_any(skb);
+	}
+	netdev_completed_queue(vi->dev, pkts_compl, bytes_compl);
+	return tot_sgs;
+}
+
+/*
+ * Reclaim transmitted skbs on behalf of a queue stopped by BQL.  Returns
+ * false if start_xmit holds the tx lock and we need to be polled again.
+ */
+static bool virtnet_tx_reclaim(struct virtnet_info *vi)
+{
+	struct netdev_queue *txq = netdev_get_tx_queue(vi->dev, 0);
+
+	if (likely(!netif_xmit_stopped(txq)))
+		return true;
+	if (!__netif_tx_trylock(txq))
+		return false;
+	free_old_xmit_skbs(vi);
+	__netif_tx_unlock(txq);
+	return true;
+}
+
 static int virtnet_poll(struct napi_struct *napi, int budget)
 {
 	struct virtnet_info *vi = container_of(napi, struct virtnet_info, napi);
 	void *buf;
 	unsigned int len, received = 0;
 
+	if (unlikely(!virtnet_tx_reclaim(vi)))
+		return budget;
+
 again:
 	while (received < budget &&
 	       (buf = virtqueue_get_buf(vi->rvq, &len)) != NULL) {
@@ -545,26 +594,6 @@ again:
 	return received;
 }
 
-static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
-{
-	struct sk_buff *skb;
-	unsigned int len, tot_sgs = 0;
-	struct virtnet_stats __percpu *stats = this_cpu_ptr(vi->stats);
-
-	while ((skb = virtqueue_get_buf(vi->svq, &len)) != NULL) {
-		pr_debug("Sent skb %p\n", skb);
-
-		u64_stats_update_begin(&stats->syncp);
-		stats->tx_bytes += skb->len;
-		stats->tx_packets++;
-		u64_stats_update_end(&stats->syncp);
-
-		tot_sgs += skb_vnet_hdr(skb)->num_sg;
-		dev_kfree_skb_any(skb);
-	}
-	return tot_sgs;
-}
-
 static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 {
 	struct skb_vnet_hdr *hdr = skb_vnet_hdr(skb);
@@ -615,6 +644,7 @@ static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct virtnet_info *vi = netdev_priv(dev);
+	struct netdev_queue *txq = netdev_get_tx_queue(dev, 0);
 	int capacity;
 
 	/* Free up any pending old buffers before queueing new ones. */
@@ -640,6 +670,7 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 		kfree_skb(skb);
 		return NETDEV_TX_OK;
 	}
+	netdev_tx_sent_queue(txq, skb->len);
 	virtqueue_kick(vi->svq);
 
 	/* Don't wait up for transmitted skbs to be freed. */
@@ -655,9 +686,18 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 			capacity += free_old_xmit_skbs(vi);
 			if (capacity >= 2+MAX_SKB_FRAGS) {
 				netif_start_queue(dev);
-				virtqueue_disable_cb(vi->svq);
+				if (!netif_xmit_stopped(txq))
+					virtqueue_disable_cb(vi->svq);
 			}
 		}
+	} else if (unlikely(netif_xmit_stopped(txq))) {
+		/* BQL stopped the queue: ask for a completion interrupt so
+		 * the bytes in flight get reported and the queue restarted. */
+		if (unlikely(!virtqueue_enable_cb_delayed(vi->svq))) {
+			free_old_xmit_skbs(vi);
+			if (!netif_xmit_stopped(txq))
+				virtqueue_disable_cb(vi->svq);
+		}
 	}
 
 	return NETDEV_TX_OK;
@@ -1140,6 +1180,7 @@ static void free_unused_bufs(struct virtnet_info *vi)
 			break;
 		dev_kfree_skb(buf);
 	}
+	netdev_reset_queue(vi->dev);
 	while (1) {
 		buf = virtqueue_detach_unused_buf(vi->rvq);
 		if (!buf)
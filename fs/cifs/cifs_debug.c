@@ -169,10 +169,12 @@ static int cifs_debug_data_proc_show(struct seq_file *m, void *v)
 				ses->capabilities, ses->status);
 			}
 			seq_printf(m, "TCP status: %d\n\tLocal Users To "
-				   "Server: %d SecMode: 0x%x Req On Wire: %d",
+				   "Server: %d SecMode: 0x%x Req On Wire: %d "
+				   "Max Pending: %u",
 				   server->tcpStatus, server->srv_count,
 				   server->sec_mode,
-				   atomic_read(&server->inFlight));
+				   atomic_read(&server->inFlight),
+				   server->max_pending);
 
 #ifdef CONFIG_CIFS_STATS2
 			seq_printf(m, " In Send: %d In MaxReq Wait: %d",
@@ -298,6 +300,14 @@ static ssize_t cifs_stats_proc_write(struct file *file,
 					atomic_set(&tcon->num_hardlinks, 0);
 					atomic_set(&tcon->num_symlinks, 0);
 					atomic_set(&tcon->num_locks, 0);
+#ifdef CONFIG_CIFS_STATS2
+					spin_lock(&tcon->stat_lock);
+					tcon->time_reads = 0;
+					tcon->time_writes = 0;
+					tcon->nr_timed_reads = 0;
+					tcon->nr_timed_writes = 0;
+					spin_unlock(&tcon->stat_lock);
+#endif /* CONFIG_CIFS_STATS2 */
 				}
 			}
 		}
@@ -307,6 +317,29 @@ static ssize_t cifs_stats_proc_write(struct file *file,
 	return count;
 }
 
+#ifdef CONFIG_CIFS_STATS2
+/* average time from sending an async read/write to receiving its reply */
+static void cifs_stats_show_latency(struct seq_file *m, struct cifs_tcon *tcon)
+{
+	unsigned long long rtime, wtime;
+	unsigned int nr_reads, nr_writes;
+
+	spin_lock(&tcon->stat_lock);
+	rtime = tcon->time_reads;
+	wtime = tcon->time_writes;
+	nr_reads = tcon->nr_timed_reads;
+	nr_writes = tcon->nr_timed_writes;
+	spin_unlock(&tcon->stat_lock);
+
+	if (nr_reads)
+		do_div(rtime, nr_reads);
+	if (nr_writes)
+		do_div(wtime, nr_writes);
+	seq_printf(m, "\nAsync Read Latency: %u ms Write Latency: %u ms",
+		   jiffies_to_msecs(rtime), jiffies_to_msecs(wtime));
+}
+#endif /* CONFIG_CIFS_STATS2 */
+
 static int cifs_stats_proc_show(struct seq_file *m, void *v)
 {
 	int i;
@@ -365,6 +398,13 @@ static int cifs_stats_proc_show(struct seq_file *m, void *v)
 				seq_printf(m, "\nWrites: %d Bytes: %lld",
 					atomic_read(&tcon->num_writes),
 					(long long)(tcon->bytes_written));
+				seq_printf(m, "\nAsync Reads In Flight: %d "
+					      "Writes In Flight: %d",
+					atomic_read(&tcon->num_reads_inflight),
+					atomic_read(&tcon->num_writes_inflight));
+#ifdef CONFIG_CIFS_STATS2
+				cifs_stats_show_latency(m, tcon);
+#endif /* CONFIG_CIFS_STATS2 */
 				seq_printf(m, "\nFlushes: %d",
 					atomic_read(&tcon->num_flushes));
 				seq_printf(m, "\nLocks: %d HardLinks: %d "
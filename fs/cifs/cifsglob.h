@@ -207,6 +207,7 @@ struct smb_vol {
 	bool rwpidforward:1; /* pid forward for read/write operations */
 	unsigned int rsize;
 	unsigned int wsize;
+	unsigned int max_pending; /* max requests in flight to the server */
 	bool sockopt_tcp_nodelay:1;
 	unsigned short int port;
 	unsigned long actimeo; /* attribute cache timeout (jiffies) */
@@ -256,6 +257,7 @@ struct TCP_Server_Info {
 	bool noautotune;		/* do not autotune send buf sizes */
 	bool tcp_nodelay;
 	atomic_t inFlight;  /* number of requests on the wire to server */
+	unsigned int max_pending; /* limit on inFlight before callers block */
 	struct mutex srv_mutex;
 	struct task_struct *tsk;
 	char server_GUID[16];
@@ -395,6 +397,8 @@ struct cifs_tcon {
 	atomic_t num_smbs_sent;
 	atomic_t num_writes;
 	atomic_t num_reads;
+	atomic_t num_writes_inflight;	/* async writes awaiting a response */
+	atomic_t num_reads_inflight;	/* async reads awaiting a response */
 	atomic_t num_flushes;
 	atomic_t num_oplock_brks;
 	atomic_t num_opens;
@@ -417,6 +421,8 @@ struct cifs_tcon {
 #ifdef CONFIG_CIFS_STATS2
 	unsigned long long time_writes;
 	unsigned long long time_reads;
+	unsigned int nr_timed_writes;	/* async writes in time_writes */
+	unsigned int nr_timed_reads;	/* async reads in time_reads */
 	unsigned long long time_opens;
 	unsigned long long time_deletes;
 	unsigned long long time_closes;
@@ -629,6 +635,7 @@ convert_delimiter(char *path, char delim)
 
 #ifdef CONFIG_CIFS_STATS
 #define cifs_stats_inc atomic_inc
+#define cifs_stats_dec atomic_dec
 
 static inline void cifs_stats_bytes_written(struct cifs_tcon *tcon,
 					    unsigned int bytes)
@@ -650,6 +657,7 @@ static inline void cifs_stats_bytes_read(struct cifs_tcon *tcon,
 #else
 
 #define  cifs_stats_inc(field) do {} while (0)
+#define  cifs_stats_dec(field) do {} while (0)
 #define  cifs_stats_bytes_written(tcon, bytes) do {} while (0)
 #define  cifs_stats_bytes_read(tcon, bytes) do {} while (0)
 
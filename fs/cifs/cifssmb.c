@@ -1636,6 +1636,21 @@ cifs_readv_complete(struct work_struct *work)
 	cifs_readdata_free(rdata);
 }
 
+#ifdef CONFIG_CIFS_STATS2
+/* account the time from allocating the mid of an async call to its reply */
+static void
+cifs_stats_async_time(struct cifs_tcon *tcon, struct mid_q_entry *mid,
+		      unsigned long long *time, unsigned int *count)
+{
+	spin_lock(&tcon->stat_lock);
+	*time += jiffies - mid->when_alloc;
+	(*count)++;
+	spin_unlock(&tcon->stat_lock);
+}
+#else
+#define cifs_stats_async_time(tcon, mid, time, count) do {} while (0)
+#endif /* CONFIG_CIFS_STATS2 */
+
 static void
 cifs_readv_callback(struct mid_q_entry *mid)
 {
@@ -1658,6 +1673,8 @@ cifs_readv_callback(struct mid_q_entry *mid)
 		/* FIXME: should this be counted toward the initiating task? */
 		task_io_account_read(rdata->bytes);
 		cifs_stats_bytes_read(tcon, rdata->bytes);
+		cifs_stats_async_time(tcon, mid, &tcon->time_reads,
+				      &tcon->nr_timed_reads);
 		break;
 	case MID_REQUEST_SUBMITTED:
 	case MID_RETRY_NEEDED:
@@ -1667,6 +1684,7 @@ cifs_readv_callback(struct mid_q_entry *mid)
 		rdata->result = -EIO;
 	}
 
+	cifs_stats_dec(&tcon->num_reads_inflight);
 	queue_work(system_nrt_wq, &rdata->work);
 	DeleteMidQEntry(mid);
 	atomic_dec(&server->inFlight);
@@ -1723,12 +1741,15 @@ cifs_async_readv(struct cifs_readdata *rdata)
 	rdata->iov[0].iov_base = smb;
 	rdata->iov[0].iov_len = be32_to_cpu(smb->hdr.smb_buf_length) + 4;
 
+	cifs_stats_inc(&tcon->num_reads_inflight);
 	rc = cifs_call_async(tcon->ses->server, rdata->iov, 1,
 			     cifs_readv_receive, cifs_readv_callback,
 			     rdata, false);
 
 	if (rc == 0)
 		cifs_stats_inc(&tcon->num_reads);
+	else
+		cifs_stats_dec(&tcon->num_reads_inflight);
 
 	cifs_small_buf_release(smb);
 	return rc;
@@ -2098,6 +2119,8 @@ cifs_writev_callback(struct mid_q_entry *mid)
 			wdata->result = -ENOSPC;
 		else
 			wdata->bytes = written;
+		cifs_stats_async_time(tcon, mid, &tcon->time_writes,
+				      &tcon->nr_timed_writes);
 		break;
 	case MID_REQUEST_SUBMITTED:
 	case MID_RETRY_NEEDED:
@@ -2108,6 +2131,7 @@ cifs_writev_callback(struct mid_q_entry *mid)
 		break;
 	}
 
+	cifs_stats_dec(&tcon->num_writes_inflight);
 	queue_work(system_nrt_wq, &wdata->work);
 	DeleteMidQEntry(mid);
 	atomic_dec(&tcon->ses->server->inFlight);
@@ -2193,13 +2217,16 @@ cifs_async_writev(struct cifs_writedata *wdata)
 	}
 
 	kref_get(&wdata->refcount);
+	cifs_stats_inc(&tcon->num_writes_inflight);
 	rc = cifs_call_async(tcon->ses->server, iov, wdata->nr_pages + 1,
 			     NULL, cifs_writev_callback, wdata, false);
 
 	if (rc == 0)
 		cifs_stats_inc(&tcon->num_writes);
-	else
+	else {
+		cifs_stats_dec(&tcon->num_writes_inflight);
 		kref_put(&wdata->refcount, cifs_writedata_release);
+	}
 
 	/* send is done, unmap pages */
 	for (i = 0; i < wdata->nr_pages; i++)
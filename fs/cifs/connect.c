@@ -644,12 +644,12 @@ static void clean_demultiplex_info(struct TCP_Server_Info *server)
 
 	/*
 	 * Check if we have blocked requests that need to free. Note that
-	 * cifs_max_pending is normally 50, but can be set at module install
-	 * time to as little as two.
+	 * max_pending is normally 50, but can be set at module install
+	 * or mount time to as little as two.
 	 */
 	spin_lock(&GlobalMid_Lock);
-	if (atomic_read(&server->inFlight) >= cifs_max_pending)
-		atomic_set(&server->inFlight, cifs_max_pending - 1);
+	if (atomic_read(&server->inFlight) >= server->max_pending)
+		atomic_set(&server->inFlight, server->max_pending - 1);
 	/*
 	 * We do not want to set the max_pending too low or we could end up
 	 * with the counter going negative.
@@ -1330,6 +1330,17 @@ cifs_parse_mount_options(const char *mountdata, const char *devname,
 				vol->wsize =
 					simple_strtoul(value, &value, 0);
 			}
+		} else if (strnicmp(data, "max_pending", 11) == 0) {
+			if (value && *value) {
+				vol->max_pending =
+					simple_strtoul(value, &value, 0);
+				if (vol->max_pending < 2 ||
+				    vol->max_pending > 256) {
+					cERROR(1, "CIFS: max_pending must be "
+						  "between 2 and 256");
+					goto cifs_parse_mount_err;
+				}
+			}
 		} else if (strnicmp(data, "sockopt", 5) == 0) {
 			if (!value || !*value) {
 				cERROR(1, "no socket option specified");
@@ -1790,6 +1801,10 @@ static int match_server(struct TCP_Server_Info *server, struct sockaddr *addr,
 	if (!match_security(server, vol))
 		return 0;
 
+	/* a different in-flight window needs its own connection */
+	if (vol->max_pending && vol->max_pending != server->max_pending)
+		return 0;
+
 	return 1;
 }
 
@@ -1910,6 +1925,7 @@ cifs_get_tcp_session(struct smb_vol *volume_info)
 	tcp_ses->noautotune = volume_info->noautotune;
 	tcp_ses->tcp_nodelay = volume_info->sockopt_tcp_nodelay;
 	atomic_set(&tcp_ses->inFlight, 0);
+	tcp_ses->max_pending = volume_info->max_pending ? : cifs_max_pending;
 	init_waitqueue_head(&tcp_ses->response_q);
 	init_waitqueue_head(&tcp_ses->request_q);
 	INIT_LIST_HEAD(&tcp_ses->pending_mid_q);
@@ -3352,6 +3368,13 @@ cifs_get_volume_info(char *mount_data, const char *devname)
 	return volume_info;
 }
 
+/*
+ * Minimum number of rsize reads that readahead should be able to keep on
+ * the wire at once, so that sequential reads are pipelined rather than
+ * waiting for each reply before the next request goes out.
+ */
+#define CIFS_MIN_RA_READS 4
+
 /* make sure ra_pages is a multiple of rsize */
 static inline unsigned int
 cifs_ra_pages(struct cifs_sb_info *cifs_sb)
@@ -3359,12 +3382,11 @@ cifs_ra_pages(struct cifs_sb_info *cifs_sb)
 	unsigned int reads;
 	unsigned int rsize_pages = cifs_sb->rsize / PAGE_CACHE_SIZE;
 
-	if (rsize_pages >= default_backing_dev_info.ra_pages)
-		return default_backing_dev_info.ra_pages;
-	else if (rsize_pages == 0)
+	if (rsize_pages == 0)
 		return rsize_pages;
 
 	reads = default_backing_dev_info.ra_pages / rsize_pages;
+	reads = max_t(unsigned int, reads, CIFS_MIN_RA_READS);
 	return reads * rsize_pages;
 }
 
@@ -25,15 +25,65 @@ MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_queue *fuse_get_queue(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount or clone and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
 
+static struct fuse_conn *fuse_get_conn(struct file *file)
+{
+	struct fuse_queue *fq = fuse_get_queue(file);
+
+	return fq ? fq->fc : NULL;
+}
+
+void fuse_queue_init(struct fuse_queue *fq, struct fuse_conn *fc, int cpu)
+{
+	fq->fc = fc;
+	init_waitqueue_head(&fq->waitq);
+	INIT_LIST_HEAD(&fq->pending);
+	fq->fasync = NULL;
+	fq->count = 0;
+	fq->cpu = cpu;
+}
+
+/*
+ * Find the queue requests submitted on @cpu are delivered to
+ *
+ * Called with fc->lock held
+ */
+static struct fuse_queue *fuse_cpu_queue(struct fuse_conn *fc, int cpu)
+{
+	if (fc->cpu_queue && fc->cpu_queue[cpu])
+		return fc->cpu_queue[cpu];
+
+	return &fc->queue;
+}
+
+void fuse_wake_up_queues(struct fuse_conn *fc)
+{
+	int cpu;
+
+	wake_up_all(&fc->queue.waitq);
+	kill_fasync(&fc->queue.fasync, SIGIO, POLL_IN);
+	if (!fc->cpu_queue)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_queue *fq = fc->cpu_queue[cpu];
+
+		if (fq) {
+			wake_up_all(&fq->waitq);
+			kill_fasync(&fq->fasync, SIGIO, POLL_IN);
+		}
+	}
+}
+
 static void fuse_request_init(struct fuse_req *req)
 {
 	memset(req, 0, sizeof(*req));
@@ -239,16 +289,18 @@ static u64 fuse_get_unique(struct fuse_conn *fc)
 
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_queue *fq = fuse_cpu_queue(fc, req->cpu);
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &fq->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_up(&fq->waitq);
+	kill_fasync(&fq->fasync, SIGIO, POLL_IN);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -259,10 +311,22 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 
 	spin_lock(&fc->lock);
 	if (fc->connected) {
+		/*
+		 * Forgets can be read from any queue.  Wake the local one,
+		 * and the default one, which always has a reader, in case
+		 * the readers of the local queue are all busy.
+		 */
+		struct fuse_queue *fq =
+			fuse_cpu_queue(fc, raw_smp_processor_id());
+
 		fc->forget_list_tail->next = forget;
 		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+		wake_up(&fq->waitq);
+		kill_fasync(&fq->fasync, SIGIO, POLL_IN);
+		if (fq != &fc->queue) {
+			wake_up(&fc->queue.waitq);
+			kill_fasync(&fc->queue.fasync, SIGIO, POLL_IN);
+		}
 	} else {
 		kfree(forget);
 	}
@@ -335,11 +399,14 @@ __acquires(fc->lock)
 	spin_lock(&fc->lock);
 }
 
+/*
+ * Interrupts can be read from any queue.  The readers of the queue the
+ * request went to may all be busy, or gone, so wake every queue.
+ */
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
 	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_wake_up_queues(fc);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
@@ -417,6 +484,7 @@ void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 		req->out.h.error = -ECONNREFUSED;
 	else {
 		req->in.h.unique = fuse_get_unique(fc);
+		req->cpu = raw_smp_processor_id();
 		queue_request(fc, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
@@ -432,6 +500,7 @@ static void fuse_request_send_nowait_locked(struct fuse_conn *fc,
 					    struct fuse_req *req)
 {
 	req->background = 1;
+	req->cpu = raw_smp_processor_id();
 	fc->num_background++;
 	if (fc->num_background == fc->max_background)
 		fc->blocked = 1;
@@ -470,6 +539,7 @@ static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
+	req->cpu = raw_smp_processor_id();
 	spin_lock(&fc->lock);
 	if (fc->connected) {
 		queue_request(fc, req);
@@ -911,21 +981,28 @@ static int forget_pending(struct fuse_conn *fc)
 	return fc->forget_list_head.next != NULL;
 }
 
-static int request_pending(struct fuse_conn *fc)
+/*
+ * Interrupts and forgets are not bound to a queue, readers of any queue
+ * may pick them up
+ */
+static int request_pending(struct fuse_queue *fq)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
+	struct fuse_conn *fc = fq->fc;
+
+	return !list_empty(&fq->pending) || !list_empty(&fc->interrupts) ||
 		forget_pending(fc);
 }
 
 /* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void request_wait(struct fuse_queue *fq)
+__releases(fq->fc->lock)
+__acquires(fq->fc->lock)
 {
+	struct fuse_conn *fc = fq->fc;
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&fq->waitq, &wait);
+	while (fc->connected && !request_pending(fq)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
 			break;
@@ -935,7 +1012,7 @@ __acquires(fc->lock)
 		spin_lock(&fc->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&fq->waitq, &wait);
 }
 
 /*
@@ -1099,9 +1176,10 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_queue *fq, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_conn *fc = fq->fc;
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1111,15 +1189,15 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	spin_lock(&fc->lock);
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	    !request_pending(fq))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(fq);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(fq))
 		goto err_unlock;
 
 	if (!list_empty(&fc->interrupts)) {
@@ -1129,14 +1207,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	}
 
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
+		if (list_empty(&fq->pending) || fc->forget_batch-- > 0)
 			return fuse_read_forget(fc, cs, nbytes);
 
 		if (fc->forget_batch <= -8)
 			fc->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(fq->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
 	list_move(&req->list, &fc->io);
 
@@ -1190,13 +1268,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_queue *fq = fuse_get_queue(file);
+	if (!fq)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, fq->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(fq, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1224,18 +1302,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_queue *fq = fuse_get_queue(in);
+	if (!fq)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, fq->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(fq, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1889,16 +1967,18 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_queue *fq = fuse_get_queue(file);
+	struct fuse_conn *fc;
+	if (!fq)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	fc = fq->fc;
+	poll_wait(file, &fq->waitq, wait);
 
 	spin_lock(&fc->lock);
 	if (!fc->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(fq))
 		mask |= POLLIN | POLLRDNORM;
 	spin_unlock(&fc->lock);
 
@@ -1964,9 +2044,25 @@ static void end_queued_requests(struct fuse_conn *fc)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
+	LIST_HEAD(pending);
+	int cpu;
+
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
+	/*
+	 * Collect the pending requests of all queues first: a per-CPU
+	 * queue may go away while end_requests() drops the lock.
+	 */
+	list_splice_init(&fc->queue.pending, &pending);
+	if (fc->cpu_queue) {
+		for_each_possible_cpu(cpu) {
+			struct fuse_queue *fq = fc->cpu_queue[cpu];
+
+			if (fq)
+				list_splice_tail_init(&fq->pending, &pending);
+		}
+	}
+	end_requests(fc, &pending);
 	end_requests(fc, &fc->processing);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
@@ -2015,25 +2111,59 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		end_io_requests(fc);
 		end_queued_requests(fc);
 		end_polls(fc);
-		wake_up_all(&fc->waitq);
+		fuse_wake_up_queues(fc);
 		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	}
 	spin_unlock(&fc->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+/*
+ * Unbind a per-CPU queue whose last reader has gone away.  Requests
+ * still pending on it are handed to the default queue, or aborted if
+ * the connection is already dead.
+ *
+ * Called with fc->lock held, may release and reacquire it
+ */
+static void fuse_queue_unbind(struct fuse_queue *fq)
+__releases(fq->fc->lock)
+__acquires(fq->fc->lock)
+{
+	struct fuse_conn *fc = fq->fc;
+
+	fc->cpu_queue[fq->cpu] = NULL;
+	if (!fc->connected) {
+		end_requests(fc, &fq->pending);
+	} else if (!list_empty(&fq->pending)) {
+		list_splice_tail_init(&fq->pending, &fc->queue.pending);
+		wake_up(&fc->queue.waitq);
+		kill_fasync(&fc->queue.fasync, SIGIO, POLL_IN);
+	}
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_queue *fq = fuse_get_queue(file);
+	if (fq) {
+		struct fuse_conn *fc = fq->fc;
+
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
+		if (--fq->count) {
+			/* Other device files are still serving this queue */
+			fq = NULL;
+		} else if (fq == &fc->queue) {
+			fc->connected = 0;
+			fc->blocked = 0;
+			end_queued_requests(fc);
+			end_polls(fc);
+			fuse_wake_up_queues(fc);
+			wake_up_all(&fc->blocked_waitq);
+			fq = NULL;
+		} else {
+			fuse_queue_unbind(fq);
+		}
 		spin_unlock(&fc->lock);
+		kfree(fq);
 		fuse_conn_put(fc);
 	}
 
@@ -2041,14 +2171,109 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 }
 EXPORT_SYMBOL_GPL(fuse_dev_release);
 
+/*
+ * Attach a freshly opened device file to the connection of another one.
+ * With a valid @cpu the new file gets its own queue for requests
+ * submitted on that CPU (shared with earlier clones for the same CPU),
+ * otherwise it reads from the default queue.
+ */
+static int fuse_dev_clone(struct fuse_conn *fc, struct file *file, u32 cpu)
+{
+	struct fuse_queue *fq, *new_fq = NULL;
+	struct fuse_queue **cpu_queue = NULL;
+	int err;
+
+	if (cpu != FUSE_DEV_CLONE_NOCPU) {
+		if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+			return -EINVAL;
+
+		err = -ENOMEM;
+		new_fq = kmalloc(sizeof(*new_fq), GFP_KERNEL);
+		if (!new_fq)
+			goto out;
+		fuse_queue_init(new_fq, fc, cpu);
+
+		if (!fc->cpu_queue) {
+			cpu_queue = kcalloc(nr_cpu_ids, sizeof(*cpu_queue),
+					    GFP_KERNEL);
+			if (!cpu_queue)
+				goto out;
+		}
+	}
+
+	mutex_lock(&fuse_mutex);
+	err = -EINVAL;
+	if (file->private_data)
+		goto out_unlock;
+
+	spin_lock(&fc->lock);
+	if (new_fq) {
+		if (!fc->cpu_queue) {
+			fc->cpu_queue = cpu_queue;
+			cpu_queue = NULL;
+		}
+		fq = fc->cpu_queue[cpu];
+		if (!fq) {
+			fq = fc->cpu_queue[cpu] = new_fq;
+			new_fq = NULL;
+		}
+	} else {
+		fq = &fc->queue;
+	}
+	fq->count++;
+	spin_unlock(&fc->lock);
+
+	fuse_conn_get(fc);
+	file->private_data = fq;
+	err = 0;
+
+ out_unlock:
+	mutex_unlock(&fuse_mutex);
+ out:
+	kfree(cpu_queue);
+	kfree(new_fq);
+	return err;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_dev_clone clone;
+	struct file *oldfile;
+	struct fuse_conn *fc;
+	int err;
+
+	if (cmd != FUSE_DEV_IOC_CLONE_CPU)
+		return -ENOTTY;
+
+	if (copy_from_user(&clone, (void __user *) arg, sizeof(clone)))
+		return -EFAULT;
+
+	oldfile = fget(clone.fd);
+	if (!oldfile)
+		return -EBADF;
+
+	/*
+	 * Check against file->f_op, so that a CUSE channel can't be
+	 * cloned through /dev/fuse and vice versa.
+	 */
+	err = -EINVAL;
+	fc = fuse_get_conn(oldfile);
+	if (oldfile->f_op == file->f_op && fc)
+		err = fuse_dev_clone(fc, file, clone.cpu);
+
+	fput(oldfile);
+	return err;
+}
+
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_queue *fq = fuse_get_queue(file);
+	if (!fq)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &fq->fasync);
 }
 
 const struct file_operations fuse_dev_operations = {
@@ -2063,6 +2288,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
@@ -254,6 +254,9 @@ struct fuse_req {
 	/** State of the request */
 	enum fuse_req_state state;
 
+	/** CPU the request was submitted on, selects the request queue */
+	int cpu;
+
 	/** The request input */
 	struct fuse_in in;
 
@@ -312,6 +315,35 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A queue of requests waiting to be read from the device.
+ *
+ * Every connection has a default queue, served by the device file
+ * passed to mount.  Additional queues are created by cloning the
+ * device file with FUSE_DEV_IOC_CLONE_CPU and binding the clone to a CPU:
+ * requests submitted on that CPU are then only delivered to readers of
+ * the clone.  All fields except waitq are protected by fuse_conn->lock.
+ */
+struct fuse_queue {
+	/** The connection this queue belongs to */
+	struct fuse_conn *fc;
+
+	/** Readers of the queue are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** O_ASYNC requests */
+	struct fasync_struct *fasync;
+
+	/** Number of device files reading from this queue */
+	int count;
+
+	/** CPU whose requests are routed here, -1 for the default queue */
+	int cpu;
+};
+
 /**
  * A Fuse connection.
  *
@@ -344,11 +376,12 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
+	/** The default request queue */
+	struct fuse_queue queue;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Per-CPU request queues, indexed by CPU id, NULL if none is
+	    bound.  Allocated on the first FUSE_DEV_IOC_CLONE_CPU */
+	struct fuse_queue **cpu_queue;
 
 	/** The list of requests being processed */
 	struct list_head processing;
@@ -472,6 +505,10 @@ struct fuse_conn {
 	/** Do multi-page cached writes */
 	unsigned big_writes:1;
 
+	/** Use the page cache for buffered writes and write back dirty
+	    pages in batches.  Only set in INIT */
+	unsigned writeback_cache:1;
+
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
@@ -499,9 +536,6 @@ struct fuse_conn {
 	/** number of dentries used in the above array */
 	int ctl_ndents;
 
-	/** O_ASYNC requests */
-	struct fasync_struct *fasync;
-
 	/** Key for lock owner ID scrambling */
 	u32 scramble_key[4];
 
@@ -690,6 +724,16 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/**
+ * Initialize a request queue
+ */
+void fuse_queue_init(struct fuse_queue *fq, struct fuse_conn *fc, int cpu);
+
+/**
+ * Wake up readers of all request queues, called with fc->lock held
+ */
+void fuse_wake_up_queues(struct fuse_conn *fc);
+
 /**
  * Invalidate inode attributes
  */
@@ -99,6 +99,7 @@ enum {
 	Opt_mountvers,
 	Opt_nfsvers,
 	Opt_minorversion,
+	Opt_nconnect,
 
 	/* Mount options that take string arguments */
 	Opt_sec, Opt_proto, Opt_mountproto, Opt_mounthost,
@@ -166,6 +167,7 @@ static const match_table_t nfs_mount_option_tokens = {
 	{ Opt_nfsvers, "nfsvers=%s" },
 	{ Opt_nfsvers, "vers=%s" },
 	{ Opt_minorversion, "minorversion=%s" },
+	{ Opt_nconnect, "nconnect=%s" },
 
 	{ Opt_sec, "sec=%s" },
 	{ Opt_proto, "proto=%s" },
@@ -687,6 +689,8 @@ static void nfs_show_mount_options(struct seq_file *m, struct nfs_server *nfss,
 
 	seq_printf(m, ",timeo=%lu", 10U * nfss->client->cl_timeout->to_initval / HZ);
 	seq_printf(m, ",retrans=%u", nfss->client->cl_timeout->to_retries);
+	if (clp->cl_nconnect > 1)
+		seq_printf(m, ",nconnect=%u", clp->cl_nconnect);
 	seq_printf(m, ",sec=%s", nfs_pseudoflavour_to_name(nfss->client->cl_auth->au_flavor));
 
 	if (version != 4)
@@ -1322,6 +1326,12 @@ static int nfs_parse_mount_options(char *raw,
 				goto out_invalid_value;
 			mnt->minorversion = option;
 			break;
+		case Opt_nconnect:
+			if (nfs_get_option_ul(args, &option) ||
+			    option < 1 || option > RPC_MAX_NCONNECT)
+				goto out_invalid_value;
+			mnt->nconnect = option;
+			break;
 
 		/*
 		 * options that take text values
@@ -1966,6 +1976,7 @@ nfs_compare_remount_data(struct nfs_server *nfss,
 	    data->acdirmax != nfss->acdirmax / HZ ||
 	    data->timeo != (10U * nfss->client->cl_timeout->to_initval / HZ) ||
 	    data->nfs_server.port != nfss->port ||
+	    data->nconnect != nfss->nfs_client->cl_nconnect ||
 	    data->nfs_server.addrlen != nfss->nfs_client->cl_addrlen ||
 	    !rpc_cmp_addr((struct sockaddr *)&data->nfs_server.address,
 			  (struct sockaddr *)&nfss->nfs_client->cl_addr))
@@ -2011,6 +2022,7 @@ nfs_remount(struct super_block *sb, int *flags, char *raw_data)
 	data->acdirmax = nfss->acdirmax / HZ;
 	data->timeo = 10U * nfss->client->cl_timeout->to_initval / HZ;
 	data->nfs_server.port = nfss->port;
+	data->nconnect = nfss->nfs_client->cl_nconnect;
 	data->nfs_server.addrlen = nfss->nfs_client->cl_addrlen;
 	memcpy(&data->nfs_server.address, &nfss->nfs_client->cl_addr,
 		data->nfs_server.addrlen);
@@ -2505,6 +2517,16 @@ static int nfs4_validate_text_mount_data(void *options,
 		return -EINVAL;
 	}
 
+	/*
+	 * The session backchannel is only set up on the first transport,
+	 * and session operations are not pinned to it.
+	 */
+	if (args->minorversion > 0 && args->nconnect > 1) {
+		dfprintk(MOUNT,
+			 "NFS4: nconnect is not supported with NFSv4.1\n");
+		return -EINVAL;
+	}
+
 	return nfs_parse_devname(dev_name,
 				   &args->nfs_server.hostname,
 				   NFS4_MAXNAMLEN,
@@ -14,7 +14,6 @@
  * Representation of a reply cache entry.
  */
 struct svc_cacherep {
-	struct hlist_node	c_hash;
 	struct list_head	c_lru;
 
 	unsigned char		c_state,	/* unused, inprog, done */
@@ -26,6 +25,8 @@ struct svc_cacherep {
 	u32			c_proc;
 	u32			c_vers;
 	unsigned long		c_timestamp;
+	u32			c_len;		/* length of the arguments */
+	__wsum			c_csum;		/* checksum of the arguments */
 	union {
 		struct kvec	u_vec;
 		__be32		u_status;
@@ -67,10 +68,17 @@ enum {
  */
 #define RC_DELAY		(HZ/5)
 
+/* Cache entries expire after this time period */
+#define RC_EXPIRE		(120 * HZ)
+
+/* Checksum this amount of the request */
+#define RC_CSUMLEN		(256U)
+
 int	nfsd_reply_cache_init(void);
 void	nfsd_reply_cache_shutdown(void);
 int	nfsd_cache_lookup(struct svc_rqst *);
 void	nfsd_cache_update(struct svc_rqst *, int, __be32 *);
+int	nfsd_reply_cache_stats_open(struct inode *, struct file *);
 
 #ifdef CONFIG_NFSD_V4
 void	nfsd4_set_statp(struct svc_rqst *rqstp, __be32 *statp);
@@ -0,0 +1,542 @@
+/*
+ * Open-file cache for nfsd.
+ *
+ * NFSv2 and v3 have no open or close, so every READ, WRITE and COMMIT used
+ * to open the file, do its I/O and close it again. That is a permission
+ * check, a lease break, a struct file allocation and an fput per call, and
+ * the readahead state had to be saved and restored by hand between calls.
+ * Instead, the files are kept open in this cache and closed once they have
+ * not been used for a while, under memory pressure, when the last link to
+ * the file is removed, or when the filesystem is unlocked for unmounting.
+ */
+
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/file.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+#include <linux/fsnotify_backend.h>
+
+#include "nfsd.h"
+#include "vfs.h"
+#include "filecache.h"
+
+#define NFSDDBG_FACILITY	NFSDDBG_FH
+
+#define NFSD_FILE_HASH_BITS	12
+#define NFSD_FILE_HASH_SIZE	(1 << NFSD_FILE_HASH_BITS)
+
+/*
+ * The LRU is scanned this often. A file which has been neither in use nor
+ * looked up during a whole period is closed.
+ */
+#define NFSD_LAUNDRETTE_DELAY	(2 * HZ)
+
+/* The access bits that tell cached files apart */
+#define NFSD_FILE_MAY_MASK	(NFSD_MAY_READ | NFSD_MAY_WRITE)
+
+/*
+ * locking for the file cache:
+ * The hash chains are protected by their bucket lock, the LRU list by
+ * nfsd_file_lru_lock, which nests inside a bucket lock. Whoever clears
+ * NFSD_FILE_HASHED takes the file off both and drops the reference held
+ * by the hash table. The fsnotify marks are added and removed under
+ * nfsd_file_mark_mutex.
+ */
+struct nfsd_fcache_bucket {
+	struct hlist_head	nb_head;
+	spinlock_t		nb_lock;
+};
+
+static struct nfsd_fcache_bucket	*nfsd_file_hashtbl;
+static struct kmem_cache		*nfsd_file_slab;
+static struct fsnotify_group		*nfsd_file_fsnotify_group;
+
+static LIST_HEAD(nfsd_file_lru);
+static DEFINE_SPINLOCK(nfsd_file_lru_lock);
+static atomic_t				nfsd_file_lru_count;
+
+static DEFINE_MUTEX(nfsd_file_mark_mutex);
+
+static void nfsd_file_gc_worker(struct work_struct *work);
+static DECLARE_DELAYED_WORK(nfsd_filecache_laundrette, nfsd_file_gc_worker);
+
+static void
+nfsd_file_schedule_laundrette(void)
+{
+	if (atomic_read(&nfsd_file_lru_count))
+		schedule_delayed_work(&nfsd_filecache_laundrette,
+				      NFSD_LAUNDRETTE_DELAY);
+}
+
+static struct nfsd_file *
+nfsd_file_alloc(struct inode *inode, unsigned char may, unsigned int hashval)
+{
+	struct nfsd_file *nf;
+
+	nf = kmem_cache_alloc(nfsd_file_slab, GFP_KERNEL);
+	if (nf) {
+		INIT_HLIST_NODE(&nf->nf_node);
+		INIT_LIST_HEAD(&nf->nf_lru);
+		nf->nf_file = NULL;
+		nf->nf_inode = inode;
+		nf->nf_cred = get_current_cred();
+		atomic_set(&nf->nf_ref, 1);
+		nf->nf_flags = 0;
+		nf->nf_hashval = hashval;
+		nf->nf_may = may;
+	}
+	return nf;
+}
+
+static void
+nfsd_file_free(struct nfsd_file *nf)
+{
+	dprintk("nfsd: closing cached file %p\n", nf->nf_file);
+	if (nf->nf_file)
+		fput(nf->nf_file);
+	put_cred(nf->nf_cred);
+	kmem_cache_free(nfsd_file_slab, nf);
+}
+
+void
+nfsd_file_put(struct nfsd_file *nf)
+{
+	if (atomic_dec_and_test(&nf->nf_ref))
+		nfsd_file_free(nf);
+}
+
+/*
+ * I/O through a cached file is done with the credentials of whoever opened
+ * it, so only hand it to callers with the same ones. The group list of a
+ * call is built afresh for every call, compare its contents.
+ */
+static bool
+nfsd_file_match_cred(const struct cred *c1, const struct cred *c2)
+{
+	int i;
+
+	if (c1 == c2)
+		return true;
+	if (c1->fsuid != c2->fsuid || c1->fsgid != c2->fsgid)
+		return false;
+	if (!cap_issubset(c1->cap_effective, c2->cap_effective) ||
+	    !cap_issubset(c2->cap_effective, c1->cap_effective))
+		return false;
+	if (c1->group_info == c2->group_info)
+		return true;
+	if (c1->group_info->ngroups != c2->group_info->ngroups)
+		return false;
+	for (i = 0; i < c1->group_info->ngroups; i++) {
+		if (GROUP_AT(c1->group_info, i) != GROUP_AT(c2->group_info, i))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Find a cached file and take a reference to it. Must be called with the
+ * bucket lock held.
+ */
+static struct nfsd_file *
+nfsd_file_find_locked(struct inode *inode, unsigned char may,
+		      unsigned int hashval)
+{
+	struct nfsd_file *nf;
+	struct hlist_node *pos;
+	const struct cred *cred = current_cred();
+
+	hlist_for_each_entry(nf, pos, &nfsd_file_hashtbl[hashval].nb_head,
+			     nf_node) {
+		if (nf->nf_inode != inode || nf->nf_may != may)
+			continue;
+		if (!test_bit(NFSD_FILE_HASHED, &nf->nf_flags))
+			continue;
+		if (!nfsd_file_match_cred(nf->nf_cred, cred))
+			continue;
+		atomic_inc(&nf->nf_ref);
+		if (!test_bit(NFSD_FILE_REFERENCED, &nf->nf_flags))
+			set_bit(NFSD_FILE_REFERENCED, &nf->nf_flags);
+		return nf;
+	}
+	return NULL;
+}
+
+/*
+ * Take a file off the LRU once NFSD_FILE_HASHED has been cleared. Must be
+ * called with the bucket lock held.
+ */
+static void
+nfsd_file_unhash_locked(struct nfsd_file *nf)
+{
+	hlist_del_init(&nf->nf_node);
+	spin_lock(&nfsd_file_lru_lock);
+	list_del_init(&nf->nf_lru);
+	atomic_dec(&nfsd_file_lru_count);
+	spin_unlock(&nfsd_file_lru_lock);
+}
+
+/*
+ * Watch the inode of a newly cached file, so that the file can be closed
+ * when its last link is removed rather than keep the space allocated.
+ */
+static void
+nfsd_file_mark_inode(struct inode *inode)
+{
+	struct fsnotify_mark *mark, *old;
+
+	/* allocate first, this might end up in our own shrinker */
+	mark = kmalloc(sizeof(*mark), GFP_KERNEL);
+	if (!mark)
+		return;
+	fsnotify_init_mark(mark, fsnotify_free_mark_kfree);
+	mark->mask = FS_ATTRIB | FS_DELETE_SELF;
+
+	mutex_lock(&nfsd_file_mark_mutex);
+	old = fsnotify_find_inode_mark(nfsd_file_fsnotify_group, inode);
+	if (old)
+		fsnotify_put_mark(old);
+	else
+		fsnotify_add_mark(mark, nfsd_file_fsnotify_group, inode,
+				  NULL, 0);
+	mutex_unlock(&nfsd_file_mark_mutex);
+	/* the inode holds its own reference if the mark was added */
+	fsnotify_put_mark(mark);
+}
+
+/*
+ * The mark pins the inode, so remove it along with the last cached file
+ * for the inode. Called after the file has been taken off its hash chain.
+ */
+static void
+nfsd_file_unmark_inode(struct nfsd_file *nf)
+{
+	struct nfsd_fcache_bucket *b = &nfsd_file_hashtbl[nf->nf_hashval];
+	struct fsnotify_mark *mark;
+	struct nfsd_file *tmp;
+	struct hlist_node *pos;
+	bool last = true;
+
+	mutex_lock(&nfsd_file_mark_mutex);
+	spin_lock(&b->nb_lock);
+	hlist_for_each_entry(tmp, pos, &b->nb_head, nf_node) {
+		if (tmp->nf_inode == nf->nf_inode) {
+			last = false;
+			break;
+		}
+	}
+	spin_unlock(&b->nb_lock);
+
+	if (last) {
+		mark = fsnotify_find_inode_mark(nfsd_file_fsnotify_group,
+						nf->nf_inode);
+		if (mark) {
+			fsnotify_destroy_mark(mark);
+			fsnotify_put_mark(mark);
+		}
+	}
+	mutex_unlock(&nfsd_file_mark_mutex);
+}
+
+/*
+ * Drop the hash table's reference to files taken off the LRU, linked
+ * through nf_lru.
+ */
+static void
+nfsd_file_dispose_list(struct list_head *dispose)
+{
+	struct nfsd_fcache_bucket *b;
+	struct nfsd_file *nf;
+
+	while (!list_empty(dispose)) {
+		nf = list_first_entry(dispose, struct nfsd_file, nf_lru);
+		list_del_init(&nf->nf_lru);
+		if (!hlist_unhashed(&nf->nf_node)) {
+			b = &nfsd_file_hashtbl[nf->nf_hashval];
+			spin_lock(&b->nb_lock);
+			hlist_del_init(&nf->nf_node);
+			spin_unlock(&b->nb_lock);
+		}
+		nfsd_file_unmark_inode(nf);
+		nfsd_file_put(nf);
+	}
+}
+
+/*
+ * Walk up to nr_to_scan files of the LRU, and move those which are not in
+ * use and have not been looked up since the previous walk to "dispose".
+ * Files in the latter case get a second chance.
+ */
+static void
+nfsd_file_lru_scan(unsigned long nr_to_scan, struct list_head *dispose)
+{
+	struct nfsd_file *nf, *tmp;
+
+	spin_lock(&nfsd_file_lru_lock);
+	list_for_each_entry_safe(nf, tmp, &nfsd_file_lru, nf_lru) {
+		if (!nr_to_scan--)
+			break;
+		if (atomic_read(&nf->nf_ref) > 1)
+			continue;
+		if (test_and_clear_bit(NFSD_FILE_REFERENCED, &nf->nf_flags))
+			continue;
+		if (!test_and_clear_bit(NFSD_FILE_HASHED, &nf->nf_flags))
+			continue;
+		list_move(&nf->nf_lru, dispose);
+		atomic_dec(&nfsd_file_lru_count);
+	}
+	spin_unlock(&nfsd_file_lru_lock);
+}
+
+static void
+nfsd_file_gc_worker(struct work_struct *work)
+{
+	LIST_HEAD(dispose);
+
+	nfsd_file_lru_scan(ULONG_MAX, &dispose);
+	nfsd_file_dispose_list(&dispose);
+	nfsd_file_schedule_laundrette();
+}
+
+static int
+nfsd_file_lru_shrink(struct shrinker *shrink, struct shrink_control *sc)
+{
+	LIST_HEAD(dispose);
+
+	if (sc->nr_to_scan) {
+		/* closing a file may have to write to the filesystem */
+		if (!(sc->gfp_mask & __GFP_FS))
+			return -1;
+		nfsd_file_lru_scan(sc->nr_to_scan, &dispose);
+		nfsd_file_dispose_list(&dispose);
+	}
+	return atomic_read(&nfsd_file_lru_count);
+}
+
+static struct shrinker nfsd_file_shrinker = {
+	.shrink	= nfsd_file_lru_shrink,
+	.seeks	= 1,
+};
+
+/*
+ * Close the cached files of an inode, or of every inode of a superblock,
+ * or of every inode when sb is NULL.
+ */
+static void
+nfsd_file_close_matching(struct inode *inode, struct super_block *sb)
+{
+	struct nfsd_fcache_bucket *b;
+	struct nfsd_file *nf;
+	struct hlist_node *pos, *next;
+	unsigned int i, first = 0, last = NFSD_FILE_HASH_SIZE;
+	LIST_HEAD(dispose);
+
+	if (inode) {
+		first = hash_ptr(inode, NFSD_FILE_HASH_BITS);
+		last = first + 1;
+	}
+
+	for (i = first; i < last; i++) {
+		b = &nfsd_file_hashtbl[i];
+		if (hlist_empty(&b->nb_head))
+			continue;
+		spin_lock(&b->nb_lock);
+		hlist_for_each_entry_safe(nf, pos, next, &b->nb_head, nf_node) {
+			if (inode && nf->nf_inode != inode)
+				continue;
+			if (sb && nf->nf_inode->i_sb != sb)
+				continue;
+			if (!test_and_clear_bit(NFSD_FILE_HASHED, &nf->nf_flags))
+				continue;
+			nfsd_file_unhash_locked(nf);
+			list_add(&nf->nf_lru, &dispose);
+		}
+		spin_unlock(&b->nb_lock);
+	}
+	nfsd_file_dispose_list(&dispose);
+}
+
+void
+nfsd_file_cache_purge(struct super_block *sb)
+{
+	if (nfsd_file_hashtbl)
+		nfsd_file_close_matching(NULL, sb);
+}
+
+static bool
+nfsd_file_fsnotify_should_send_event(struct fsnotify_group *group,
+				     struct inode *inode,
+				     struct fsnotify_mark *inode_mark,
+				     struct fsnotify_mark *vfsmount_mark,
+				     __u32 mask, void *data, int data_type)
+{
+	/* only the removal of the last link is of interest */
+	if ((mask & FS_ATTRIB) && inode->i_nlink)
+		return false;
+	return true;
+}
+
+static int
+nfsd_file_fsnotify_handle_event(struct fsnotify_group *group,
+				struct fsnotify_mark *inode_mark,
+				struct fsnotify_mark *vfsmount_mark,
+				struct fsnotify_event *event)
+{
+	nfsd_file_close_matching(event->to_tell, NULL);
+	return 0;
+}
+
+static struct fsnotify_ops nfsd_file_fsnotify_ops = {
+	.should_send_event	= nfsd_file_fsnotify_should_send_event,
+	.handle_event		= nfsd_file_fsnotify_handle_event,
+};
+
+int
+nfsd_file_cache_init(void)
+{
+	unsigned int i;
+
+	if (nfsd_file_hashtbl)
+		return 0;
+
+	nfsd_file_slab = kmem_cache_create("nfsd_file",
+					   sizeof(struct nfsd_file), 0, 0,
+					   NULL);
+	if (!nfsd_file_slab)
+		goto out_nomem;
+
+	nfsd_file_fsnotify_group = fsnotify_alloc_group(&nfsd_file_fsnotify_ops);
+	if (IS_ERR(nfsd_file_fsnotify_group)) {
+		nfsd_file_fsnotify_group = NULL;
+		goto out_nomem;
+	}
+
+	nfsd_file_hashtbl = kcalloc(NFSD_FILE_HASH_SIZE,
+				    sizeof(*nfsd_file_hashtbl), GFP_KERNEL);
+	if (!nfsd_file_hashtbl)
+		goto out_nomem;
+	for (i = 0; i < NFSD_FILE_HASH_SIZE; i++) {
+		INIT_HLIST_HEAD(&nfsd_file_hashtbl[i].nb_head);
+		spin_lock_init(&nfsd_file_hashtbl[i].nb_lock);
+	}
+
+	atomic_set(&nfsd_file_lru_count, 0);
+	register_shrinker(&nfsd_file_shrinker);
+	return 0;
+
+out_nomem:
+	printk(KERN_ERR "nfsd: failed to allocate file cache\n");
+	if (nfsd_file_fsnotify_group) {
+		fsnotify_put_group(nfsd_file_fsnotify_group);
+		nfsd_file_fsnotify_group = NULL;
+	}
+	if (nfsd_file_slab) {
+		kmem_cache_destroy(nfsd_file_slab);
+		nfsd_file_slab = NULL;
+	}
+	return -ENOMEM;
+}
+
+/*
+ * Called once all nfsd threads are gone, so no file is in use anymore.
+ */
+void
+nfsd_file_cache_shutdown(void)
+{
+	if (!nfsd_file_hashtbl)
+		return;
+
+	unregister_shrinker(&nfsd_file_shrinker);
+	cancel_delayed_work_sync(&nfsd_filecache_laundrette);
+	nfsd_file_close_matching(NULL, NULL);
+
+	fsnotify_put_group(nfsd_file_fsnotify_group);
+	nfsd_file_fsnotify_group = NULL;
+
+	kfree(nfsd_file_hashtbl);
+	nfsd_file_hashtbl = NULL;
+	kmem_cache_destroy(nfsd_file_slab);
+	nfsd_file_slab = NULL;
+}
+
+/**
+ * nfsd_file_acquire - get an open file for a call
+ * @rqstp: the call
+ * @fhp: file handle of the file, verified here
+ * @may_flags: NFSD_MAY_ flags for the access, as for nfsd_open()
+ * @nfp: on success, the file, to be released with nfsd_file_put()
+ *
+ * Returns nfs_ok or an nfs error. The checks done by nfsd_open() are
+ * done for every call, whether the file comes from the cache or not.
+ */
+__be32
+nfsd_file_acquire(struct svc_rqst *rqstp, struct svc_fh *fhp,
+		  unsigned int may_flags, struct nfsd_file **nfp)
+{
+	struct nfsd_fcache_bucket *b;
+	struct nfsd_file *nf, *new;
+	struct inode *inode;
+	unsigned int hashval;
+	unsigned char may;
+	__be32 status;
+
+	status = fh_verify(rqstp, fhp, S_IFREG,
+			   may_flags | NFSD_MAY_OWNER_OVERRIDE);
+	if (status)
+		return status;
+
+	inode = fhp->fh_dentry->d_inode;
+	may = may_flags & NFSD_FILE_MAY_MASK;
+	hashval = hash_ptr(inode, NFSD_FILE_HASH_BITS);
+	b = &nfsd_file_hashtbl[hashval];
+
+	spin_lock(&b->nb_lock);
+	nf = nfsd_file_find_locked(inode, may, hashval);
+	spin_unlock(&b->nb_lock);
+	if (nf) {
+		status = nfsd_open_check(fhp, may_flags);
+		if (status) {
+			nfsd_file_put(nf);
+			return status;
+		}
+		*nfp = nf;
+		return nfs_ok;
+	}
+
+	new = nfsd_file_alloc(inode, may, hashval);
+	if (!new)
+		return nfserr_jukebox;
+	status = nfsd_open_verified(rqstp, fhp, may_flags, &new->nf_file);
+	if (status) {
+		new->nf_file = NULL;
+		nfsd_file_put(new);
+		return status;
+	}
+
+	/* someone else may have opened the file meanwhile */
+	spin_lock(&b->nb_lock);
+	nf = nfsd_file_find_locked(inode, may, hashval);
+	if (!nf) {
+		nf = new;
+		new = NULL;
+		/* this reference belongs to the hash table */
+		atomic_inc(&nf->nf_ref);
+		set_bit(NFSD_FILE_HASHED, &nf->nf_flags);
+		hlist_add_head(&nf->nf_node, &b->nb_head);
+		spin_lock(&nfsd_file_lru_lock);
+		list_add_tail(&nf->nf_lru, &nfsd_file_lru);
+		atomic_inc(&nfsd_file_lru_count);
+		spin_unlock(&nfsd_file_lru_lock);
+	}
+	spin_unlock(&b->nb_lock);
+
+	if (new)
+		nfsd_file_put(new);
+	else {
+		nfsd_file_mark_inode(inode);
+		nfsd_file_schedule_laundrette();
+	}
+
+	*nfp = nf;
+	return nfs_ok;
+}
@@ -0,0 +1,45 @@
+/*
+ * Open-file cache for nfsd.
+ */
+
+#ifndef _FS_NFSD_FILECACHE_H
+#define _FS_NFSD_FILECACHE_H
+
+#include <linux/fs.h>
+#include <linux/cred.h>
+
+#include "nfsfh.h"
+
+/*
+ * A file kept open by nfsd between calls, so that NFSv2/v3 READ, WRITE and
+ * COMMIT do not have to open and close the file every time, and keep their
+ * readahead state from one call to the next.
+ *
+ * Files are found by inode, access mode and credentials. The hash table
+ * holds a reference to each file in it; the other references belong to the
+ * calls using the file.
+ */
+struct nfsd_file {
+	struct hlist_node	nf_node;
+	struct list_head	nf_lru;
+	struct file		*nf_file;
+	struct inode		*nf_inode;
+	const struct cred	*nf_cred;
+	atomic_t		nf_ref;
+	unsigned long		nf_flags;
+	unsigned int		nf_hashval;
+	unsigned char		nf_may;
+};
+
+/* nf_flags */
+#define NFSD_FILE_HASHED	0	/* in the hash table and on the LRU */
+#define NFSD_FILE_REFERENCED	1	/* used since the last LRU scan */
+
+int		nfsd_file_cache_init(void);
+void		nfsd_file_cache_shutdown(void);
+void		nfsd_file_cache_purge(struct super_block *sb);
+__be32		nfsd_file_acquire(struct svc_rqst *rqstp, struct svc_fh *fhp,
+				  unsigned int may_flags, struct nfsd_file **nfp);
+void		nfsd_file_put(struct nfsd_file *nf);
+
+#endif /* _FS_NFSD_FILECACHE_H */
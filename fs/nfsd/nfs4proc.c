@@ -34,11 +34,14 @@
  */
 #include <linux/file.h>
 #include <linux/slab.h>
+#include <linux/cred.h>
+#include <linux/sched.h>
 
 #include "idmap.h"
 #include "cache.h"
 #include "xdr4.h"
 #include "vfs.h"
+#include "filecache.h"
 
 #define NFSDDBG_FACILITY		NFSDDBG_PROC
 
@@ -663,7 +666,7 @@ nfsd4_read(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 {
 	__be32 status;
 
-	/* no need to check permission - this will be done in nfsd_read() */
+	/* no need to check permission - nfsd4_encode_read() does it */
 
 	read->rd_filp = NULL;
 	if (read->rd_offset >= OFFSET_MAX)
@@ -671,8 +674,9 @@ nfsd4_read(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 
 	nfs4_lock_state();
 	/* check stateid */
-	if ((status = nfs4_preprocess_stateid_op(cstate, &read->rd_stateid,
-						 RD_STATE, &read->rd_filp))) {
+	if ((status = nfs4_preprocess_stateid_op(cstate, &cstate->current_fh,
+						 &read->rd_stateid, RD_STATE,
+						 &read->rd_filp))) {
 		dprintk("NFSD: nfsd4_read: couldn't process stateid!\n");
 		goto out;
 	}
@@ -829,7 +833,7 @@ nfsd4_setattr(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 
 	if (setattr->sa_iattr.ia_valid & ATTR_SIZE) {
 		nfs4_lock_state();
-		status = nfs4_preprocess_stateid_op(cstate,
+		status = nfs4_preprocess_stateid_op(cstate, &cstate->current_fh,
 			&setattr->sa_stateid, WR_STATE, NULL);
 		nfs4_unlock_state();
 		if (status) {
@@ -875,7 +879,8 @@ nfsd4_write(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 		return nfserr_inval;
 
 	nfs4_lock_state();
-	status = nfs4_preprocess_stateid_op(cstate, stateid, WR_STATE, &filp);
+	status = nfs4_preprocess_stateid_op(cstate, &cstate->current_fh,
+					    stateid, WR_STATE, &filp);
 	if (filp)
 		get_file(filp);
 	nfs4_unlock_state();
@@ -902,6 +907,357 @@ nfsd4_write(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 	return status;
 }
 
+/*
+ * NFSv4.2 COPY, intra-server only.  A copy the client wants done
+ * synchronously is done here, up to NFSD4_COPY_CHUNK bytes at a time;
+ * anything else goes to copy_wq, and the client is told when it is
+ * finished with a CB_OFFLOAD callback.
+ */
+
+/* the most we copy in one go, so as not to tie up an nfsd thread: */
+#define NFSD4_COPY_CHUNK	(4 << 20)
+
+static struct workqueue_struct *copy_wq;
+
+int nfsd4_create_copy_queue(void)
+{
+	copy_wq = alloc_workqueue("nfsd4_copy", WQ_UNBOUND, 0);
+	if (!copy_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void nfsd4_destroy_copy_queue(void)
+{
+	destroy_workqueue(copy_wq);
+}
+
+void nfsd4_copy_put(struct nfsd4_copy *copy)
+{
+	if (!atomic_dec_and_test(&copy->cp_refcount))
+		return;
+	fput(copy->cp_src);
+	fput(copy->cp_dst);
+	put_cred(copy->cp_cred);
+	nfsd4_put_client(copy->cp_clp);
+	kfree(copy);
+}
+
+/* Drops the client's reference, if nobody has done so yet: */
+void nfsd4_copy_unhash(struct nfsd4_copy *copy)
+{
+	struct nfs4_client *clp = copy->cp_clp;
+	bool hashed;
+
+	spin_lock(&clp->cl_lock);
+	hashed = !list_empty(&copy->cp_perclnt);
+	list_del_init(&copy->cp_perclnt);
+	spin_unlock(&clp->cl_lock);
+	if (hashed)
+		nfsd4_copy_put(copy);
+}
+
+/* must be called under cl_lock: */
+static struct nfsd4_copy *
+find_async_copy(struct nfs4_client *clp, stateid_t *stateid)
+{
+	struct nfsd4_copy *copy;
+
+	list_for_each_entry(copy, &clp->cl_copies, cp_perclnt) {
+		if (!memcmp(&copy->cp_stateid.si_opaque, &stateid->si_opaque,
+			    sizeof(stateid_opaque_t)))
+			return copy;
+	}
+	return NULL;
+}
+
+/*
+ * Cancel any copies still running for a client that is going away.
+ * This is called under the state lock, so it does not wait for them:
+ * each copy holds a reference on the client, and the copy work checks
+ * the cancelled flag under cl_lock before it queues CB_OFFLOAD.
+ */
+void nfsd4_shutdown_copy(struct nfs4_client *clp)
+{
+	struct nfsd4_copy *copy;
+	LIST_HEAD(reaplist);
+
+	spin_lock(&clp->cl_lock);
+	while (!list_empty(&clp->cl_copies)) {
+		copy = list_first_entry(&clp->cl_copies, struct nfsd4_copy,
+					cp_perclnt);
+		set_bit(NFSD4_COPY_CANCELLED, &copy->cp_flags);
+		list_move(&copy->cp_perclnt, &reaplist);
+	}
+	spin_unlock(&clp->cl_lock);
+
+	while (!list_empty(&reaplist)) {
+		copy = list_first_entry(&reaplist, struct nfsd4_copy,
+					cp_perclnt);
+		list_del_init(&copy->cp_perclnt);
+		nfsd4_copy_put(copy);
+	}
+}
+
+/*
+ * Let the exported filesystem do the copy if it can (e.g. by sharing
+ * extents), vfs_copy_file_range() falls back to splicing otherwise.
+ */
+static long
+nfsd4_copy_chunk(struct nfsd4_copy *copy, u64 done, size_t len)
+{
+	return vfs_copy_file_range(copy->cp_src, copy->cp_src_pos + done,
+				   copy->cp_dst, copy->cp_dst_pos + done,
+				   len, 0);
+}
+
+static void nfsd4_copy_work(struct work_struct *work)
+{
+	struct nfsd4_copy *copy = container_of(work, struct nfsd4_copy,
+					       cp_work);
+	struct nfs4_client *clp = copy->cp_clp;
+	const struct cred *old_cred;
+	__be32 status = nfs_ok;
+	bool cancelled;
+	u64 done = 0;
+	long bytes;
+
+	/* write as the requester, so that e.g. suid bits get killed: */
+	old_cred = override_creds(copy->cp_cred);
+	while (done < copy->cp_count) {
+		if (test_bit(NFSD4_COPY_CANCELLED, &copy->cp_flags))
+			break;
+		bytes = nfsd4_copy_chunk(copy, done,
+				min_t(u64, copy->cp_count - done,
+				      NFSD4_COPY_CHUNK));
+		if (bytes < 0)
+			status = nfserrno(bytes);
+		if (bytes <= 0)
+			break;
+		done += bytes;
+
+		/* OFFLOAD_STATUS reads these under cl_lock: */
+		spin_lock(&clp->cl_lock);
+		copy->cp_res_count = done;
+		spin_unlock(&clp->cl_lock);
+	}
+	revert_creds(old_cred);
+
+	spin_lock(&clp->cl_lock);
+	copy->cp_status = status;
+	set_bit(NFSD4_COPY_DONE, &copy->cp_flags);
+	/*
+	 * Checked under cl_lock so that nfsd4_shutdown_copy() either sees
+	 * the callback queued, and nfsd4_shutdown_callback() flushes it,
+	 * or we see the copy cancelled:
+	 */
+	cancelled = test_bit(NFSD4_COPY_CANCELLED, &copy->cp_flags);
+	if (!cancelled)
+		/* the callback inherits our reference: */
+		nfsd4_cb_offload(copy);
+	spin_unlock(&clp->cl_lock);
+
+	if (cancelled)
+		nfsd4_copy_put(copy);
+}
+
+/*
+ * Return a referenced file for the given stateid: the one the client
+ * opened, or, for the special stateids, one from the open file cache.
+ */
+static __be32
+nfsd4_copy_get_file(struct svc_rqst *rqstp,
+		    struct nfsd4_compound_state *cstate, struct svc_fh *fhp,
+		    stateid_t *stateid, int flags, struct file **filp)
+{
+	int may_flags = (flags & RD_STATE) ? NFSD_MAY_READ : NFSD_MAY_WRITE;
+	struct nfsd_file *nf;
+	__be32 status;
+
+	nfs4_lock_state();
+	status = nfs4_preprocess_stateid_op(cstate, fhp, stateid, flags,
+					    filp);
+	if (*filp)
+		get_file(*filp);
+	nfs4_unlock_state();
+	if (status)
+		return status;
+
+	if (*filp) {
+		status = nfsd_permission(rqstp, fhp->fh_export,
+				fhp->fh_dentry,
+				may_flags | NFSD_MAY_OWNER_OVERRIDE);
+		if (status) {
+			fput(*filp);
+			*filp = NULL;
+		}
+		return status;
+	}
+
+	status = nfsd_file_acquire(rqstp, fhp, may_flags, &nf);
+	if (status)
+		return status;
+	*filp = nf->nf_file;
+	get_file(*filp);
+	nfsd_file_put(nf);
+	return nfs_ok;
+}
+
+static __be32
+nfsd4_copy_check_range(struct nfsd4_copy *copy)
+{
+	struct inode *src = copy->cp_src->f_path.dentry->d_inode;
+	struct inode *dst = copy->cp_dst->f_path.dentry->d_inode;
+	loff_t size = i_size_read(src);
+
+	if (!S_ISREG(src->i_mode) || !S_ISREG(dst->i_mode))
+		return nfserr_wrong_type;
+	if (copy->cp_src_pos > size || copy->cp_dst_pos >= OFFSET_MAX)
+		return nfserr_inval;
+	/* a count of zero means "to the end of the source file": */
+	if (!copy->cp_count)
+		copy->cp_count = size - copy->cp_src_pos;
+	else if (copy->cp_count > size - copy->cp_src_pos)
+		return nfserr_inval;
+	if (copy->cp_count > OFFSET_MAX - copy->cp_dst_pos)
+		return nfserr_inval;
+
+	if (src == dst &&
+	    copy->cp_src_pos < copy->cp_dst_pos + copy->cp_count &&
+	    copy->cp_dst_pos < copy->cp_src_pos + copy->cp_count)
+		return nfserr_inval;
+	return nfs_ok;
+}
+
+static __be32
+nfsd4_copy(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
+	   struct nfsd4_copy *copy)
+{
+	struct nfs4_client *clp = cstate->session->se_client;
+	struct nfsd4_copy *async = NULL;
+	u32 *p;
+	long bytes;
+	__be32 status;
+
+	copy->cp_src = NULL;
+	copy->cp_dst = NULL;
+	if (!cstate->save_fh.fh_dentry)
+		return nfserr_nofilehandle;
+	if (cstate->save_fh.fh_export != cstate->current_fh.fh_export)
+		return nfserr_xdev;
+
+	status = nfsd4_copy_get_file(rqstp, cstate, &cstate->save_fh,
+				     &copy->cp_src_stateid, RD_STATE,
+				     &copy->cp_src);
+	if (status)
+		goto out;
+	status = nfsd4_copy_get_file(rqstp, cstate, &cstate->current_fh,
+				     &copy->cp_dst_stateid, WR_STATE,
+				     &copy->cp_dst);
+	if (status)
+		goto out;
+	status = nfsd4_copy_check_range(copy);
+	if (status)
+		goto out;
+
+	copy->cp_res_count = 0;
+	copy->cp_committed = NFS_UNSTABLE;
+	p = (u32 *)copy->cp_verf.data;
+	*p++ = nfssvc_boot.tv_sec;
+	*p++ = nfssvc_boot.tv_usec;
+
+	/*
+	 * Without a working back channel the client would never hear
+	 * that an asynchronous copy had finished:
+	 */
+	if (!copy->cp_synchronous && clp->cl_cb_state == NFSD4_CB_UP &&
+	    copy->cp_count > NFSD4_COPY_CHUNK)
+		async = kmemdup(copy, sizeof(*copy), GFP_KERNEL);
+
+	if (!async) {
+		copy->cp_synchronous = 1;
+		bytes = nfsd4_copy_chunk(copy, 0,
+				min_t(u64, copy->cp_count, NFSD4_COPY_CHUNK));
+		if (bytes < 0)
+			status = nfserrno(bytes);
+		else
+			copy->cp_res_count = bytes;
+		goto out;
+	}
+
+	/* one reference for cl_copies, one for the copy work: */
+	atomic_set(&async->cp_refcount, 2);
+	/* the client must outlive the copy, see nfsd4_shutdown_copy(): */
+	atomic_inc(&clp->cl_refcount);
+	async->cp_clp = clp;
+	async->cp_cred = get_current_cred();
+	async->cp_flags = 0;
+	fh_copy_shallow(&async->cp_fh, &cstate->current_fh.fh_handle);
+	INIT_WORK(&async->cp_work, nfsd4_copy_work);
+
+	spin_lock(&clp->cl_lock);
+	async->cp_stateid.si_generation = 1;
+	async->cp_stateid.si_opaque.so_clid = clp->cl_clientid;
+	async->cp_stateid.si_opaque.so_id = ++clp->cl_copy_id;
+	list_add(&async->cp_perclnt, &clp->cl_copies);
+	spin_unlock(&clp->cl_lock);
+
+	memcpy(&copy->cp_stateid, &async->cp_stateid, sizeof(stateid_t));
+	queue_work(copy_wq, &async->cp_work);
+	/* the files now belong to the asynchronous copy */
+	return nfs_ok;
+out:
+	if (copy->cp_src)
+		fput(copy->cp_src);
+	if (copy->cp_dst)
+		fput(copy->cp_dst);
+	return status;
+}
+
+static __be32
+nfsd4_offload_status(struct svc_rqst *rqstp,
+		     struct nfsd4_compound_state *cstate,
+		     struct nfsd4_offload_status *os)
+{
+	struct nfs4_client *clp = cstate->session->se_client;
+	struct nfsd4_copy *copy;
+	__be32 status = nfs_ok;
+
+	spin_lock(&clp->cl_lock);
+	copy = find_async_copy(clp, &os->os_stateid);
+	if (copy) {
+		os->os_count = copy->cp_res_count;
+		os->os_complete = test_bit(NFSD4_COPY_DONE, &copy->cp_flags);
+		os->os_status = copy->cp_status;
+	} else
+		status = nfserr_bad_stateid;
+	spin_unlock(&clp->cl_lock);
+	return status;
+}
+
+static __be32
+nfsd4_offload_cancel(struct svc_rqst *rqstp,
+		     struct nfsd4_compound_state *cstate,
+		     struct nfsd4_offload_status *os)
+{
+	struct nfs4_client *clp = cstate->session->se_client;
+	struct nfsd4_copy *copy;
+
+	spin_lock(&clp->cl_lock);
+	copy = find_async_copy(clp, &os->os_stateid);
+	if (copy) {
+		set_bit(NFSD4_COPY_CANCELLED, &copy->cp_flags);
+		list_del_init(&copy->cp_perclnt);
+	}
+	spin_unlock(&clp->cl_lock);
+	if (!copy)
+		return nfserr_bad_stateid;
+
+	/* the copy work notices the flag and stops at the next chunk */
+	nfsd4_copy_put(copy);
+	return nfs_ok;
+}
+
 /* This routine never returns NFS_OK!  If there are no other errors, it
  * will return NFSERR_SAME or NFSERR_NOT_SAME depending on whether the
  * attributes matched.  VERIFY is implemented by mapping NFSERR_SAME
@@ -1035,7 +1391,7 @@ struct nfsd4_operation {
 	nfsd4op_rsize op_rsize_bop;
 };
 
-static struct nfsd4_operation nfsd4_ops[];
+static struct nfsd4_operation nfsd4_ops[LAST_NFS4_OP + 1];
 
 static const char *nfsd4_op_name(unsigned opnum);
 
@@ -1248,7 +1604,8 @@ encode_op:
 			cstate->replay_owner = NULL;
 		}
 		/* XXX Ugh, we need to get rid of this kind of special case: */
-		if (op->opnum == OP_READ && op->u.read.rd_filp)
+		if ((op->opnum == OP_READ || op->opnum == OP_READ_PLUS) &&
+		    op->u.read.rd_filp)
 			fput(op->u.read.rd_filp);
 
 		nfsd4_increment_op_stats(op->opnum);
@@ -1336,6 +1693,20 @@ static inline u32 nfsd4_read_rsize(struct svc_rqst *rqstp, struct nfsd4_op *op)
 	return (op_encode_hdr_size + 2) * sizeof(__be32) + rlen;
 }
 
+static inline u32 nfsd4_read_plus_rsize(struct svc_rqst *rqstp, struct nfsd4_op *op)
+{
+	u32 maxcount = 0, rlen = 0;
+
+	maxcount = svc_max_payload(rqstp);
+	rlen = op->u.read.rd_length;
+
+	if (rlen > maxcount)
+		rlen = maxcount;
+
+	/* eof, segment count, one hole segment and one data segment: */
+	return (op_encode_hdr_size + 2 + 5 + 4) * sizeof(__be32) + rlen;
+}
+
 static inline u32 nfsd4_readdir_rsize(struct svc_rqst *rqstp, struct nfsd4_op *op)
 {
 	u32 rlen = op->u.readdir.rd_maxcount;
@@ -1403,7 +1774,16 @@ static inline u32 nfsd4_create_session_rsize(struct svc_rqst *rqstp, struct nfsd
 		op_encode_channel_attrs_maxsz) * sizeof(__be32);
 }
 
-static struct nfsd4_operation nfsd4_ops[] = {
+static inline u32 nfsd4_copy_rsize(struct svc_rqst *rqstp, struct nfsd4_op *op)
+{
+	return (op_encode_hdr_size +
+		1 + op_encode_stateid_maxsz + /* wr_callback_id */
+		2 + 1 + /* wr_count, wr_committed */
+		op_encode_verifier_maxsz + /* wr_writeverf */
+		2 /* cr_requirements */) * sizeof(__be32);
+}
+
+static struct nfsd4_operation nfsd4_ops[LAST_NFS4_OP + 1] = {
 	[OP_ACCESS] = {
 		.op_func = (nfsd4op_func)nfsd4_access,
 		.op_name = "OP_ACCESS",
@@ -1672,6 +2052,30 @@ static struct nfsd4_operation nfsd4_ops[] = {
 		.op_name = "OP_FREE_STATEID",
 		.op_rsize_bop = (nfsd4op_rsize)nfsd4_only_status_rsize,
 	},
+
+	/* NFSv4.2 operations */
+	[OP_COPY] = {
+		.op_func = (nfsd4op_func)nfsd4_copy,
+		.op_flags = OP_MODIFIES_SOMETHING,
+		.op_name = "OP_COPY",
+		.op_rsize_bop = (nfsd4op_rsize)nfsd4_copy_rsize,
+	},
+	[OP_OFFLOAD_CANCEL] = {
+		.op_func = (nfsd4op_func)nfsd4_offload_cancel,
+		.op_flags = OP_MODIFIES_SOMETHING,
+		.op_name = "OP_OFFLOAD_CANCEL",
+		.op_rsize_bop = (nfsd4op_rsize)nfsd4_only_status_rsize,
+	},
+	[OP_OFFLOAD_STATUS] = {
+		.op_func = (nfsd4op_func)nfsd4_offload_status,
+		.op_name = "OP_OFFLOAD_STATUS",
+	},
+	[OP_READ_PLUS] = {
+		.op_func = (nfsd4op_func)nfsd4_read,
+		.op_flags = OP_MODIFIES_SOMETHING,
+		.op_name = "OP_READ_PLUS",
+		.op_rsize_bop = (nfsd4op_rsize)nfsd4_read_plus_rsize,
+	},
 };
 
 static const char *nfsd4_op_name(unsigned opnum)
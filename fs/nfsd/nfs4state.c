@@ -1035,6 +1035,22 @@ release_session_client(struct nfsd4_session *session)
 	spin_unlock(&client_lock);
 }
 
+/*
+ * Drop a reference that kept the client around outside of a compound,
+ * e.g. for an asynchronous copy; frees the client if it has expired.
+ */
+void
+nfsd4_put_client(struct nfs4_client *clp)
+{
+	if (!atomic_dec_and_lock(&clp->cl_refcount, &client_lock))
+		return;
+	if (is_client_expired(clp))
+		free_client(clp);
+	else
+		renew_client_locked(clp);
+	spin_unlock(&client_lock);
+}
+
 /* must be called under the client_lock */
 static inline void
 unhash_client_locked(struct nfs4_client *clp)
@@ -1072,6 +1088,7 @@ expire_client(struct nfs4_client *clp)
 		oo = list_entry(clp->cl_openowners.next, struct nfs4_openowner, oo_perclient);
 		release_openowner(oo);
 	}
+	nfsd4_shutdown_copy(clp);
 	nfsd4_shutdown_callback(clp);
 	if (clp->cl_cb_conn.cb_xprt)
 		svc_xprt_put(clp->cl_cb_conn.cb_xprt);
@@ -1195,6 +1212,7 @@ static struct nfs4_client *create_client(struct xdr_netobj name, char *recdir,
 	INIT_LIST_HEAD(&clp->cl_delegations);
 	INIT_LIST_HEAD(&clp->cl_lru);
 	INIT_LIST_HEAD(&clp->cl_callbacks);
+	INIT_LIST_HEAD(&clp->cl_copies);
 	spin_lock_init(&clp->cl_lock);
 	INIT_WORK(&clp->cl_cb_null.cb_work, nfsd4_do_callback_rpc);
 	clp->cl_time = get_seconds();
@@ -1693,7 +1711,7 @@ nfsd4_create_session(struct svc_rqst *rqstp,
 	 * XXX: we should probably set this at creation time, and check
 	 * for consistent minorversion use throughout:
 	 */
-	conf->cl_minorversion = 1;
+	conf->cl_minorversion = cstate->minorversion;
 	/*
 	 * We do not support RDMA or persistent sessions
 	 */
@@ -3322,12 +3340,12 @@ static __be32 nfsd4_lookup_stateid(stateid_t *stateid, unsigned char typemask, s
 */
 __be32
 nfs4_preprocess_stateid_op(struct nfsd4_compound_state *cstate,
-			   stateid_t *stateid, int flags, struct file **filpp)
+			   struct svc_fh *current_fh, stateid_t *stateid,
+			   int flags, struct file **filpp)
 {
 	struct nfs4_stid *s;
 	struct nfs4_ol_stateid *stp = NULL;
 	struct nfs4_delegation *dp = NULL;
-	struct svc_fh *current_fh = &cstate->current_fh;
 	struct inode *ino = current_fh->fh_dentry->d_inode;
 	__be32 status;
 
@@ -4631,9 +4649,14 @@ __nfs4_state_start(void)
 	ret = nfsd4_create_callback_queue();
 	if (ret)
 		goto out_free_laundry;
+	ret = nfsd4_create_copy_queue();
+	if (ret)
+		goto out_free_callback;
 	queue_delayed_work(laundry_wq, &laundromat_work, nfsd4_grace * HZ);
 	set_max_delegations();
 	return 0;
+out_free_callback:
+	nfsd4_destroy_callback_queue();
 out_free_laundry:
 	destroy_workqueue(laundry_wq);
 	return ret;
@@ -4689,5 +4712,6 @@ nfs4_state_shutdown(void)
 	nfs4_release_reclaim();
 	__nfs4_state_shutdown();
 	nfs4_unlock_state();
+	nfsd4_destroy_copy_queue();
 	nfsd4_destroy_callback_queue();
 }
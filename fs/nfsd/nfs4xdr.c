@@ -51,6 +51,7 @@
 #include "acl.h"
 #include "xdr4.h"
 #include "vfs.h"
+#include "filecache.h"
 #include "state.h"
 #include "cache.h"
 
@@ -1436,6 +1437,39 @@ static __be32 nfsd4_decode_reclaim_complete(struct nfsd4_compoundargs *argp, str
 	DECODE_TAIL;
 }
 
+static __be32
+nfsd4_decode_copy(struct nfsd4_compoundargs *argp, struct nfsd4_copy *copy)
+{
+	DECODE_HEAD;
+	u32 count;
+
+	status = nfsd4_decode_stateid(argp, &copy->cp_src_stateid);
+	if (status)
+		return status;
+	status = nfsd4_decode_stateid(argp, &copy->cp_dst_stateid);
+	if (status)
+		return status;
+	READ_BUF(8 + 8 + 8 + 4 + 4 + 4);
+	READ64(copy->cp_src_pos);
+	READ64(copy->cp_dst_pos);
+	READ64(copy->cp_count);
+	READ32(copy->cp_consecutive);
+	READ32(copy->cp_synchronous);
+	READ32(count);
+	/* ca_source_server<>: only intra-server copies are supported */
+	if (count)
+		return nfserr_notsupp;
+
+	DECODE_TAIL;
+}
+
+static __be32
+nfsd4_decode_offload_status(struct nfsd4_compoundargs *argp,
+			    struct nfsd4_offload_status *os)
+{
+	return nfsd4_decode_stateid(argp, &os->os_stateid);
+}
+
 static __be32
 nfsd4_decode_noop(struct nfsd4_compoundargs *argp, void *p)
 {
@@ -1551,6 +1585,82 @@ static nfsd4_dec nfsd41_dec_ops[] = {
 	[OP_RECLAIM_COMPLETE]	= (nfsd4_dec)nfsd4_decode_reclaim_complete,
 };
 
+static nfsd4_dec nfsd42_dec_ops[] = {
+	[OP_ACCESS]		= (nfsd4_dec)nfsd4_decode_access,
+	[OP_CLOSE]		= (nfsd4_dec)nfsd4_decode_close,
+	[OP_COMMIT]		= (nfsd4_dec)nfsd4_decode_commit,
+	[OP_CREATE]		= (nfsd4_dec)nfsd4_decode_create,
+	[OP_DELEGPURGE]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_DELEGRETURN]	= (nfsd4_dec)nfsd4_decode_delegreturn,
+	[OP_GETATTR]		= (nfsd4_dec)nfsd4_decode_getattr,
+	[OP_GETFH]		= (nfsd4_dec)nfsd4_decode_noop,
+	[OP_LINK]		= (nfsd4_dec)nfsd4_decode_link,
+	[OP_LOCK]		= (nfsd4_dec)nfsd4_decode_lock,
+	[OP_LOCKT]		= (nfsd4_dec)nfsd4_decode_lockt,
+	[OP_LOCKU]		= (nfsd4_dec)nfsd4_decode_locku,
+	[OP_LOOKUP]		= (nfsd4_dec)nfsd4_decode_lookup,
+	[OP_LOOKUPP]		= (nfsd4_dec)nfsd4_decode_noop,
+	[OP_NVERIFY]		= (nfsd4_dec)nfsd4_decode_verify,
+	[OP_OPEN]		= (nfsd4_dec)nfsd4_decode_open,
+	[OP_OPENATTR]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_OPEN_CONFIRM]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_OPEN_DOWNGRADE]	= (nfsd4_dec)nfsd4_decode_open_downgrade,
+	[OP_PUTFH]		= (nfsd4_dec)nfsd4_decode_putfh,
+	[OP_PUTPUBFH]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_PUTROOTFH]		= (nfsd4_dec)nfsd4_decode_noop,
+	[OP_READ]		= (nfsd4_dec)nfsd4_decode_read,
+	[OP_READDIR]		= (nfsd4_dec)nfsd4_decode_readdir,
+	[OP_READLINK]		= (nfsd4_dec)nfsd4_decode_noop,
+	[OP_REMOVE]		= (nfsd4_dec)nfsd4_decode_remove,
+	[OP_RENAME]		= (nfsd4_dec)nfsd4_decode_rename,
+	[OP_RENEW]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_RESTOREFH]		= (nfsd4_dec)nfsd4_decode_noop,
+	[OP_SAVEFH]		= (nfsd4_dec)nfsd4_decode_noop,
+	[OP_SECINFO]		= (nfsd4_dec)nfsd4_decode_secinfo,
+	[OP_SETATTR]		= (nfsd4_dec)nfsd4_decode_setattr,
+	[OP_SETCLIENTID]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_SETCLIENTID_CONFIRM]= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_VERIFY]		= (nfsd4_dec)nfsd4_decode_verify,
+	[OP_WRITE]		= (nfsd4_dec)nfsd4_decode_write,
+	[OP_RELEASE_LOCKOWNER]	= (nfsd4_dec)nfsd4_decode_notsupp,
+
+	/* new operations for NFSv4.1 */
+	[OP_BACKCHANNEL_CTL]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_BIND_CONN_TO_SESSION]= (nfsd4_dec)nfsd4_decode_bind_conn_to_session,
+	[OP_EXCHANGE_ID]	= (nfsd4_dec)nfsd4_decode_exchange_id,
+	[OP_CREATE_SESSION]	= (nfsd4_dec)nfsd4_decode_create_session,
+	[OP_DESTROY_SESSION]	= (nfsd4_dec)nfsd4_decode_destroy_session,
+	[OP_FREE_STATEID]	= (nfsd4_dec)nfsd4_decode_free_stateid,
+	[OP_GET_DIR_DELEGATION]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_GETDEVICEINFO]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_GETDEVICELIST]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_LAYOUTCOMMIT]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_LAYOUTGET]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_LAYOUTRETURN]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_SECINFO_NO_NAME]	= (nfsd4_dec)nfsd4_decode_secinfo_no_name,
+	[OP_SEQUENCE]		= (nfsd4_dec)nfsd4_decode_sequence,
+	[OP_SET_SSV]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_TEST_STATEID]	= (nfsd4_dec)nfsd4_decode_test_stateid,
+	[OP_WANT_DELEGATION]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_DESTROY_CLIENTID]	= (nfsd4_dec)nfsd4_decode_destroy_clientid,
+	[OP_RECLAIM_COMPLETE]	= (nfsd4_dec)nfsd4_decode_reclaim_complete,
+
+	/* new operations for NFSv4.2 */
+	[OP_ALLOCATE]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_COPY]		= (nfsd4_dec)nfsd4_decode_copy,
+	[OP_COPY_NOTIFY]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_DEALLOCATE]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_IO_ADVISE]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_LAYOUTERROR]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_LAYOUTSTATS]	= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_OFFLOAD_CANCEL]	= (nfsd4_dec)nfsd4_decode_offload_status,
+	[OP_OFFLOAD_STATUS]	= (nfsd4_dec)nfsd4_decode_offload_status,
+	[OP_READ_PLUS]		= (nfsd4_dec)nfsd4_decode_read,
+	[OP_SEEK]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_WRITE_SAME]		= (nfsd4_dec)nfsd4_decode_notsupp,
+	[OP_CLONE]		= (nfsd4_dec)nfsd4_decode_notsupp,
+};
+
 struct nfsd4_minorversion_ops {
 	nfsd4_dec *decoders;
 	int nops;
@@ -1559,6 +1669,7 @@ struct nfsd4_minorversion_ops {
 static struct nfsd4_minorversion_ops nfsd4_minorversion[] = {
 	[0] = { nfsd4_dec_ops, ARRAY_SIZE(nfsd4_dec_ops) },
 	[1] = { nfsd41_dec_ops, ARRAY_SIZE(nfsd41_dec_ops) },
+	[2] = { nfsd42_dec_ops, ARRAY_SIZE(nfsd42_dec_ops) },
 };
 
 static __be32
@@ -1638,7 +1749,7 @@ nfsd4_decode_compound(struct nfsd4_compoundargs *argp)
 		}
 		op->opnum = ntohl(*argp->p++);
 
-		if (op->opnum >= FIRST_NFS4_OP && op->opnum <= LAST_NFS4_OP)
+		if (op->opnum >= FIRST_NFS4_OP && op->opnum < ops->nops)
 			op->status = ops->decoders[op->opnum](argp, &op->u);
 		else {
 			op->opnum = OP_ILLEGAL;
@@ -2884,52 +2995,75 @@ nfsd4_encode_open_downgrade(struct nfsd4_compoundres *resp, __be32 nfserr, struc
 	return nfserr;
 }
 
+/*
+ * Returns the file to read from: either the one belonging to the
+ * stateid, or, in the NFSv4 special stateid case, one from the open
+ * file cache, which the caller must release with nfsd_file_put().
+ */
 static __be32
-nfsd4_encode_read(struct nfsd4_compoundres *resp, __be32 nfserr,
-		  struct nfsd4_read *read)
+nfsd4_read_get_file(struct nfsd4_compoundres *resp, struct nfsd4_read *read,
+		    struct nfsd_file **nfp, struct file **filp)
 {
-	u32 eof;
-	int v, pn;
-	unsigned long maxcount; 
-	long len;
-	__be32 *p;
+	struct svc_fh *fhp = read->rd_fhp;
+	__be32 nfserr;
 
-	if (nfserr)
-		return nfserr;
-	if (resp->xbuf->page_len)
-		return nfserr_resource;
+	*nfp = NULL;
+	*filp = read->rd_filp;
+	if (*filp)
+		return nfsd_permission(resp->rqstp, fhp->fh_export,
+				fhp->fh_dentry,
+				NFSD_MAY_READ|NFSD_MAY_OWNER_OVERRIDE);
 
-	RESERVE_SPACE(8); /* eof flag and byte count */
+	nfserr = nfsd_file_acquire(resp->rqstp, fhp, NFSD_MAY_READ, nfp);
+	if (!nfserr)
+		*filp = (*nfp)->nf_file;
+	return nfserr;
+}
 
-	maxcount = svc_max_payload(resp->rqstp);
-	if (maxcount > read->rd_length)
-		maxcount = read->rd_length;
+/*
+ * Read up to *maxcount bytes at @offset into the reply pages.
+ */
+static __be32
+nfsd4_read_pages(struct nfsd4_compoundres *resp, struct nfsd4_read *read,
+		 struct file *file, loff_t offset, unsigned long *maxcount)
+{
+	struct svc_rqst *rqstp = resp->rqstp;
+	long len;
+	int v, pn;
 
-	len = maxcount;
+	/*
+	 * As for v2/v3, send page cache pages straight from the file
+	 * rather than copy the data into the reply pages.
+	 */
+	if (nfsd_read_splice_ok(rqstp, file))
+		return nfsd_splice_read(rqstp, file, offset, maxcount);
+
+	len = *maxcount;
 	v = 0;
 	while (len > 0) {
-		pn = resp->rqstp->rq_resused++;
-		resp->rqstp->rq_vec[v].iov_base =
-			page_address(resp->rqstp->rq_respages[pn]);
-		resp->rqstp->rq_vec[v].iov_len =
+		pn = rqstp->rq_resused++;
+		rqstp->rq_vec[v].iov_base =
+			page_address(rqstp->rq_respages[pn]);
+		rqstp->rq_vec[v].iov_len =
 			len < PAGE_SIZE ? len : PAGE_SIZE;
 		v++;
 		len -= PAGE_SIZE;
 	}
 	read->rd_vlen = v;
 
-	nfserr = nfsd_read_file(read->rd_rqstp, read->rd_fhp, read->rd_filp,
-			read->rd_offset, resp->rqstp->rq_vec, read->rd_vlen,
-			&maxcount);
+	return nfsd_readv(file, offset, rqstp->rq_vec, read->rd_vlen,
+			maxcount);
+}
 
-	if (nfserr)
-		return nfserr;
-	eof = (read->rd_offset + maxcount >=
-	       read->rd_fhp->fh_dentry->d_inode->i_size);
+/*
+ * Close off the head at resp->p and account for the @maxcount bytes
+ * of read data now in the page list.
+ */
+static void
+nfsd4_read_finish_pages(struct nfsd4_compoundres *resp, unsigned long maxcount)
+{
+	__be32 *p = resp->p;
 
-	WRITE32(eof);
-	WRITE32(maxcount);
-	ADJUST_ARGS();
 	resp->xbuf->head[0].iov_len = (char*)p
 					- (char*)resp->xbuf->head[0].iov_base;
 	resp->xbuf->page_len = maxcount;
@@ -2944,9 +3078,144 @@ nfsd4_encode_read(struct nfsd4_compoundres *resp, __be32 nfserr,
 		resp->xbuf->tail[0].iov_len = 4 - (maxcount&3);
 		ADJUST_ARGS();
 	}
+}
+
+static __be32
+nfsd4_encode_read(struct nfsd4_compoundres *resp, __be32 nfserr,
+		  struct nfsd4_read *read)
+{
+	struct svc_rqst *rqstp = resp->rqstp;
+	struct svc_fh *fhp = read->rd_fhp;
+	struct nfsd_file *nf;
+	struct file *file;
+	u32 eof;
+	unsigned long maxcount; 
+	__be32 *p;
+
+	if (nfserr)
+		return nfserr;
+	if (resp->xbuf->page_len)
+		return nfserr_resource;
+
+	/* Note file may still be NULL in NFSv4 special stateid case: */
+	nfserr = nfsd4_read_get_file(resp, read, &nf, &file);
+	if (nfserr)
+		return nfserr;
+
+	RESERVE_SPACE(8); /* eof flag and byte count */
+
+	maxcount = svc_max_payload(rqstp);
+	if (maxcount > read->rd_length)
+		maxcount = read->rd_length;
+
+	nfserr = nfsd4_read_pages(resp, read, file, read->rd_offset,
+			&maxcount);
+	if (nf)
+		nfsd_file_put(nf);
+
+	if (nfserr)
+		return nfserr;
+	eof = (read->rd_offset + maxcount >=
+	       fhp->fh_dentry->d_inode->i_size);
+
+	WRITE32(eof);
+	WRITE32(maxcount);
+	ADJUST_ARGS();
+	nfsd4_read_finish_pages(resp, maxcount);
 	return 0;
 }
 
+/*
+ * READ_PLUS returns the range as a list of data and hole segments,
+ * using SEEK_DATA/SEEK_HOLE to find out where the filesystem has
+ * allocated blocks.  We encode at most one hole segment followed by
+ * at most one data segment, so that the data can go in the page list
+ * just as it does for READ; a client that wants more simply sends
+ * another READ_PLUS from where this one stopped.
+ */
+static __be32
+nfsd4_encode_read_plus(struct nfsd4_compoundres *resp, __be32 nfserr,
+		       struct nfsd4_read *read)
+{
+	struct svc_rqst *rqstp = resp->rqstp;
+	struct svc_fh *fhp = read->rd_fhp;
+	struct nfsd_file *nf;
+	struct file *file;
+	loff_t offset = read->rd_offset;
+	loff_t size, data, hole;
+	unsigned long count, maxcount;
+	u32 eof, segments = 0;
+	__be32 *eofp, *p;
+
+	if (nfserr)
+		return nfserr;
+	if (resp->xbuf->page_len)
+		return nfserr_resource;
+
+	nfserr = nfsd4_read_get_file(resp, read, &nf, &file);
+	if (nfserr)
+		return nfserr;
+
+	RESERVE_SPACE(8); /* eof flag and segment count */
+	eofp = p;
+	p += 2;
+	ADJUST_ARGS();
+
+	count = read->rd_length;
+	size = i_size_read(fhp->fh_dentry->d_inode);
+
+	data = vfs_llseek(file, offset, SEEK_DATA);
+	if (data == -ENXIO)
+		data = size;		/* nothing but hole up to EOF */
+	else if (data < 0)
+		data = offset;		/* no hole information; treat as data */
+
+	if (data > offset && offset < size) {
+		unsigned long len = min_t(loff_t, data - offset, count);
+
+		RESERVE_SPACE(4 + 8 + 8);
+		WRITE32(NFS4_CONTENT_HOLE);
+		WRITE64(offset);
+		WRITE64(len);
+		ADJUST_ARGS();
+		segments++;
+		offset += len;
+		count -= len;
+	}
+
+	if (count && offset < size) {
+		hole = vfs_llseek(file, offset, SEEK_HOLE);
+		if (hole < 0)
+			hole = size;
+		maxcount = min_t(loff_t, svc_max_payload(rqstp), count);
+		if (hole > offset && maxcount > hole - offset)
+			maxcount = hole - offset;
+
+		nfserr = nfsd4_read_pages(resp, read, file, offset, &maxcount);
+		if (nfserr) {
+			/* throw away the eof flag and any hole segment */
+			resp->p = eofp;
+			goto out;
+		}
+		RESERVE_SPACE(4 + 8 + 4);
+		WRITE32(NFS4_CONTENT_DATA);
+		WRITE64(offset);
+		WRITE32(maxcount);
+		ADJUST_ARGS();
+		segments++;
+		offset += maxcount;
+		nfsd4_read_finish_pages(resp, maxcount);
+	}
+
+	eof = (offset >= size);
+	*eofp++ = htonl(eof);
+	*eofp = htonl(segments);
+out:
+	if (nf)
+		nfsd_file_put(nf);
+	return nfserr;
+}
+
 static __be32
 nfsd4_encode_readlink(struct nfsd4_compoundres *resp, __be32 nfserr, struct nfsd4_readlink *readlink)
 {
@@ -3364,6 +3633,53 @@ nfsd4_encode_free_stateid(struct nfsd4_compoundres *resp, int nfserr,
 	return nfserr;
 }
 
+static __be32
+nfsd4_encode_copy(struct nfsd4_compoundres *resp, __be32 nfserr,
+		  struct nfsd4_copy *copy)
+{
+	__be32 *p;
+
+	if (nfserr)
+		return nfserr;
+
+	/* cr_response.wr_callback_id<1> */
+	RESERVE_SPACE(4);
+	WRITE32(copy->cp_synchronous ? 0 : 1);
+	ADJUST_ARGS();
+	if (!copy->cp_synchronous)
+		nfsd4_encode_stateid(resp, &copy->cp_stateid);
+
+	RESERVE_SPACE(8 + 4 + NFS4_VERIFIER_SIZE + 4 + 4);
+	WRITE64(copy->cp_res_count);
+	WRITE32(copy->cp_committed);
+	WRITEMEM(copy->cp_verf.data, NFS4_VERIFIER_SIZE);
+	/* cr_requirements: we always copy consecutively */
+	WRITE32(1);
+	WRITE32(copy->cp_synchronous);
+	ADJUST_ARGS();
+	return nfserr;
+}
+
+static __be32
+nfsd4_encode_offload_status(struct nfsd4_compoundres *resp, __be32 nfserr,
+			    struct nfsd4_offload_status *os)
+{
+	__be32 *p;
+
+	if (nfserr)
+		return nfserr;
+
+	RESERVE_SPACE(8 + 4 + 4);
+	WRITE64(os->os_count);
+	if (os->os_complete) {
+		WRITE32(1);
+		*p++ = os->os_status;
+	} else
+		WRITE32(0);
+	ADJUST_ARGS();
+	return nfserr;
+}
+
 static __be32
 nfsd4_encode_sequence(struct nfsd4_compoundres *resp, int nfserr,
 		      struct nfsd4_sequence *seq)
@@ -3490,6 +3806,21 @@ static nfsd4_enc nfsd4_enc_ops[] = {
 	[OP_WANT_DELEGATION]	= (nfsd4_enc)nfsd4_encode_noop,
 	[OP_DESTROY_CLIENTID]	= (nfsd4_enc)nfsd4_encode_noop,
 	[OP_RECLAIM_COMPLETE]	= (nfsd4_enc)nfsd4_encode_noop,
+
+	/* NFSv4.2 operations */
+	[OP_ALLOCATE]		= (nfsd4_enc)nfsd4_encode_noop,
+	[OP_COPY]		= (nfsd4_enc)nfsd4_encode_copy,
+	[OP_COPY_NOTIFY]	= (nfsd4_enc)nfsd4_encode_noop,
+	[OP_DEALLOCATE]		= (nfsd4_enc)nfsd4_encode_noop,
+	[OP_IO_ADVISE]		= (nfsd4_enc)nfsd4_encode_noop,
+	[OP_LAYOUTERROR]	= (nfsd4_enc)nfsd4_encode_noop,
+	[OP_LAYOUTSTATS]	= (nfsd4_enc)nfsd4_encode_noop,
+	[OP_OFFLOAD_CANCEL]	= (nfsd4_enc)nfsd4_encode_noop,
+	[OP_OFFLOAD_STATUS]	= (nfsd4_enc)nfsd4_encode_offload_status,
+	[OP_READ_PLUS]		= (nfsd4_enc)nfsd4_encode_read_plus,
+	[OP_SEEK]		= (nfsd4_enc)nfsd4_encode_noop,
+	[OP_WRITE_SAME]		= (nfsd4_enc)nfsd4_encode_noop,
+	[OP_CLONE]		= (nfsd4_enc)nfsd4_encode_noop,
 };
 
 /*
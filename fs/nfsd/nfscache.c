@@ -9,64 +9,160 @@
  */
 
 #include <linux/slab.h>
+#include <linux/highmem.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
+#include <net/checksum.h>
 
 #include "nfsd.h"
 #include "cache.h"
 
-/* Size of reply cache. Common values are:
+#define NFSDDBG_FACILITY	NFSDDBG_REPCACHE
+
+/*
+ * The cache is sized from the amount of low memory, see
+ * nfsd_cache_size_limit(). For reference, the fixed sizes used by
+ * other implementations are:
  * 4.3BSD:	128
  * 4.4BSD:	256
  * Solaris2:	1024
  * DEC Unix:	512-4096
  */
-#define CACHESIZE		1024
-#define HASHSIZE		64
+#define CACHESIZE_MAX		(256 * 1024)
 
-static struct hlist_head *	cache_hash;
-static struct list_head 	lru_head;
+/* Aim for hash chains (and thus per-bucket LRU lists) of this length */
+#define TARGET_BUCKET_SIZE	32
+
+/*
+ * Each bucket has its own lock and its own LRU list, which doubles as
+ * the hash chain, so that nfsd threads handling different XIDs do not
+ * serialise on a single lock.
+ */
+struct nfsd_drc_bucket {
+	struct list_head	lru_head;
+	spinlock_t		cache_lock;
+};
+
+static struct nfsd_drc_bucket	*drc_hashtbl;
+static unsigned int		drc_hashbits;
+static struct kmem_cache	*drc_slab;
 static int			cache_disabled = 1;
 
+/* max number of entries allowed in the cache */
+static unsigned int		max_drc_entries;
+
+/* number of entries and bytes of memory currently in the cache */
+static atomic_t			num_drc_entries;
+static atomic_t			drc_mem_usage;
+
 /*
- * Calculate the hash index from an XID.
+ * Statistics for /proc/fs/nfsd/reply_cache_stats. Like the hit and miss
+ * counters in nfsdstats, these are updated under a bucket lock only and
+ * are thus approximate.
  */
-static inline u32 request_hash(u32 xid)
-{
-	u32 h = xid;
-	h ^= (xid >> 24);
-	return h & (HASHSIZE-1);
-}
+static unsigned int		payload_misses;
+static unsigned int		longest_chain;
+static unsigned int		longest_chain_cachesize;
 
 static int	nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *vec);
+static int	nfsd_reply_cache_shrink(struct shrinker *shrink,
+					struct shrink_control *sc);
+
+static struct shrinker nfsd_reply_cache_shrinker = {
+	.shrink	= nfsd_reply_cache_shrink,
+	.seeks	= 1,
+};
 
 /*
  * locking for the reply cache:
  * A cache entry is "single use" if c_state == RC_INPROG
- * Otherwise, it when accessing _prev or _next, the lock must be held.
+ * Otherwise, when accessing c_lru or freeing the entry, the lock of the
+ * bucket the entry hashes to must be held.
  */
-static DEFINE_SPINLOCK(cache_lock);
 
-int nfsd_reply_cache_init(void)
+/*
+ * Allow an entry for every 64 KB (with 4 KB pages) of the square root of
+ * the number of low memory pages, up to CACHESIZE_MAX. This gives 8192
+ * entries for 64 MB of memory and 128K entries for 16 GB, enough to keep
+ * an entry around until the client retransmits at high RPC rates, while
+ * growing slowly enough on large machines.
+ */
+static unsigned int nfsd_cache_size_limit(void)
+{
+	unsigned int limit;
+	unsigned long low_pages = totalram_pages - totalhigh_pages;
+
+	limit = (16 * int_sqrt(low_pages)) << (PAGE_SHIFT - 10);
+	return min_t(unsigned int, limit, CACHESIZE_MAX);
+}
+
+/*
+ * Calculate the hash bucket from an XID.
+ */
+static inline struct nfsd_drc_bucket *nfsd_cache_bucket(__be32 xid)
+{
+	return &drc_hashtbl[hash_32(be32_to_cpu(xid), drc_hashbits)];
+}
+
+static struct svc_cacherep *nfsd_reply_cache_alloc(void)
 {
 	struct svc_cacherep	*rp;
-	int			i;
-
-	INIT_LIST_HEAD(&lru_head);
-	i = CACHESIZE;
-	while (i) {
-		rp = kmalloc(sizeof(*rp), GFP_KERNEL);
-		if (!rp)
-			goto out_nomem;
-		list_add(&rp->c_lru, &lru_head);
+
+	rp = kmem_cache_alloc(drc_slab, GFP_KERNEL);
+	if (rp) {
 		rp->c_state = RC_UNUSED;
 		rp->c_type = RC_NOCACHE;
-		INIT_HLIST_NODE(&rp->c_hash);
-		i--;
+		INIT_LIST_HEAD(&rp->c_lru);
 	}
+	return rp;
+}
+
+static void nfsd_reply_cache_free_locked(struct svc_cacherep *rp)
+{
+	if (rp->c_type == RC_REPLBUFF && rp->c_replvec.iov_base) {
+		atomic_sub(rp->c_replvec.iov_len, &drc_mem_usage);
+		kfree(rp->c_replvec.iov_base);
+	}
+	list_del(&rp->c_lru);
+	atomic_dec(&num_drc_entries);
+	atomic_sub(sizeof(*rp), &drc_mem_usage);
+	kmem_cache_free(drc_slab, rp);
+}
 
-	cache_hash = kcalloc (HASHSIZE, sizeof(struct hlist_head), GFP_KERNEL);
-	if (!cache_hash)
+static void nfsd_reply_cache_free(struct nfsd_drc_bucket *b,
+				  struct svc_cacherep *rp)
+{
+	spin_lock(&b->cache_lock);
+	nfsd_reply_cache_free_locked(rp);
+	spin_unlock(&b->cache_lock);
+}
+
+int nfsd_reply_cache_init(void)
+{
+	unsigned int		hashsize, i;
+
+	max_drc_entries = nfsd_cache_size_limit();
+	hashsize = roundup_pow_of_two(DIV_ROUND_UP(max_drc_entries,
+						   TARGET_BUCKET_SIZE));
+	drc_hashbits = ilog2(hashsize);
+	atomic_set(&num_drc_entries, 0);
+	atomic_set(&drc_mem_usage, 0);
+
+	drc_slab = kmem_cache_create("nfsd_drc", sizeof(struct svc_cacherep),
+				     0, 0, NULL);
+	if (!drc_slab)
+		goto out_nomem;
+
+	drc_hashtbl = kcalloc(hashsize, sizeof(*drc_hashtbl), GFP_KERNEL);
+	if (!drc_hashtbl)
 		goto out_nomem;
+	for (i = 0; i < hashsize; i++) {
+		INIT_LIST_HEAD(&drc_hashtbl[i].lru_head);
+		spin_lock_init(&drc_hashtbl[i].cache_lock);
+	}
 
+	register_shrinker(&nfsd_reply_cache_shrinker);
 	cache_disabled = 0;
 	return 0;
 out_nomem:
@@ -78,55 +174,188 @@ out_nomem:
 void nfsd_reply_cache_shutdown(void)
 {
 	struct svc_cacherep	*rp;
+	unsigned int		i;
 
-	while (!list_empty(&lru_head)) {
-		rp = list_entry(lru_head.next, struct svc_cacherep, c_lru);
-		if (rp->c_state == RC_DONE && rp->c_type == RC_REPLBUFF)
-			kfree(rp->c_replvec.iov_base);
-		list_del(&rp->c_lru);
-		kfree(rp);
+	if (!cache_disabled)
+		unregister_shrinker(&nfsd_reply_cache_shrinker);
+	cache_disabled = 1;
+
+	if (drc_hashtbl) {
+		for (i = 0; i < (1U << drc_hashbits); i++) {
+			struct list_head *head = &drc_hashtbl[i].lru_head;
+
+			while (!list_empty(head)) {
+				rp = list_first_entry(head, struct svc_cacherep,
+						      c_lru);
+				nfsd_reply_cache_free_locked(rp);
+			}
+		}
 	}
 
-	cache_disabled = 1;
+	kfree(drc_hashtbl);
+	drc_hashtbl = NULL;
 
-	kfree (cache_hash);
-	cache_hash = NULL;
+	if (drc_slab) {
+		kmem_cache_destroy(drc_slab);
+		drc_slab = NULL;
+	}
 }
 
 /*
- * Move cache entry to end of LRU list
+ * Move cache entry to end of LRU list, and refresh its timestamp
  */
 static void
-lru_put_end(struct svc_cacherep *rp)
+lru_put_end(struct nfsd_drc_bucket *b, struct svc_cacherep *rp)
 {
-	list_move_tail(&rp->c_lru, &lru_head);
+	rp->c_timestamp = jiffies;
+	list_move_tail(&rp->c_lru, &b->lru_head);
 }
 
 /*
- * Move a cache entry from one hash list to another
+ * Free the expired entries at the head of a bucket's LRU list, or all of
+ * the completed ones while the cache is over its size limit. Entries for
+ * calls still in progress are skipped. Must be called with the bucket
+ * lock held.
  */
-static void
-hash_refile(struct svc_cacherep *rp)
+static int
+prune_bucket(struct nfsd_drc_bucket *b)
+{
+	struct svc_cacherep	*rp, *tmp;
+	int			freed = 0;
+
+	list_for_each_entry_safe(rp, tmp, &b->lru_head, c_lru) {
+		if (rp->c_state == RC_INPROG)
+			continue;
+		if (atomic_read(&num_drc_entries) <= max_drc_entries &&
+		    time_before(jiffies, rp->c_timestamp + RC_EXPIRE))
+			break;
+		nfsd_reply_cache_free_locked(rp);
+		freed++;
+	}
+	return freed;
+}
+
+/*
+ * Expired entries are otherwise only freed when their bucket is looked
+ * up again, so let memory pressure clean up after a burst of calls.
+ */
+static int
+nfsd_reply_cache_shrink(struct shrinker *shrink, struct shrink_control *sc)
+{
+	struct nfsd_drc_bucket	*b;
+	unsigned int		i;
+
+	if (sc->nr_to_scan) {
+		for (i = 0; i < (1U << drc_hashbits); i++) {
+			b = &drc_hashtbl[i];
+			if (list_empty(&b->lru_head))
+				continue;
+			spin_lock(&b->cache_lock);
+			prune_bucket(b);
+			spin_unlock(&b->cache_lock);
+		}
+	}
+	return atomic_read(&num_drc_entries);
+}
+
+/*
+ * Checksum the start of the call's arguments, so that a retransmission
+ * is told apart from a new call that happens to reuse the XID, as some
+ * clients do after a reboot.
+ */
+static __wsum
+nfsd_cache_csum(struct svc_rqst *rqstp)
 {
-	hlist_del_init(&rp->c_hash);
-	hlist_add_head(&rp->c_hash, cache_hash + request_hash(rp->c_xid));
+	struct xdr_buf		*buf = &rqstp->rq_arg;
+	const unsigned char	*p = buf->head[0].iov_base;
+	size_t			csum_len = min_t(size_t, buf->head[0].iov_len +
+						 buf->page_len, RC_CSUMLEN);
+	size_t			len = min(buf->head[0].iov_len, csum_len);
+	unsigned int		idx, base;
+	__wsum			csum;
+
+	csum = csum_partial(p, len, 0);
+	csum_len -= len;
+
+	/* continue into the page array */
+	idx = buf->page_base / PAGE_SIZE;
+	base = buf->page_base & ~PAGE_MASK;
+	while (csum_len) {
+		p = page_address(buf->pages[idx]) + base;
+		len = min_t(size_t, PAGE_SIZE - base, csum_len);
+		csum = csum_partial(p, len, csum);
+		csum_len -= len;
+		base = 0;
+		++idx;
+	}
+	return csum;
+}
+
+static int
+nfsd_cache_match(struct svc_rqst *rqstp, __wsum csum, struct svc_cacherep *rp)
+{
+	/* check the RPC header first, it is the cheapest to compare */
+	if (rqstp->rq_xid != rp->c_xid || rqstp->rq_proc != rp->c_proc ||
+	    rqstp->rq_prot != rp->c_prot || rqstp->rq_vers != rp->c_vers ||
+	    memcmp((char*)&rqstp->rq_addr, (char*)&rp->c_addr, sizeof(rp->c_addr)))
+		return 0;
+
+	/* then the length and checksum of the arguments */
+	if (rqstp->rq_arg.len != rp->c_len || csum != rp->c_csum) {
+		payload_misses++;
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Search a bucket for an entry matching the current call. Must be called
+ * with the bucket lock held.
+ */
+static struct svc_cacherep *
+nfsd_cache_search(struct nfsd_drc_bucket *b, struct svc_rqst *rqstp,
+		  __wsum csum)
+{
+	struct svc_cacherep	*rp, *ret = NULL;
+	unsigned int		entries = 0;
+
+	list_for_each_entry(rp, &b->lru_head, c_lru) {
+		++entries;
+		if (nfsd_cache_match(rqstp, csum, rp)) {
+			ret = rp;
+			break;
+		}
+	}
+
+	if (entries > longest_chain) {
+		longest_chain = entries;
+		longest_chain_cachesize = atomic_read(&num_drc_entries);
+	} else if (entries == longest_chain) {
+		/* prefer to keep the smallest cachesize possible here */
+		longest_chain_cachesize = min_t(unsigned int,
+						longest_chain_cachesize,
+						atomic_read(&num_drc_entries));
+	}
+
+	return ret;
 }
 
 /*
  * Try to find an entry matching the current call in the cache. When none
- * is found, we grab the oldest unlocked entry off the LRU list.
- * Note that no operation within the loop may sleep.
+ * is found, a new entry is added for the call. The entry is allocated
+ * up front, since a miss is the common case.
+ * Note that no operation within the locked section may sleep.
  */
 int
 nfsd_cache_lookup(struct svc_rqst *rqstp)
 {
-	struct hlist_node	*hn;
-	struct hlist_head 	*rh;
-	struct svc_cacherep	*rp;
+	struct svc_cacherep	*rp, *found;
+	struct nfsd_drc_bucket	*b;
 	__be32			xid = rqstp->rq_xid;
 	u32			proto =  rqstp->rq_prot,
 				vers = rqstp->rq_vers,
 				proc = rqstp->rq_proc;
+	__wsum			csum;
 	unsigned long		age;
 	int type = rqstp->rq_cachetype;
 	int rtn;
@@ -137,45 +366,33 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 		return RC_DOIT;
 	}
 
-	spin_lock(&cache_lock);
-	rtn = RC_DOIT;
+	csum = nfsd_cache_csum(rqstp);
+	b = nfsd_cache_bucket(xid);
 
-	rh = &cache_hash[request_hash(xid)];
-	hlist_for_each_entry(rp, hn, rh, c_hash) {
-		if (rp->c_state != RC_UNUSED &&
-		    xid == rp->c_xid && proc == rp->c_proc &&
-		    proto == rp->c_prot && vers == rp->c_vers &&
-		    time_before(jiffies, rp->c_timestamp + 120*HZ) &&
-		    memcmp((char*)&rqstp->rq_addr, (char*)&rp->c_addr, sizeof(rp->c_addr))==0) {
-			nfsdstats.rchits++;
-			goto found_entry;
-		}
+	rp = nfsd_reply_cache_alloc();
+	if (rp) {
+		atomic_inc(&num_drc_entries);
+		atomic_add(sizeof(*rp), &drc_mem_usage);
 	}
-	nfsdstats.rcmisses++;
 
-	/* This loop shouldn't take more than a few iterations normally */
-	{
-	int	safe = 0;
-	list_for_each_entry(rp, &lru_head, c_lru) {
-		if (rp->c_state != RC_INPROG)
-			break;
-		if (safe++ > CACHESIZE) {
-			printk("nfsd: loop in repcache LRU list\n");
-			cache_disabled = 1;
-			goto out;
-		}
-	}
-	}
+	spin_lock(&b->cache_lock);
+	rtn = RC_DOIT;
 
-	/* All entries on the LRU are in-progress. This should not happen */
-	if (&rp->c_lru == &lru_head) {
-		static int	complaints;
+	prune_bucket(b);
 
-		printk(KERN_WARNING "nfsd: all repcache entries locked!\n");
-		if (++complaints > 5) {
-			printk(KERN_WARNING "nfsd: disabling repcache.\n");
-			cache_disabled = 1;
-		}
+	found = nfsd_cache_search(b, rqstp, csum);
+	if (found) {
+		if (rp)
+			nfsd_reply_cache_free_locked(rp);
+		rp = found;
+		nfsdstats.rchits++;
+		goto found_entry;
+	}
+	nfsdstats.rcmisses++;
+
+	/* Without an entry the call is just not cached */
+	if (!rp) {
+		dprintk("nfsd: unable to allocate reply cache entry\n");
 		goto out;
 	}
 
@@ -186,25 +403,18 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 	memcpy(&rp->c_addr, svc_addr_in(rqstp), sizeof(rp->c_addr));
 	rp->c_prot = proto;
 	rp->c_vers = vers;
-	rp->c_timestamp = jiffies;
+	rp->c_len = rqstp->rq_arg.len;
+	rp->c_csum = csum;
 
-	hash_refile(rp);
-
-	/* release any buffer */
-	if (rp->c_type == RC_REPLBUFF) {
-		kfree(rp->c_replvec.iov_base);
-		rp->c_replvec.iov_base = NULL;
-	}
-	rp->c_type = RC_NOCACHE;
+	lru_put_end(b, rp);
  out:
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->cache_lock);
 	return rtn;
 
 found_entry:
 	/* We found a matching entry which is either in progress or done. */
 	age = jiffies - rp->c_timestamp;
-	rp->c_timestamp = jiffies;
-	lru_put_end(rp);
+	lru_put_end(b, rp);
 
 	rtn = RC_DROPIT;
 	/* Request being processed or excessive rexmits */
@@ -232,7 +442,7 @@ found_entry:
 		break;
 	default:
 		printk(KERN_WARNING "nfsd: bad repcache type %d\n", rp->c_type);
-		rp->c_state = RC_UNUSED;
+		nfsd_reply_cache_free_locked(rp);
 	}
 
 	goto out;
@@ -258,18 +468,21 @@ void
 nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 {
 	struct svc_cacherep *rp;
+	struct nfsd_drc_bucket *b;
 	struct kvec	*resv = &rqstp->rq_res.head[0], *cachv;
 	int		len;
 
 	if (!(rp = rqstp->rq_cacherep) || cache_disabled)
 		return;
 
+	b = nfsd_cache_bucket(rp->c_xid);
+
 	len = resv->iov_len - ((char*)statp - (char*)resv->iov_base);
 	len >>= 2;
 
 	/* Don't cache excessive amounts of data and XDR failures */
 	if (!statp || len > (256 >> 2)) {
-		rp->c_state = RC_UNUSED;
+		nfsd_reply_cache_free(b, rp);
 		return;
 	}
 
@@ -283,22 +496,23 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 		cachv = &rp->c_replvec;
 		cachv->iov_base = kmalloc(len << 2, GFP_KERNEL);
 		if (!cachv->iov_base) {
-			spin_lock(&cache_lock);
-			rp->c_state = RC_UNUSED;
-			spin_unlock(&cache_lock);
+			nfsd_reply_cache_free(b, rp);
 			return;
 		}
 		cachv->iov_len = len << 2;
 		memcpy(cachv->iov_base, statp, len << 2);
+		atomic_add(cachv->iov_len, &drc_mem_usage);
 		break;
+	case RC_NOCACHE:
+		nfsd_reply_cache_free(b, rp);
+		return;
 	}
-	spin_lock(&cache_lock);
-	lru_put_end(rp);
+	spin_lock(&b->cache_lock);
+	lru_put_end(b, rp);
 	rp->c_secure = rqstp->rq_secure;
 	rp->c_type = cachetype;
 	rp->c_state = RC_DONE;
-	rp->c_timestamp = jiffies;
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->cache_lock);
 	return;
 }
 
@@ -321,3 +535,30 @@ nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *data)
 	vec->iov_len += data->iov_len;
 	return 1;
 }
+
+/*
+ * Note that fields may be added, removed or reordered in the future. Programs
+ * scraping this file for info should test the labels to ensure they're
+ * getting the correct field.
+ */
+static int nfsd_reply_cache_stats_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "max entries:           %u\n", max_drc_entries);
+	seq_printf(m, "num entries:           %u\n",
+			atomic_read(&num_drc_entries));
+	seq_printf(m, "hash buckets:          %u\n", 1U << drc_hashbits);
+	seq_printf(m, "mem usage:             %u\n",
+			atomic_read(&drc_mem_usage));
+	seq_printf(m, "cache hits:            %u\n", nfsdstats.rchits);
+	seq_printf(m, "cache misses:          %u\n", nfsdstats.rcmisses);
+	seq_printf(m, "not cached:            %u\n", nfsdstats.rcnocache);
+	seq_printf(m, "payload misses:        %u\n", payload_misses);
+	seq_printf(m, "longest chain len:     %u\n", longest_chain);
+	seq_printf(m, "cachesize at longest:  %u\n", longest_chain_cachesize);
+	return 0;
+}
+
+int nfsd_reply_cache_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nfsd_reply_cache_stats_show, NULL);
+}
@@ -21,6 +21,7 @@
 #include "nfsd.h"
 #include "cache.h"
 #include "vfs.h"
+#include "filecache.h"
 
 #define NFSDDBG_FACILITY	NFSDDBG_SVC
 
@@ -209,20 +210,15 @@ static int nfsd_startup(unsigned short port, int nrservs)
 
 	if (nfsd_up)
 		return 0;
-	/*
-	 * Readahead param cache - will no-op if it already exists.
-	 * (Note therefore results will be suboptimal if number of
-	 * threads is modified after nfsd start.)
-	 */
-	ret = nfsd_racache_init(2*nrservs);
+	ret = nfsd_file_cache_init();
 	if (ret)
 		return ret;
 	ret = nfsd_init_socks(port);
 	if (ret)
-		goto out_racache;
+		goto out_filecache;
 	ret = lockd_up();
 	if (ret)
-		goto out_racache;
+		goto out_filecache;
 	ret = nfs4_state_start();
 	if (ret)
 		goto out_lockd;
@@ -230,8 +226,8 @@ static int nfsd_startup(unsigned short port, int nrservs)
 	return 0;
 out_lockd:
 	lockd_down();
-out_racache:
-	nfsd_racache_shutdown();
+out_filecache:
+	nfsd_file_cache_shutdown();
 	return ret;
 }
 
@@ -247,7 +243,7 @@ static void nfsd_shutdown(void)
 		return;
 	nfs4_state_shutdown();
 	lockd_down();
-	nfsd_racache_shutdown();
+	nfsd_file_cache_shutdown();
 	nfsd_up = false;
 }
 
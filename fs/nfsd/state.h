@@ -279,6 +279,10 @@ struct nfs4_client {
 	unsigned long		cl_cb_slot_busy;
 	struct rpc_wait_queue	cl_cb_waitq;	/* backchannel callers may */
 						/* wait here for slots */
+
+	/* for nfs42 asynchronous copies, protected by cl_lock: */
+	struct list_head	cl_copies;
+	u32			cl_copy_id;
 };
 
 static inline void
@@ -457,9 +461,11 @@ static inline struct nfs4_ol_stateid *openlockstateid(struct nfs4_stid *s)
 #define WR_STATE	        0x00000020
 
 struct nfsd4_compound_state;
+struct nfsd4_copy;
 
 extern __be32 nfs4_preprocess_stateid_op(struct nfsd4_compound_state *cstate,
-		stateid_t *stateid, int flags, struct file **filp);
+		struct svc_fh *fhp, stateid_t *stateid, int flags,
+		struct file **filp);
 extern void nfs4_lock_state(void);
 extern void nfs4_unlock_state(void);
 extern int nfs4_in_grace(void);
@@ -475,6 +481,12 @@ extern void nfsd4_cb_recall(struct nfs4_delegation *dp);
 extern int nfsd4_create_callback_queue(void);
 extern void nfsd4_destroy_callback_queue(void);
 extern void nfsd4_shutdown_callback(struct nfs4_client *);
+extern int nfsd4_create_copy_queue(void);
+extern void nfsd4_destroy_copy_queue(void);
+extern void nfsd4_shutdown_copy(struct nfs4_client *);
+extern void nfsd4_cb_offload(struct nfsd4_copy *copy);
+extern void nfsd4_copy_unhash(struct nfsd4_copy *copy);
+extern void nfsd4_copy_put(struct nfsd4_copy *copy);
 extern void nfs4_put_delegation(struct nfs4_delegation *dp);
 extern __be32 nfs4_make_rec_clidname(char *clidname, struct xdr_netobj *clname);
 extern void nfsd4_init_recdir(void);
@@ -486,6 +498,7 @@ extern void nfsd4_recdir_purge_old(void);
 extern void nfsd4_create_clid_dir(struct nfs4_client *clp);
 extern void nfsd4_remove_clid_dir(struct nfs4_client *clp);
 extern void release_session_client(struct nfsd4_session *);
+extern void nfsd4_put_client(struct nfs4_client *);
 extern __be32 nfs4_validate_stateid(struct nfs4_client *, stateid_t *);
 extern void nfsd4_purge_closed_stateid(struct nfs4_stateowner *);
 
@@ -354,6 +354,45 @@ struct nfsd4_free_stateid {
 	__be32		fr_status;          /* response */
 };
 
+struct nfsd4_copy {
+	stateid_t		cp_src_stateid;     /* request */
+	stateid_t		cp_dst_stateid;     /* request */
+	u64			cp_src_pos;         /* request */
+	u64			cp_dst_pos;         /* request */
+	u64			cp_count;           /* request */
+	u32			cp_consecutive;     /* request */
+	u32			cp_synchronous;     /* request */
+
+	stateid_t		cp_stateid;         /* response, async only */
+	u64			cp_res_count;       /* response */
+	u32			cp_committed;       /* response */
+	nfs4_verifier		cp_verf;            /* response */
+
+	/* for asynchronous copies: */
+	struct nfs4_client	*cp_clp;
+	const struct cred	*cp_cred;
+	struct file		*cp_src;
+	struct file		*cp_dst;
+	struct knfsd_fh		cp_fh;
+	__be32			cp_status;
+#define NFSD4_COPY_CANCELLED	0
+#define NFSD4_COPY_DONE		1
+#define NFSD4_COPY_NOTIFIED	2
+	unsigned long		cp_flags;
+	atomic_t		cp_refcount;
+	struct list_head	cp_perclnt;
+	struct work_struct	cp_work;
+	struct nfsd4_callback	cp_cb;
+};
+
+/* also used for OFFLOAD_CANCEL */
+struct nfsd4_offload_status {
+	stateid_t	os_stateid;         /* request */
+	u64		os_count;           /* response */
+	u32		os_complete;        /* response */
+	__be32		os_status;          /* response */
+};
+
 /* also used for NVERIFY */
 struct nfsd4_verify {
 	u32		ve_bmval[3];        /* request */
@@ -450,6 +489,10 @@ struct nfsd4_op {
 		struct nfsd4_reclaim_complete	reclaim_complete;
 		struct nfsd4_test_stateid	test_stateid;
 		struct nfsd4_free_stateid	free_stateid;
+
+		/* NFSv4.2 */
+		struct nfsd4_copy		copy;
+		struct nfsd4_offload_status	offload_status;
 	} u;
 	struct nfs4_replay *			replay;
 };
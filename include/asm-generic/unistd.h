@@ -691,9 +691,15 @@ __SC_COMP(__NR_process_vm_readv, sys_process_vm_readv, \
 #define __NR_process_vm_writev 271
 __SC_COMP(__NR_process_vm_writev, sys_process_vm_writev, \
           compat_sys_process_vm_writev)
+/* 272 through 279 are reserved */
+#define __NR_bpf 280
+__SYSCALL(__NR_bpf, sys_bpf)
+/* 281 through 284 are reserved */
+#define __NR_copy_file_range 285
+__SYSCALL(__NR_copy_file_range, sys_copy_file_range)
 
 #undef __NR_syscalls
-#define __NR_syscalls 272
+#define __NR_syscalls 286
 
 /*
  * All syscalls below here should go away really,
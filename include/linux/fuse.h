@@ -54,12 +54,18 @@
  * 7.18
  *  - add FUSE_IOCTL_DIR flag
  *  - add FUSE_NOTIFY_DELETE
+ *
+ * Not tied to a protocol version (negotiated with the INIT flag, or
+ * detected by the ioctl failing with ENOTTY):
+ *  - add FUSE_WRITEBACK_CACHE
+ *  - add FUSE_DEV_IOC_CLONE_CPU device ioctl
  */
 
 #ifndef _LINUX_FUSE_H
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /*
  * Version negotiation:
@@ -164,6 +170,7 @@ struct fuse_file_lock {
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
  * FUSE_DONT_MASK: don't apply umask to file mode on create operations
  * FUSE_FLOCK_LOCKS: remote locking for BSD style file locks
+ * FUSE_WRITEBACK_CACHE: use writeback cache for buffered writes
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -173,6 +180,7 @@ struct fuse_file_lock {
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
 #define FUSE_FLOCK_LOCKS	(1 << 10)
+#define FUSE_WRITEBACK_CACHE	(1 << 16)
 
 /**
  * CUSE INIT request/reply flags
@@ -645,4 +653,27 @@ struct fuse_notify_retrieve_in {
 	__u64	dummy4;
 };
 
+/**
+ * Device ioctls
+ *
+ * FUSE_DEV_IOC_CLONE_CPU: attach a newly opened /dev/fuse file to the
+ * connection of the mounted device file @fd.  If @cpu names a CPU,
+ * requests submitted on that CPU are queued to the new file (and any
+ * other clone bound to the same CPU) only.  FUSE_DEV_CLONE_NOCPU makes
+ * the new file another reader of the default queue.  The connection is
+ * torn down when the last file reading the default queue is closed.
+ *
+ * Command numbers below 32 are left to upstream, which uses 0 for a
+ * FUSE_DEV_IOC_CLONE with a different argument.
+ */
+#define FUSE_DEV_CLONE_NOCPU	((__u32) -1)
+
+struct fuse_dev_clone {
+	__u32	fd;
+	__u32	cpu;
+};
+
+#define FUSE_DEV_IOC_MAGIC	229
+#define FUSE_DEV_IOC_CLONE_CPU	_IOW(FUSE_DEV_IOC_MAGIC, 32, struct fuse_dev_clone)
+
 #endif /* _LINUX_FUSE_H */
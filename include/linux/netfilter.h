@@ -393,5 +393,11 @@ extern void (*nf_ct_destroy)(struct nf_conntrack *) __rcu;
 static inline void nf_ct_attach(struct sk_buff *new, struct sk_buff *skb) {}
 #endif
 
+#if IS_ENABLED(CONFIG_NF_FLOW_OFFLOAD)
+/* Called for every received IPv4 packet; returns non-zero if the packet
+ * was forwarded by the flow offload fast path. */
+extern int (*nf_flow_offload_hook)(struct sk_buff *skb) __rcu;
+#endif
+
 #endif /*__KERNEL__*/
 #endif /*__LINUX_NETFILTER_H*/
@@ -253,6 +253,21 @@ enum nfs_opnum4 {
 	OP_DESTROY_CLIENTID = 57,
 	OP_RECLAIM_COMPLETE = 58,
 
+	/* nfs42 */
+	OP_ALLOCATE = 59,
+	OP_COPY = 60,
+	OP_COPY_NOTIFY = 61,
+	OP_DEALLOCATE = 62,
+	OP_IO_ADVISE = 63,
+	OP_LAYOUTERROR = 64,
+	OP_LAYOUTSTATS = 65,
+	OP_OFFLOAD_CANCEL = 66,
+	OP_OFFLOAD_STATUS = 67,
+	OP_READ_PLUS = 68,
+	OP_SEEK = 69,
+	OP_WRITE_SAME = 70,
+	OP_CLONE = 71,
+
 	OP_ILLEGAL = 10044,
 };
 
@@ -260,7 +275,7 @@ enum nfs_opnum4 {
 Needs to be updated if more operations are defined in future.*/
 
 #define FIRST_NFS4_OP	OP_ACCESS
-#define LAST_NFS4_OP 	OP_RECLAIM_COMPLETE
+#define LAST_NFS4_OP 	OP_CLONE
 
 enum nfsstat4 {
 	NFS4_OK = 0,
@@ -371,6 +386,15 @@ enum nfsstat4 {
 	NFS4ERR_REJECT_DELEG	= 10085,	/* on callback */
 	NFS4ERR_RETURNCONFLICT	= 10086,	/* outstanding layoutreturn */
 	NFS4ERR_DELEG_REVOKED	= 10087,	/* deleg./layout revoked */
+
+	/* nfs42 */
+	NFS4ERR_PARTNER_NOTSUPP	= 10088,	/* s2s not supported */
+	NFS4ERR_PARTNER_NO_AUTH	= 10089,	/* s2s not authorized */
+	NFS4ERR_UNION_NOTSUPP	= 10090,	/* arm of union not supp */
+	NFS4ERR_OFFLOAD_DENIED	= 10091,	/* dest not allowing copy */
+	NFS4ERR_WRONG_LFS	= 10092,	/* LFS not supported */
+	NFS4ERR_BADLABEL	= 10093,	/* incorrect label */
+	NFS4ERR_OFFLOAD_NO_REQS	= 10094,	/* dest not meeting reqs */
 };
 
 static inline bool seqid_mutating_err(u32 err)
@@ -649,6 +673,12 @@ struct nfs4_deviceid {
 	char data[NFS4_DEVICEID4_SIZE];
 };
 
+/* nfs42 types */
+enum data_content4 {
+	NFS4_CONTENT_DATA = 0,
+	NFS4_CONTENT_HOLE = 1,
+};
+
 #endif
 #endif
 
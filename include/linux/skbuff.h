@@ -238,6 +238,23 @@ struct ubuf_info {
 	unsigned long desc;
 };
 
+/*
+ * MSG_ZEROCOPY sends keep the user pages pinned in the skb frags, so
+ * unlike other ubuf_info users their frags may be shared between skbs.
+ * Every skb_shared_info pointing at it holds a reference; when the last
+ * one is dropped the ids [id, id + len) are reported to the sender
+ * through the socket error queue.
+ */
+struct sock_zerocopy {
+	struct ubuf_info	ubuf;
+	struct sock		*sk;
+	struct sk_buff		*notify;
+	atomic_t		refcnt;
+	u32			id;
+	u16			len;
+	bool			copied;
+};
+
 /* This data is invariant across clones and lives at
  * the end of the header data, ie. at skb->end.
  */
@@ -363,6 +380,7 @@ typedef unsigned char *sk_buff_data_t;
  *	@wifi_acked: whether frame was acked on wifi or not
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
+ *	@napi_id: id of the NAPI struct this skb came from
  *	@secmark: security marking
  *	@mark: Generic packet mark
  *	@dropcount: total number of sk_receive_queue overflows
@@ -462,6 +480,9 @@ struct sk_buff {
 #ifdef CONFIG_NET_DMA
 	dma_cookie_t		dma_cookie;
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int		napi_id;
+#endif
 #ifdef CONFIG_NETWORK_SECMARK
 	__u32			secmark;
 #endif
@@ -568,6 +589,17 @@ extern bool skb_recycle_check(struct sk_buff *skb, int skb_size);
 
 extern struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src);
 extern int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask);
+
+extern void sock_zerocopy_callback(void *arg);
+extern struct sock_zerocopy *sock_zerocopy_alloc(struct sock *sk,
+						 struct sk_buff *skb);
+extern void sock_zerocopy_put(struct sock_zerocopy *uz);
+extern void sock_zerocopy_put_abort(struct sock_zerocopy *uz);
+extern int skb_zerocopy_iter_stream(struct sock *sk, struct sk_buff *skb,
+				    unsigned char __user *from, int len,
+				    struct sock_zerocopy *uz);
+extern void skb_zerocopy_clone(struct sk_buff *nskb, struct sk_buff *orig);
+
 extern struct sk_buff *skb_clone(struct sk_buff *skb,
 				 gfp_t priority);
 extern struct sk_buff *skb_copy(const struct sk_buff *skb,
@@ -646,6 +678,56 @@ static inline struct skb_shared_hwtstamps *skb_hwtstamps(struct sk_buff *skb)
 	return &skb_shinfo(skb)->hwtstamps;
 }
 
+static inline struct sock_zerocopy *skb_sock_zerocopy(const struct sk_buff *skb)
+{
+	struct ubuf_info *uarg;
+
+	if (!(skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY))
+		return NULL;
+	uarg = skb_shinfo(skb)->destructor_arg;
+	if (uarg->callback != sock_zerocopy_callback)
+		return NULL;
+	return container_of(uarg, struct sock_zerocopy, ubuf);
+}
+
+static inline void sock_zerocopy_get(struct sock_zerocopy *uz)
+{
+	atomic_inc(&uz->refcnt);
+}
+
+/**
+ *	skb_orphan_frags - copy userspace frags the skb can't share
+ *	@skb: buffer to orphan frags from
+ *	@gfp_mask: allocation mask for replacement pages
+ *
+ *	Called before the frags end up in a second skb_shared_info.  Frags
+ *	of a MSG_ZEROCOPY send stay, every skb_shared_info holds a
+ *	reference on its completion; other userspace frags are copied.
+ */
+static inline int skb_orphan_frags(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	if (likely(!(skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY)))
+		return 0;
+	if (skb_sock_zerocopy(skb))
+		return 0;
+	return skb_copy_ubufs(skb, gfp_mask);
+}
+
+/**
+ *	skb_orphan_frags_rx - copy all userspace frags before local delivery
+ *	@skb: buffer to orphan frags from
+ *	@gfp_mask: allocation mask for replacement pages
+ *
+ *	A local receiver may hold on to the skb indefinitely, so not even
+ *	MSG_ZEROCOPY frags may be passed to it.
+ */
+static inline int skb_orphan_frags_rx(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	if (likely(!(skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY)))
+		return 0;
+	return skb_copy_ubufs(skb, gfp_mask);
+}
+
 /**
  *	skb_queue_empty - check if a queue is empty
  *	@list: queue head
@@ -30,6 +30,7 @@ struct rpc_message {
 
 struct rpc_call_ops;
 struct rpc_wait_queue;
+struct rpc_xprt;
 struct rpc_wait {
 	struct list_head	list;		/* wait queue links */
 	struct list_head	links;		/* Links to related tasks */
@@ -44,6 +45,7 @@ struct rpc_task {
 	atomic_t		tk_count;	/* Reference count */
 	struct list_head	tk_task;	/* global list of tasks */
 	struct rpc_clnt *	tk_client;	/* RPC client */
+	struct rpc_xprt *	tk_xprt;	/* transport */
 	struct rpc_rqst *	tk_rqstp;	/* RPC request */
 
 	/*
@@ -87,7 +89,6 @@ struct rpc_task {
 				tk_cred_retry : 2,
 				tk_rebind_retry : 2;
 };
-#define tk_xprt			tk_client->cl_xprt
 
 /* support walking a list of tasks on a wait queue */
 #define	task_for_each(task, pos, head) \
@@ -18,6 +18,8 @@
 #include <linux/sunrpc/svcauth.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/llist.h>
+#include <linux/rcupdate.h>
 
 /*
  * This is the RPC server thread function prototype
@@ -26,10 +28,10 @@ typedef int		(*svc_thread_fn)(void *);
 
 /* statistics for svc_pool structures */
 struct svc_pool_stats {
-	unsigned long	packets;
-	unsigned long	sockets_queued;
-	unsigned long	threads_woken;
-	unsigned long	threads_timedout;
+	atomic_long_t	packets;
+	atomic_long_t	sockets_queued;
+	atomic_long_t	threads_woken;
+	atomic_long_t	threads_timedout;
 };
 
 /*
@@ -44,14 +46,21 @@ struct svc_pool_stats {
  */
 struct svc_pool {
 	unsigned int		sp_id;	    	/* pool id; also node id on NUMA */
-	spinlock_t		sp_lock;	/* protects all fields */
-	struct list_head	sp_threads;	/* idle server threads */
-	struct list_head	sp_sockets;	/* pending sockets */
+	spinlock_t		sp_lock;	/* protects sp_xprts, sp_nrthreads
+						 * and changes to sp_all_threads */
+	struct llist_node	*sp_xprts;	/* pending transports, oldest first */
 	unsigned int		sp_nrthreads;	/* # of threads in pool */
-	struct list_head	sp_all_threads;	/* all server threads */
+	struct list_head	sp_all_threads;	/* all server threads (RCU) */
+	unsigned long		sp_flags;
 	struct svc_pool_stats	sp_stats;	/* statistics on pool operation */
+
+	/* transports just queued, newest first; written without locking */
+	struct llist_head	sp_xprts_new ____cacheline_aligned_in_smp;
 } ____cacheline_aligned_in_smp;
 
+/* bits for sp_flags */
+#define	SP_TASK_PENDING		0	/* svc_wake_up found no idle thread */
+
 /*
  * RPC service.
  *
@@ -217,9 +226,10 @@ static inline void svc_putu32(struct kvec *iov, __be32 val)
  * processed.
  */
 struct svc_rqst {
-	struct list_head	rq_list;	/* idle list */
 	struct list_head	rq_all;		/* all threads list */
+	struct rcu_head		rq_rcu_head;	/* for RCU deferred kfree */
 	struct svc_xprt *	rq_xprt;	/* transport ptr */
+	unsigned long		rq_flags;	/* see below */
 
 	struct sockaddr_storage	rq_addr;	/* peer address */
 	size_t			rq_addrlen;
@@ -278,6 +288,10 @@ struct svc_rqst {
 	struct task_struct	*rq_task;	/* service thread */
 };
 
+/* bits for rq_flags */
+#define	RQ_BUSY		0	/* not waiting for a transport */
+#define	RQ_VICTIM	1	/* chosen to exit, off sp_all_threads */
+
 /*
  * Rigorous type checking on sockaddr type conversions
  */
@@ -8,6 +8,7 @@
 #define SUNRPC_SVC_XPRT_H
 
 #include <linux/sunrpc/svc.h>
+#include <linux/ktime.h>
 
 struct module;
 
@@ -49,7 +50,8 @@ struct svc_xprt {
 	struct svc_xprt_ops	*xpt_ops;
 	struct kref		xpt_ref;
 	struct list_head	xpt_list;
-	struct list_head	xpt_ready;
+	struct llist_node	xpt_ready;
+	ktime_t			xpt_qtime;	/* when last queued */
 	unsigned long		xpt_flags;
 #define	XPT_BUSY	0		/* enqueued/receiving */
 #define	XPT_CONN	1		/* conn pending */
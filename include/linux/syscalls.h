@@ -63,6 +63,7 @@ struct getcpu_cache;
 struct old_linux_dirent;
 struct perf_event_attr;
 struct file_handle;
+union bpf_attr;
 
 #include <linux/types.h>
 #include <linux/aio_abi.h>
@@ -793,6 +794,10 @@ asmlinkage long sys_vmsplice(int fd, const struct iovec __user *iov,
 
 asmlinkage long sys_tee(int fdin, int fdout, size_t len, unsigned int flags);
 
+asmlinkage long sys_copy_file_range(int fd_in, loff_t __user *off_in,
+				    int fd_out, loff_t __user *off_out,
+				    size_t len, unsigned int flags);
+
 asmlinkage long sys_sync_file_range(int fd, loff_t offset, loff_t nbytes,
 					unsigned int flags);
 asmlinkage long sys_sync_file_range2(int fd, unsigned int flags,
@@ -857,4 +862,7 @@ asmlinkage long sys_process_vm_writev(pid_t pid,
 				      unsigned long riovcnt,
 				      unsigned long flags);
 
+asmlinkage long sys_bpf(int cmd, union bpf_attr __user *attr,
+			unsigned int size);
+
 #endif
@@ -339,6 +339,9 @@ struct tcp_sock {
 #endif
 	} ucopy;
 
+	unsigned long	tsq_flags;	/* TSQ_* bits, see tcp_wfree()	*/
+	struct list_head tsq_node;	/* anchor in tsq_tasklet.head list */
+
 	u32	snd_wl1;	/* Sequence for window update		*/
 	u32	snd_wnd;	/* The window we expect to receive	*/
 	u32	max_window;	/* Maximal window ever seen from peer	*/
@@ -474,6 +477,13 @@ struct tcp_sock {
 	struct tcp_cookie_values  *cookie_values;
 };
 
+/* Transmit completion bits in tp->tsq_flags */
+enum tsq_flags {
+	TSQ_THROTTLED,		/* output held back, kick on tx completion */
+	TSQ_QUEUED,		/* socket is on a tsq_tasklet list */
+	TCP_TSQ_DEFERRED,	/* tcp_tasklet_func() found socket was owned */
+};
+
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
 {
 	return (struct tcp_sock *)sk;
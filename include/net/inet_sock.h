@@ -133,6 +133,7 @@ struct rtable;
  * @mc_ttl - Multicasting TTL
  * @is_icsk - is this an inet_connection_sock?
  * @mc_index - Multicast device index
+ * @rx_dst_ifindex - ifindex of the device sk_rx_dst was learned on
  * @mc_list - Group array
  * @cork - info to build ip hdr on each ip frag while socket is corked
  */
@@ -170,6 +171,7 @@ struct inet_sock {
 	int			mc_index;
 	__be32			mc_addr;
 	struct ip_mc_socklist __rcu	*mc_list;
+	int			rx_dst_ifindex;
 	struct inet_cork_full	cork;
 };
 
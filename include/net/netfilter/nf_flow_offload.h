@@ -0,0 +1,60 @@
+#ifndef _NF_FLOW_OFFLOAD_H
+#define _NF_FLOW_OFFLOAD_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <linux/netdevice.h>
+#include <net/dst.h>
+#include <net/netfilter/nf_conntrack.h>
+
+/* Idle time after which an offloaded flow goes back to the slow path */
+#define FLOW_OFFLOAD_TIMEOUT	(30 * HZ)
+
+/* Flow is going away, don't use it for new packets */
+#define FLOW_OFFLOAD_TEARDOWN	0
+
+/* What a packet looks like on the wire when it enters the fast path in
+ * one direction, and what it has to look like when it leaves.
+ */
+struct flow_offload_tuple {
+	__be32			src_v4;
+	__be32			dst_v4;
+	__be16			src_port;
+	__be16			dst_port;
+	u8			l4proto;
+	u8			dir;
+
+	/* addresses and ports after NAT */
+	__be32			nat_src_v4;
+	__be32			nat_dst_v4;
+	__be16			nat_src_port;
+	__be16			nat_dst_port;
+
+	const struct net_device	*iif;
+	struct dst_entry	*dst;
+	unsigned int		mtu;
+};
+
+struct flow_offload_tuple_hash {
+	struct hlist_node		node;
+	struct flow_offload_tuple	tuple;
+};
+
+struct flow_offload {
+	struct flow_offload_tuple_hash	tuplehash[IP_CT_DIR_MAX];
+	struct nf_conn			*ct;
+	unsigned long			flags;
+	/* jiffies at which the flow expires unless more packets arrive */
+	unsigned long			timeout;
+	/* conntrack timeout to keep in sync with flow activity */
+	unsigned long			ct_timeout;
+	struct rcu_head			rcu_head;
+};
+
+extern int flow_offload_add(struct nf_conn *ct, enum ip_conntrack_info ctinfo,
+			    const struct sk_buff *skb,
+			    const struct net_device *in,
+			    const struct net_device *out);
+
+#endif /* _NF_FLOW_OFFLOAD_H */
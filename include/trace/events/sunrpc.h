@@ -0,0 +1,83 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM sunrpc
+
+#if !defined(_TRACE_SUNRPC_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_SUNRPC_H
+
+#include <linux/sunrpc/svc.h>
+#include <linux/sunrpc/svc_xprt.h>
+#include <linux/ktime.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(svc_xprt_enqueue,
+
+	TP_PROTO(struct svc_xprt *xprt, struct svc_pool *pool,
+		 struct svc_rqst *rqstp),
+
+	TP_ARGS(xprt, pool, rqstp),
+
+	TP_STRUCT__entry(
+		__field(struct svc_xprt *, xprt)
+		__field(unsigned long, flags)
+		__field(unsigned int, pool)
+		__field(struct svc_rqst *, rqstp)
+	),
+
+	TP_fast_assign(
+		__entry->xprt = xprt;
+		__entry->flags = xprt->xpt_flags;
+		__entry->pool = pool->sp_id;
+		__entry->rqstp = rqstp;
+	),
+
+	TP_printk("xprt=%p flags=0x%lx pool=%u woken=%p",
+		__entry->xprt, __entry->flags, __entry->pool, __entry->rqstp)
+);
+
+/* wait is the time from svc_xprt_enqueue to a thread picking it up */
+TRACE_EVENT(svc_xprt_dequeue,
+
+	TP_PROTO(struct svc_xprt *xprt),
+
+	TP_ARGS(xprt),
+
+	TP_STRUCT__entry(
+		__field(struct svc_xprt *, xprt)
+		__field(unsigned long, flags)
+		__field(s64, wait_us)
+	),
+
+	TP_fast_assign(
+		__entry->xprt = xprt;
+		__entry->flags = xprt->xpt_flags;
+		__entry->wait_us = ktime_to_us(ktime_sub(ktime_get(),
+							 xprt->xpt_qtime));
+	),
+
+	TP_printk("xprt=%p flags=0x%lx wait=%lldus",
+		__entry->xprt, __entry->flags, __entry->wait_us)
+);
+
+TRACE_EVENT(svc_wake_up,
+
+	TP_PROTO(struct svc_pool *pool, struct svc_rqst *rqstp),
+
+	TP_ARGS(pool, rqstp),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, pool)
+		__field(struct svc_rqst *, rqstp)
+	),
+
+	TP_fast_assign(
+		__entry->pool = pool->sp_id;
+		__entry->rqstp = rqstp;
+	),
+
+	TP_printk("pool=%u woken=%p", __entry->pool, __entry->rqstp)
+);
+
+#endif /* _TRACE_SUNRPC_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,341 @@
+/*
+ * Extended BPF interpreter
+ *
+ * The instruction set has ten 64-bit registers, a 512 byte stack frame
+ * and calls into in-kernel helper functions. The programs it runs were
+ * checked by the verifier beforehand, so the interpreter itself does no
+ * bounds or type checking.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#include <linux/filter.h>
+#include <linux/bpf.h>
+#include <linux/skbuff.h>
+#include <linux/ratelimit.h>
+#include <asm/unaligned.h>
+
+/* Registers */
+#define DST	regs[insn->dst_reg]
+#define SRC	regs[insn->src_reg]
+#define FP	regs[BPF_REG_FP]
+#define ARG1	regs[BPF_REG_ARG1]
+#define CTX	regs[BPF_REG_CTX]
+#define IMM	insn->imm
+
+/* Base function for offset calculation. Needs to go into .text section,
+ * therefore keeping it non-static as well; will also be used by JITs
+ * anyway later on, so do not let the compiler omit it.
+ */
+noinline u64 __bpf_call_base(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	return 0;
+}
+
+static inline void *bpf_load_pointer(const struct sk_buff *skb, int k,
+				     unsigned int size, void *buffer)
+{
+	if (k >= 0)
+		return skb_header_pointer(skb, k, size, buffer);
+	return bpf_internal_load_pointer_neg_helper(skb, k, size);
+}
+
+/**
+ *	__bpf_prog_run - run eBPF program on a given context
+ *	@ctx: is the data we are operating on
+ *	@insn: is the array of eBPF instructions
+ *
+ * Decode and execute eBPF instructions.
+ */
+static unsigned int __bpf_prog_run(const struct sk_buff *ctx,
+				   const struct bpf_insn *insn)
+{
+	u64 stack[MAX_BPF_STACK / sizeof(u64)];
+	u64 regs[MAX_BPF_REG], tmp;
+	void *ptr;
+	u32 off;
+
+	FP = (u64) (unsigned long) &stack[ARRAY_SIZE(stack)];
+	ARG1 = (u64) (unsigned long) ctx;
+
+	for (;; insn++) {
+		switch (insn->code) {
+#define ALU(OPCODE, OP)						\
+		case BPF_ALU64 | BPF_##OPCODE | BPF_X:		\
+			DST = DST OP SRC;			\
+			continue;				\
+		case BPF_ALU | BPF_##OPCODE | BPF_X:		\
+			DST = (u32) DST OP (u32) SRC;		\
+			continue;				\
+		case BPF_ALU64 | BPF_##OPCODE | BPF_K:		\
+			DST = DST OP IMM;			\
+			continue;				\
+		case BPF_ALU | BPF_##OPCODE | BPF_K:		\
+			DST = (u32) DST OP (u32) IMM;		\
+			continue;
+
+		ALU(ADD,  +)
+		ALU(SUB,  -)
+		ALU(AND,  &)
+		ALU(OR,   |)
+		ALU(XOR,  ^)
+		ALU(MUL,  *)
+#undef ALU
+		/* Explicitly mask the register-based shift amounts with 63 or 31
+		 * to avoid undefined behavior; the verifier rejects immediate
+		 * shifts that are out of range.
+		 */
+		case BPF_ALU64 | BPF_LSH | BPF_X:
+			DST = DST << (SRC & 63);
+			continue;
+		case BPF_ALU | BPF_LSH | BPF_X:
+			DST = (u32) DST << (SRC & 31);
+			continue;
+		case BPF_ALU64 | BPF_LSH | BPF_K:
+			DST = DST << IMM;
+			continue;
+		case BPF_ALU | BPF_LSH | BPF_K:
+			DST = (u32) DST << IMM;
+			continue;
+		case BPF_ALU64 | BPF_RSH | BPF_X:
+			DST = DST >> (SRC & 63);
+			continue;
+		case BPF_ALU | BPF_RSH | BPF_X:
+			DST = (u32) DST >> (SRC & 31);
+			continue;
+		case BPF_ALU64 | BPF_RSH | BPF_K:
+			DST = DST >> IMM;
+			continue;
+		case BPF_ALU | BPF_RSH | BPF_K:
+			DST = (u32) DST >> IMM;
+			continue;
+		case BPF_ALU64 | BPF_ARSH | BPF_X:
+			(*(s64 *) &DST) >>= (SRC & 63);
+			continue;
+		case BPF_ALU64 | BPF_ARSH | BPF_K:
+			(*(s64 *) &DST) >>= IMM;
+			continue;
+		case BPF_ALU | BPF_NEG:
+			DST = (u32) -DST;
+			continue;
+		case BPF_ALU64 | BPF_NEG:
+			DST = -DST;
+			continue;
+		case BPF_ALU | BPF_MOV | BPF_X:
+			DST = (u32) SRC;
+			continue;
+		case BPF_ALU | BPF_MOV | BPF_K:
+			DST = (u32) IMM;
+			continue;
+		case BPF_ALU64 | BPF_MOV | BPF_X:
+			DST = SRC;
+			continue;
+		case BPF_ALU64 | BPF_MOV | BPF_K:
+			DST = IMM;
+			continue;
+		case BPF_LD | BPF_IMM | BPF_DW:
+			DST = (u64) (u32) insn[0].imm | ((u64) (u32) insn[1].imm) << 32;
+			insn++;
+			continue;
+		case BPF_ALU64 | BPF_MOD | BPF_X:
+			if (unlikely(SRC == 0))
+				return 0;
+			DST -= div64_u64(DST, SRC) * SRC;
+			continue;
+		case BPF_ALU | BPF_MOD | BPF_X:
+			if (unlikely((u32) SRC == 0))
+				return 0;
+			tmp = (u32) DST;
+			DST = do_div(tmp, (u32) SRC);
+			continue;
+		case BPF_ALU64 | BPF_MOD | BPF_K:
+			DST -= div64_u64(DST, IMM) * (u64) IMM;
+			continue;
+		case BPF_ALU | BPF_MOD | BPF_K:
+			tmp = (u32) DST;
+			DST = do_div(tmp, (u32) IMM);
+			continue;
+		case BPF_ALU64 | BPF_DIV | BPF_X:
+			if (unlikely(SRC == 0))
+				return 0;
+			DST = div64_u64(DST, SRC);
+			continue;
+		case BPF_ALU | BPF_DIV | BPF_X:
+			if (unlikely((u32) SRC == 0))
+				return 0;
+			tmp = (u32) DST;
+			do_div(tmp, (u32) SRC);
+			DST = (u32) tmp;
+			continue;
+		case BPF_ALU64 | BPF_DIV | BPF_K:
+			DST = div64_u64(DST, IMM);
+			continue;
+		case BPF_ALU | BPF_DIV | BPF_K:
+			tmp = (u32) DST;
+			do_div(tmp, (u32) IMM);
+			DST = (u32) tmp;
+			continue;
+		case BPF_ALU | BPF_END | BPF_TO_BE:
+			switch (IMM) {
+			case 16:
+				DST = (__force u16) cpu_to_be16(DST);
+				break;
+			case 32:
+				DST = (__force u32) cpu_to_be32(DST);
+				break;
+			case 64:
+				DST = (__force u64) cpu_to_be64(DST);
+				break;
+			}
+			continue;
+		case BPF_ALU | BPF_END | BPF_TO_LE:
+			switch (IMM) {
+			case 16:
+				DST = (__force u16) cpu_to_le16(DST);
+				break;
+			case 32:
+				DST = (__force u32) cpu_to_le32(DST);
+				break;
+			case 64:
+				DST = (__force u64) cpu_to_le64(DST);
+				break;
+			}
+			continue;
+
+		/* CALL */
+		case BPF_JMP | BPF_CALL:
+			/* Function call scratches BPF_R1-BPF_R5 registers,
+			 * preserves BPF_R6-BPF_R9, and stores return value
+			 * into BPF_R0.
+			 */
+			regs[BPF_REG_0] = (__bpf_call_base + insn->imm)(regs[BPF_REG_1],
+									regs[BPF_REG_2],
+									regs[BPF_REG_3],
+									regs[BPF_REG_4],
+									regs[BPF_REG_5]);
+			continue;
+
+		/* JMP */
+#define JMP(OPCODE, COND)					\
+		case BPF_JMP | BPF_##OPCODE | BPF_X:		\
+			if (COND(DST, SRC))			\
+				insn += insn->off;		\
+			continue;				\
+		case BPF_JMP | BPF_##OPCODE | BPF_K:		\
+			if (COND(DST, IMM))			\
+				insn += insn->off;		\
+			continue;
+#define EQ(a, b)	((a) == (u64) (b))
+#define NE(a, b)	((a) != (u64) (b))
+#define GT(a, b)	((a) > (u64) (b))
+#define GE(a, b)	((a) >= (u64) (b))
+#define SGT(a, b)	((s64) (a) > (s64) (b))
+#define SGE(a, b)	((s64) (a) >= (s64) (b))
+#define SET(a, b)	((a) & (u64) (b))
+
+		JMP(JEQ, EQ)
+		JMP(JNE, NE)
+		JMP(JGT, GT)
+		JMP(JGE, GE)
+		JMP(JSGT, SGT)
+		JMP(JSGE, SGE)
+		JMP(JSET, SET)
+#undef JMP
+#undef EQ
+#undef NE
+#undef GT
+#undef GE
+#undef SGT
+#undef SGE
+#undef SET
+		case BPF_JMP | BPF_JA:
+			insn += insn->off;
+			continue;
+		case BPF_JMP | BPF_EXIT:
+			return regs[BPF_REG_0];
+
+		/* STX and ST and LDX */
+#define LDST(SIZEOP, SIZE)						\
+		case BPF_STX | BPF_MEM | BPF_##SIZEOP:			\
+			*(SIZE *)(unsigned long) (DST + insn->off) = SRC;	\
+			continue;					\
+		case BPF_ST | BPF_MEM | BPF_##SIZEOP:			\
+			*(SIZE *)(unsigned long) (DST + insn->off) = IMM;	\
+			continue;					\
+		case BPF_LDX | BPF_MEM | BPF_##SIZEOP:			\
+			DST = *(SIZE *)(unsigned long) (SRC + insn->off);	\
+			continue;
+
+		LDST(B,   u8)
+		LDST(H,  u16)
+		LDST(W,  u32)
+		LDST(DW, u64)
+#undef LDST
+		case BPF_STX | BPF_XADD | BPF_W: /* lock xadd *(u32 *)(dst_reg + off16) += src_reg */
+			atomic_add((u32) SRC, (atomic_t *)(unsigned long)
+				   (DST + insn->off));
+			continue;
+		case BPF_STX | BPF_XADD | BPF_DW: /* lock xadd *(u64 *)(dst_reg + off16) += src_reg */
+			atomic64_add((u64) SRC, (atomic64_t *)(unsigned long)
+				     (DST + insn->off));
+			continue;
+
+		/* R0 = ntohx(*(size *) (((struct sk_buff *) R6)->data + imm32))
+		 * or, for BPF_IND, (src_reg + imm32) as offset. A failing
+		 * load ends the program, which then returns 0, as in classic
+		 * BPF. R1-R5 are scratched, as by a function call.
+		 */
+		case BPF_LD | BPF_ABS | BPF_W:
+			off = IMM;
+load_word:
+			ptr = bpf_load_pointer((struct sk_buff *) (unsigned long) CTX,
+					       off, 4, &tmp);
+			if (likely(ptr != NULL)) {
+				regs[BPF_REG_0] = get_unaligned_be32(ptr);
+				continue;
+			}
+			return 0;
+		case BPF_LD | BPF_ABS | BPF_H:
+			off = IMM;
+load_half:
+			ptr = bpf_load_pointer((struct sk_buff *) (unsigned long) CTX,
+					       off, 2, &tmp);
+			if (likely(ptr != NULL)) {
+				regs[BPF_REG_0] = get_unaligned_be16(ptr);
+				continue;
+			}
+			return 0;
+		case BPF_LD | BPF_ABS | BPF_B:
+			off = IMM;
+load_byte:
+			ptr = bpf_load_pointer((struct sk_buff *) (unsigned long) CTX,
+					       off, 1, &tmp);
+			if (likely(ptr != NULL)) {
+				regs[BPF_REG_0] = *(u8 *)ptr;
+				continue;
+			}
+			return 0;
+		case BPF_LD | BPF_IND | BPF_W:
+			off = IMM + SRC;
+			goto load_word;
+		case BPF_LD | BPF_IND | BPF_H:
+			off = IMM + SRC;
+			goto load_half;
+		case BPF_LD | BPF_IND | BPF_B:
+			off = IMM + SRC;
+			goto load_byte;
+
+		default:
+			/* the verifier only lets valid opcodes through */
+			WARN_RATELIMIT(1, "unknown opcode %02x\n", insn->code);
+			return 0;
+		}
+	}
+}
+
+void bpf_prog_select_runtime(struct bpf_prog *fp)
+{
+	fp->bpf_func = __bpf_prog_run;
+}
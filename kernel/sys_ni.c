@@ -203,3 +203,9 @@ cond_syscall(sys_fanotify_mark);
 cond_syscall(sys_name_to_handle_at);
 cond_syscall(sys_open_by_handle_at);
 cond_syscall(compat_sys_open_by_handle_at);
+
+/* eBPF maps and programs */
+cond_syscall(sys_bpf);
+
+/* file range copy offload */
+cond_syscall(sys_copy_file_range);
@@ -0,0 +1,493 @@
+/*
+ * Testsuite for the BPF interpreter and JIT compiler
+ *
+ * Every program is run through sk_run_filter() and through the filter
+ * function installed by sk_unattached_filter_create(), which is the JIT
+ * image when net.core.bpf_jit_enable is set. Both results must match the
+ * expected one, on a linear skb and on one whose payload sits in a page
+ * fragment. The average run time of both is reported as well.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/filter.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/if_arp.h>
+#include <linux/if_ether.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+
+#define MAX_INSNS	32
+#define MAX_DATA	64
+
+#define SKB_MARK	0x1234aaaa
+#define SKB_HASH	0x1234aaab
+#define SKB_QUEUE_MAP	123
+#define SKB_DEV_IFINDEX	577
+#define SKB_DEV_TYPE	ARPHRD_LOOPBACK
+
+/* bytes of the packet kept in the linear part of the fragmented skb */
+#define FRAG_HEADLEN	8
+
+/* flags of the tests */
+#define LINEAR_ONLY	(1 << 0)	/* only meaningful on a linear skb */
+#define NO_DEV		(1 << 1)	/* skb->dev is NULL */
+
+static int runs = 10000;
+module_param(runs, int, 0444);
+MODULE_PARM_DESC(runs, "number of runs of each program for the timings");
+
+struct bpf_test {
+	const char *descr;
+	struct sock_filter insns[MAX_INSNS];
+	u8 data[MAX_DATA];
+	unsigned int data_len;
+	unsigned int flags;
+	unsigned int result;
+};
+
+/*
+ * An ethernet header followed by the start of an IPv4 header: the
+ * network header is set at offset ETH_HLEN.
+ */
+#define PKT_DATA							\
+	{ 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,		\
+	  0x09, 0x0a, 0x0b, 0x0c, 0x08, 0x00, 0x45, 0x00,		\
+	  0x00, 0x54, 0xa1, 0xb2, 0x40, 0x00, 0x40, 0x01 }
+#define PKT_LEN		24
+
+static struct bpf_test tests[] = {
+	{
+		"RET_K",
+		{
+			BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+		},
+		PKT_DATA, PKT_LEN, 0, 0xffffffff,
+	},
+	{
+		"LD_IMM_RET_A",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0x12345678),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 0x12345678,
+	},
+	{
+		"ALU_K",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 2),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 1),
+			BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 6),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 3),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_K, 0x100),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x1ff),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 4),
+			BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 2),
+			BPF_STMT(BPF_ALU | BPF_NEG, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 0xfffffbf0,
+	},
+	{
+		"ALU_K_LARGE_IMM",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0x12345678),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 0x11111111),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 0x01010101),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xf0f0f0f0),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_K, 0x0f0f0f00),
+			BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x10001),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 0x10000),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 0x9ecf,
+	},
+	{
+		"ALU_X",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 3),
+			BPF_STMT(BPF_LD | BPF_IMM, 10),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_MUL | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_RSH | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 3,
+	},
+	{
+		"DIV_X_ZERO",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 0),
+			BPF_STMT(BPF_LD | BPF_IMM, 10),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		PKT_DATA, PKT_LEN, 0, 0,
+	},
+	{
+		"TAX_TXA_X_INIT",
+		{
+			BPF_STMT(BPF_MISC | BPF_TXA, 0),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 7),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 14,
+	},
+	{
+		"LD_LEN",
+		{
+			BPF_STMT(BPF_LDX | BPF_W | BPF_LEN, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 2 * PKT_LEN,
+	},
+	{
+		"LD_ABS",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 6),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 0x01020811,
+	},
+	{
+		"LD_ABS_UNALIGNED_TAIL",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, PKT_LEN - 4),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 7),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 0x40004001 + 0x0809,
+	},
+	{
+		"LD_ABS_OUT_OF_BOUNDS",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, PKT_LEN - 2),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		PKT_DATA, PKT_LEN, 0, 0,
+	},
+	{
+		"LD_ABS_SHORT_PACKET",
+		{
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 0),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		{ 0x01 }, 1, 0, 0,
+	},
+	{
+		"LD_IND_MEM",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 2),
+			BPF_STMT(BPF_LD | BPF_W | BPF_IND, 1),
+			BPF_STMT(BPF_ST, 1),
+			BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4),
+			BPF_STMT(BPF_ST, 2),
+			BPF_STMT(BPF_LD | BPF_B | BPF_IND, 7),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_STX, 15),
+			BPF_STMT(BPF_LD | BPF_MEM, 1),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_LDX | BPF_MEM, 2),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_LDX | BPF_MEM, 15),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 0x04050607 + 0x0708 + 2 * 0x0a,
+	},
+	{
+		"LD_IND_OUT_OF_BOUNDS",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 0xfffffff0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0x8),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		PKT_DATA, PKT_LEN, 0, 0,
+	},
+	{
+		"LDX_MSH",
+		{
+			BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, ETH_HLEN),
+			BPF_STMT(BPF_MISC | BPF_TXA, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 20,
+	},
+	{
+		"LD_NET_LL_OFF",
+		{
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_LL_OFF + 12),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_LDX | BPF_IMM, 4),
+			BPF_STMT(BPF_LD | BPF_W | BPF_IND, SKF_NET_OFF),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, LINEAR_ONLY, 0xa1b24000 + 4,
+	},
+	{
+		"JMP",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 10),
+			BPF_STMT(BPF_LDX | BPF_IMM, 5),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 5, 0, 12),
+			BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 10, 0, 11),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 10, 0, 10),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 2, 0, 9),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_X, 0, 0, 8),
+			BPF_JUMP(BPF_JMP | BPF_JGE | BPF_X, 0, 0, 7),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 6, 0),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_X, 0, 5, 0),
+			BPF_STMT(BPF_JMP | BPF_JA, 1),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x12345678, 2, 0),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 0x10000, 1, 0),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 1,
+	},
+	{
+		"JSET_LARGE_IMM",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x00010001, 0, 1),
+			BPF_STMT(BPF_RET | BPF_K, 2),
+			BPF_STMT(BPF_RET | BPF_K, 3),
+		},
+		PKT_DATA, PKT_LEN, 0, 3,
+	},
+	{
+		"ANC_PROTOCOL",
+		{
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, ETH_P_IP,
+	},
+	{
+		"ANC_MARK_RXHASH_QUEUE",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_MARK),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_RXHASH),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_QUEUE),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, SKB_HASH - SKB_MARK + SKB_QUEUE_MAP,
+	},
+	{
+		"ANC_IFINDEX_HATYPE",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_HATYPE),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, SKB_DEV_IFINDEX + SKB_DEV_TYPE,
+	},
+	{
+		"ANC_IFINDEX_NO_DEV",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		PKT_DATA, PKT_LEN, NO_DEV, 0,
+	},
+	{
+		"ANC_CPU",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 1),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_DATA, PKT_LEN, 0, 1,
+	},
+};
+
+static struct net_device test_dev;
+
+static unsigned int filter_len(const struct bpf_test *test)
+{
+	unsigned int len;
+
+	/* a program ends with a return, whose code is never 0 */
+	for (len = MAX_INSNS; len > 0; len--)
+		if (test->insns[len - 1].code)
+			break;
+	return len;
+}
+
+static struct sk_buff *populate_skb(const struct bpf_test *test, bool frag)
+{
+	unsigned int headlen = test->data_len;
+	struct sk_buff *skb;
+	struct page *page;
+
+	if (frag && headlen > FRAG_HEADLEN)
+		headlen = FRAG_HEADLEN;
+
+	skb = alloc_skb(MAX_DATA, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	memcpy(__skb_put(skb, headlen), test->data, headlen);
+	if (headlen < test->data_len) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return NULL;
+		}
+		memcpy(page_address(page), test->data + headlen,
+		       test->data_len - headlen);
+		skb_add_rx_frag(skb, 0, page, 0, test->data_len - headlen);
+	}
+
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, ETH_HLEN);
+	skb->protocol = htons(ETH_P_IP);
+	skb->mark = SKB_MARK;
+	skb->rxhash = SKB_HASH;
+	skb->queue_mapping = SKB_QUEUE_MAP;
+	skb->dev = test->flags & NO_DEV ? NULL : &test_dev;
+
+	return skb;
+}
+
+static u64 time_runs(struct sk_buff *skb, struct sk_filter *fp, bool jit)
+{
+	ktime_t start;
+	u64 ns;
+	int i;
+
+	start = ktime_get();
+	for (i = 0; i < runs; i++) {
+		if (jit)
+			SK_RUN_FILTER(fp, skb);
+		else
+			sk_run_filter(skb, fp->insns);
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	do_div(ns, runs);
+
+	return ns;
+}
+
+static int run_one(const struct bpf_test *test, struct sk_filter *fp,
+		   bool frag)
+{
+	unsigned int interp_ret, jit_ret;
+	u64 interp_ns, jit_ns;
+	struct sk_buff *skb;
+	int err = 0;
+
+	skb = populate_skb(test, frag);
+	if (!skb)
+		return -ENOMEM;
+
+	/* stay on one cpu, SKF_AD_CPU must not change between the runs */
+	preempt_disable();
+	interp_ret = sk_run_filter(skb, fp->insns);
+	jit_ret = SK_RUN_FILTER(fp, skb);
+	interp_ns = time_runs(skb, fp, false);
+	jit_ns = time_runs(skb, fp, true);
+	preempt_enable();
+
+	if (interp_ret != test->result || jit_ret != test->result) {
+		pr_err("%s%s: expected %u, interpreter %u, jit %u\n",
+		       test->descr, frag ? " (frag)" : "", test->result,
+		       interp_ret, jit_ret);
+		err = -EINVAL;
+	} else {
+		pr_info("%s%s: interpreter %llu ns, %s %llu ns\n",
+			test->descr, frag ? " (frag)" : "", interp_ns,
+			fp->bpf_func != sk_run_filter ? "jit" : "no jit",
+			jit_ns);
+	}
+
+	kfree_skb(skb);
+	return err;
+}
+
+static int __init test_bpf_init(void)
+{
+	struct bpf_test *test;
+	struct sock_fprog fprog;
+	struct sk_filter *fp;
+	int i, err, failed = 0, jited = 0;
+
+	if (runs <= 0)
+		return -EINVAL;
+
+	test_dev.ifindex = SKB_DEV_IFINDEX;
+	test_dev.type = SKB_DEV_TYPE;
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		test = &tests[i];
+		fprog.filter = test->insns;
+		fprog.len = filter_len(test);
+
+		err = sk_unattached_filter_create(&fp, &fprog);
+		if (err) {
+			pr_err("%s: filter rejected: %d\n", test->descr, err);
+			failed++;
+			continue;
+		}
+		if (fp->bpf_func != sk_run_filter)
+			jited++;
+
+		if (run_one(test, fp, false))
+			failed++;
+		else if (!(test->flags & LINEAR_ONLY) && run_one(test, fp, true))
+			failed++;
+
+		sk_unattached_filter_destroy(fp);
+	}
+
+	pr_info("%d tests, %d jited, %d failed\n", (int)ARRAY_SIZE(tests),
+		jited, failed);
+
+	return failed ? -EINVAL : 0;
+}
+
+static void __exit test_bpf_exit(void)
+{
+}
+
+module_init(test_bpf_init);
+module_exit(test_bpf_exit);
+MODULE_LICENSE("GPL");
@@ -139,18 +139,59 @@ void br_fdb_change_mac_address(struct net_bridge *br, const u8 *newaddr)
 	fdb_insert(br, NULL, newaddr);
 }
 
+/* Only looks at the chain under RCU, so that the lock is taken just for
+ * the chains that actually have something to delete.
+ */
+static bool fdb_chain_has_expired(struct net_bridge *br,
+				  struct hlist_head *head,
+				  unsigned long delay)
+{
+	struct net_bridge_fdb_entry *f;
+	struct hlist_node *h;
+	bool ret = false;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(f, h, head, hlist) {
+		unsigned long this_timer;
+
+		if (f->is_static)
+			continue;
+		this_timer = ACCESS_ONCE(f->updated) + delay;
+		if (time_before_eq(this_timer, jiffies)) {
+			ret = true;
+			break;
+		}
+		if (time_before(this_timer, br->gc_next_expire))
+			br->gc_next_expire = this_timer;
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/* Ages BR_GC_CHAINS hash chains per run and comes back on the next tick
+ * until the whole table has been seen, so that learning on the receive
+ * path never waits for a scan of the full table.
+ */
 void br_fdb_cleanup(unsigned long _data)
 {
 	struct net_bridge *br = (struct net_bridge *)_data;
 	unsigned long delay = hold_time(br);
-	unsigned long next_timer = jiffies + br->ageing_time;
-	int i;
+	unsigned int i, end;
 
-	spin_lock(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	if (br->gc_next_chain == 0)
+		br->gc_next_expire = jiffies + br->ageing_time;
+
+	end = min_t(unsigned int, br->gc_next_chain + BR_GC_CHAINS,
+		    BR_HASH_SIZE);
+	for (i = br->gc_next_chain; i < end; i++) {
 		struct net_bridge_fdb_entry *f;
 		struct hlist_node *h, *n;
 
+		if (!fdb_chain_has_expired(br, &br->hash[i], delay))
+			continue;
+
+		spin_lock(&br->hash_lock);
 		hlist_for_each_entry_safe(f, h, n, &br->hash[i], hlist) {
 			unsigned long this_timer;
 			if (f->is_static)
@@ -158,13 +199,19 @@ void br_fdb_cleanup(unsigned long _data)
 			this_timer = f->updated + delay;
 			if (time_before_eq(this_timer, jiffies))
 				fdb_delete(br, f);
-			else if (time_before(this_timer, next_timer))
-				next_timer = this_timer;
+			else if (time_before(this_timer, br->gc_next_expire))
+				br->gc_next_expire = this_timer;
 		}
+		spin_unlock(&br->hash_lock);
 	}
-	spin_unlock(&br->hash_lock);
 
-	mod_timer(&br->gc_timer, round_jiffies_up(next_timer));
+	if (end < BR_HASH_SIZE) {
+		br->gc_next_chain = end;
+		mod_timer(&br->gc_timer, jiffies + 1);
+	} else {
+		br->gc_next_chain = 0;
+		mod_timer(&br->gc_timer, round_jiffies_up(br->gc_next_expire));
+	}
 }
 
 /* Completely flush all dynamic entries in forwarding database.*/
@@ -435,9 +482,16 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 					"own address as source address\n",
 					source->dev->name);
 		} else {
-			/* fastpath: update of existing entry */
-			fdb->dst = source;
-			fdb->updated = jiffies;
+			unsigned long now = jiffies;
+
+			/* fastpath: update of existing entry, only write
+			 * what changed so that a busy station does not
+			 * keep bouncing the entry between CPUs
+			 */
+			if (unlikely(source != fdb->dst))
+				fdb->dst = source;
+			if (fdb->updated != now)
+				fdb->updated = now;
 		}
 	} else {
 		spin_lock(&br->hash_lock);
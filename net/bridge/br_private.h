@@ -22,6 +22,9 @@
 #define BR_HASH_BITS 8
 #define BR_HASH_SIZE (1 << BR_HASH_BITS)
 
+/* Hash chains aged by one run of the fdb gc timer */
+#define BR_GC_CHAINS	32
+
 #define BR_HOLD_TIME (1*HZ)
 
 #define BR_PORT_BITS	10
@@ -67,13 +70,14 @@ struct net_bridge_fdb_entry
 {
 	struct hlist_node		hlist;
 	struct net_bridge_port		*dst;
-
-	struct rcu_head			rcu;
-	unsigned long			updated;
-	unsigned long			used;
 	mac_addr			addr;
 	unsigned char			is_local;
 	unsigned char			is_static;
+	struct rcu_head			rcu;
+
+	/* written for every packet, keep them away from what lookups read */
+	unsigned long			updated ____cacheline_aligned_in_smp;
+	unsigned long			used;
 };
 
 struct net_bridge_port_group {
@@ -256,6 +260,9 @@ struct net_bridge
 	struct timer_list		tcn_timer;
 	struct timer_list		topology_change_timer;
 	struct timer_list		gc_timer;
+	/* chain the gc timer ages next, and earliest expiry seen so far */
+	unsigned int			gc_next_chain;
+	unsigned long			gc_next_expire;
 	struct kobject			*ifobj;
 };
 
@@ -95,6 +95,7 @@
 #include <linux/ethtool.h>
 #include <linux/notifier.h>
 #include <linux/skbuff.h>
+#include <linux/netfilter.h>
 #include <net/net_namespace.h>
 #include <net/sock.h>
 #include <linux/rtnetlink.h>
@@ -136,6 +137,7 @@
 #include <linux/net_tstamp.h>
 #include <linux/jump_label.h>
 #include <net/flow_keys.h>
+#include <net/busy_poll.h>
 
 #include "net-sysfs.h"
 
@@ -1583,12 +1585,10 @@ static inline bool is_skb_forwardable(struct net_device *dev,
  */
 int dev_forward_skb(struct net_device *dev, struct sk_buff *skb)
 {
-	if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-		if (skb_copy_ubufs(skb, GFP_ATOMIC)) {
-			atomic_long_inc(&dev->rx_dropped);
-			kfree_skb(skb);
-			return NET_RX_DROP;
-		}
+	if (skb_orphan_frags_rx(skb, GFP_ATOMIC)) {
+		atomic_long_inc(&dev->rx_dropped);
+		kfree_skb(skb);
+		return NET_RX_DROP;
 	}
 
 	skb_orphan(skb);
@@ -2106,25 +2106,6 @@ static int dev_gso_segment(struct sk_buff *skb, netdev_features_t features)
 	return 0;
 }
 
-/*
- * Try to orphan skb early, right before transmission by the device.
- * We cannot orphan skb if tx timestamp is requested or the sk-reference
- * is needed on driver level for other reasons, e.g. see net/can/raw.c
- */
-static inline void skb_orphan_try(struct sk_buff *skb)
-{
-	struct sock *sk = skb->sk;
-
-	if (sk && !skb_shinfo(skb)->tx_flags) {
-		/* skb_tx_hash() wont be able to get sk.
-		 * We copy sk_hash into skb->rxhash
-		 */
-		if (!skb->rxhash)
-			skb->rxhash = sk->sk_hash;
-		skb_orphan(skb);
-	}
-}
-
 static bool can_checksum_protocol(netdev_features_t features, __be16 protocol)
 {
 	return ((features & NETIF_F_GEN_CSUM) ||
@@ -2210,8 +2191,6 @@ int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
 		if (!list_empty(&ptype_all))
 			dev_queue_xmit_nit(skb, dev);
 
-		skb_orphan_try(skb);
-
 		features = netif_skb_features(skb);
 
 		if (vlan_tx_tag_present(skb) &&
@@ -3255,6 +3234,24 @@ ncls:
 		}
 	}
 
+#if IS_ENABLED(CONFIG_NF_FLOW_OFFLOAD)
+	if (skb->protocol == cpu_to_be16(ETH_P_IP)) {
+		int (*offload)(struct sk_buff *skb);
+
+		offload = rcu_dereference(nf_flow_offload_hook);
+		if (offload) {
+			if (pt_prev) {
+				ret = deliver_skb(skb, pt_prev, orig_dev);
+				pt_prev = NULL;
+			}
+			if (offload(skb)) {
+				ret = NET_RX_SUCCESS;
+				goto out;
+			}
+		}
+	}
+#endif
+
 	/* deliver only exact match when indicated */
 	null_or_dev = deliver_exact ? skb->dev : NULL;
 
@@ -3560,6 +3557,7 @@ EXPORT_SYMBOL(skb_gro_reset_offset);
 
 gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 {
+	skb_mark_napi_id(skb, napi);
 	skb_gro_reset_offset(skb);
 
 	return napi_skb_finish(__napi_gro_receive(napi, skb), skb);
@@ -3626,6 +3624,7 @@ struct sk_buff *napi_frags_skb(struct napi_struct *napi)
 
 	napi->skb = NULL;
 
+	skb_mark_napi_id(skb, napi);
 	skb_reset_mac_header(skb);
 	skb_gro_reset_offset(skb);
 
@@ -3795,6 +3794,169 @@ void napi_complete(struct napi_struct *n)
 }
 EXPORT_SYMBOL(napi_complete);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/*
+ * NAPI contexts are hashed by napi_id so that a socket, which only
+ * remembers the id of the context it last received on, can find it
+ * again to busy poll.
+ */
+#define NAPI_HASH_BITS	8
+
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+static struct hlist_head napi_hash[1 << NAPI_HASH_BITS];
+
+unsigned int sysctl_net_busy_read __read_mostly;
+unsigned int sysctl_net_busy_poll __read_mostly;
+
+static struct hlist_head *napi_hash_bucket(unsigned int napi_id)
+{
+	return &napi_hash[hash_32(napi_id, NAPI_HASH_BITS)];
+}
+
+/* must be called under rcu_read_lock(), as we dont take a reference */
+struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	struct napi_struct *napi;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(napi, pos, napi_hash_bucket(napi_id),
+				 napi_hash_node)
+		if (napi->napi_id == napi_id)
+			return napi;
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(napi_by_id);
+
+static void napi_hash_add(struct napi_struct *napi)
+{
+	spin_lock(&napi_hash_lock);
+
+	/* 0 is not a valid id, we also skip an id that is taken
+	 * we expect both events to be extremely rare
+	 */
+	do {
+		if (unlikely(++napi_gen_id == 0))
+			napi_gen_id++;
+	} while (napi_by_id(napi_gen_id));
+	napi->napi_id = napi_gen_id;
+
+	hlist_add_head_rcu(&napi->napi_hash_node,
+			   napi_hash_bucket(napi->napi_id));
+	set_bit(NAPI_STATE_HASHED, &napi->state);
+
+	spin_unlock(&napi_hash_lock);
+}
+
+/* Returns true if the caller must wait a grace period before freeing */
+static bool napi_hash_del(struct napi_struct *napi)
+{
+	bool rcu_sync_needed = false;
+
+	spin_lock(&napi_hash_lock);
+
+	if (test_and_clear_bit(NAPI_STATE_HASHED, &napi->state)) {
+		rcu_sync_needed = true;
+		hlist_del_rcu(&napi->napi_hash_node);
+	}
+	spin_unlock(&napi_hash_lock);
+	return rcu_sync_needed;
+}
+
+/*
+ * Hand a context we took ownership of in sk_busy_loop() back: either it
+ * is being disabled, or it still has work and goes to the softirq.
+ */
+static void busy_poll_stop(struct napi_struct *napi)
+{
+	if (unlikely(napi_disable_pending(napi)))
+		napi_complete(napi);
+	else
+		__napi_schedule(napi);
+}
+
+/**
+ *	sk_busy_loop - poll the device queue a socket last received on
+ *	@sk: socket waiting for data
+ *	@nonblock: poll only once instead of for sk->sk_ll_usec
+ *
+ *	Calls the NAPI poll routine of the context recorded in the socket
+ *	directly from process context, until data shows up on the socket,
+ *	the time budget runs out or we should give up the CPU.  Returns
+ *	true if the socket receive queue is not empty.
+ */
+bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
+	struct napi_struct *napi;
+	bool owned = false;
+	bool rc = false;
+
+	rcu_read_lock();
+
+	napi = napi_by_id(sk->sk_napi_id);
+	if (!napi)
+		goto out;
+
+	do {
+		int work = 0;
+
+		local_bh_disable();
+		if (owned || napi_schedule_prep(napi)) {
+			void *have = netpoll_poll_lock(napi);
+
+			/* Whoever sets NAPI_STATE_SCHED owns the poll_list,
+			 * and ours is not on any cpu's list.
+			 */
+			if (!owned)
+				INIT_LIST_HEAD(&napi->poll_list);
+			work = napi->poll(napi, BUSY_POLL_BUDGET);
+			trace_napi_poll(napi);
+
+			/* Drivers must not modify the NAPI state if they
+			 * consume the entire budget: we still own it then.
+			 */
+			owned = work == BUSY_POLL_BUDGET;
+			if (owned && napi_disable_pending(napi)) {
+				busy_poll_stop(napi);
+				owned = false;
+			}
+			netpoll_poll_unlock(have);
+		}
+		if (work > 0)
+			NET_ADD_STATS_BH(sock_net(sk),
+					 LINUX_MIB_BUSYPOLLRXPACKETS, work);
+		local_bh_enable();
+
+		rc = !skb_queue_empty(&sk->sk_receive_queue);
+		if (rc || nonblock)
+			break;
+		cpu_relax();
+	} while (!need_resched() && !signal_pending(current) &&
+		 !busy_loop_timeout(end_time));
+
+	if (owned) {
+		local_bh_disable();
+		busy_poll_stop(napi);
+		local_bh_enable();
+	}
+out:
+	rcu_read_unlock();
+	return rc;
+}
+EXPORT_SYMBOL(sk_busy_loop);
+#else
+static inline void napi_hash_add(struct napi_struct *napi)
+{
+}
+
+static inline bool napi_hash_del(struct napi_struct *napi)
+{
+	return false;
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		    int (*poll)(struct napi_struct *, int), int weight)
 {
@@ -3811,6 +3973,7 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 	napi->poll_owner = -1;
 #endif
 	set_bit(NAPI_STATE_SCHED, &napi->state);
+	napi_hash_add(napi);
 }
 EXPORT_SYMBOL(netif_napi_add);
 
@@ -3818,6 +3981,10 @@ void netif_napi_del(struct napi_struct *napi)
 {
 	struct sk_buff *skb, *next;
 
+	/* busy pollers may still be looking at it */
+	if (napi_hash_del(napi))
+		synchronize_net();
+
 	list_del_init(&napi->dev_list);
 	napi_free_frags(napi);
 
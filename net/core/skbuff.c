@@ -621,6 +621,10 @@ static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 	new->vlan_tci		= old->vlan_tci;
 
 	skb_copy_secmark(new, old);
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	new->napi_id		= old->napi_id;
+#endif
 }
 
 /*
@@ -679,7 +683,8 @@ EXPORT_SYMBOL_GPL(skb_morph);
  *
  *	This must be called on SKBTX_DEV_ZEROCOPY skb.
  *	It will copy all frags into kernel and drop the reference
- *	to userspace pages.
+ *	to userspace pages.  A cloned skb first gets its own
+ *	skb_shared_info, so the other clones keep the user pages.
  *
  *	If this function is called from an interrupt gfp_mask() must be
  *	%GFP_ATOMIC.
@@ -690,10 +695,22 @@ EXPORT_SYMBOL_GPL(skb_morph);
 int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 {
 	int i;
-	int num_frags = skb_shinfo(skb)->nr_frags;
+	int num_frags;
 	struct page *page, *head = NULL;
-	struct ubuf_info *uarg = skb_shinfo(skb)->destructor_arg;
+	struct ubuf_info *uarg;
 
+	/* only MSG_ZEROCOPY skbs are cloned without copying, see
+	 * skb_orphan_frags()
+	 */
+	if (skb_cloned(skb)) {
+		if (WARN_ON_ONCE(skb_shared(skb) || !skb_sock_zerocopy(skb)))
+			return -EINVAL;
+		if (pskb_expand_head(skb, 0, 0, gfp_mask))
+			return -ENOMEM;
+	}
+
+	num_frags = skb_shinfo(skb)->nr_frags;
+	uarg = skb_shinfo(skb)->destructor_arg;
 	for (i = 0; i < num_frags; i++) {
 		u8 *vaddr;
 		skb_frag_t *f = &skb_shinfo(skb)->frags[i];
@@ -719,6 +736,9 @@ int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
 		skb_frag_unref(skb, i);
 
+	/* let MSG_ZEROCOPY senders know their data was copied after all */
+	if (uarg->callback == sock_zerocopy_callback)
+		container_of(uarg, struct sock_zerocopy, ubuf)->copied = true;
 	uarg->callback(uarg);
 
 	/* skb frags point to kernel buffers */
@@ -751,10 +771,9 @@ struct sk_buff *skb_clone(struct sk_buff *skb, gfp_t gfp_mask)
 {
 	struct sk_buff *n;
 
-	if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-		if (skb_copy_ubufs(skb, gfp_mask))
-			return NULL;
-	}
+	/* clones share skb_shared_info, and with it the sender's reference */
+	if (skb_orphan_frags(skb, gfp_mask))
+		return NULL;
 
 	n = skb + 1;
 	if (skb->fclone == SKB_FCLONE_ORIG &&
@@ -874,18 +893,17 @@ struct sk_buff *__pskb_copy(struct sk_buff *skb, int headroom, gfp_t gfp_mask)
 	if (skb_shinfo(skb)->nr_frags) {
 		int i;
 
-		if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-			if (skb_copy_ubufs(skb, gfp_mask)) {
-				kfree_skb(n);
-				n = NULL;
-				goto out;
-			}
+		if (skb_orphan_frags(skb, gfp_mask)) {
+			kfree_skb(n);
+			n = NULL;
+			goto out;
 		}
 		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
 			skb_shinfo(n)->frags[i] = skb_shinfo(skb)->frags[i];
 			skb_frag_ref(skb, i);
 		}
 		skb_shinfo(n)->nr_frags = i;
+		skb_zerocopy_clone(n, skb);
 	}
 
 	if (skb_has_frag_list(skb)) {
@@ -968,8 +986,12 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 	if (fastpath) {
 		kfree(skb->head);
 	} else {
-		/* copy this zero copy skb frags */
-		if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
+		/* copy this zero copy skb frags, unless the new
+		 * skb_shared_info can take its own MSG_ZEROCOPY reference
+		 */
+		if (skb_sock_zerocopy(skb)) {
+			sock_zerocopy_get(skb_sock_zerocopy(skb));
+		} else if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
 			if (skb_copy_ubufs(skb, gfp_mask))
 				goto nofrags;
 		}
@@ -2260,6 +2282,7 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 		skb_split_inside_header(skb, skb1, len, pos);
 	else		/* Second chunk has no header, nothing to copy. */
 		skb_split_no_header(skb, skb1, len, pos);
+	skb_zerocopy_clone(skb1, skb);
 }
 EXPORT_SYMBOL(skb_split);
 
@@ -2298,6 +2321,11 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 	BUG_ON(shiftlen > skb->len);
 	BUG_ON(skb_headlen(skb));	/* Would corrupt stream */
 
+	/* frags of user pages must stay with their completion state */
+	if ((skb_shinfo(skb)->tx_flags | skb_shinfo(tgt)->tx_flags) &
+	    SKBTX_DEV_ZEROCOPY)
+		return 0;
+
 	todo = shiftlen;
 	from = 0;
 	to = skb_shinfo(tgt)->nr_frags;
@@ -2815,6 +2843,7 @@ struct sk_buff *skb_segment(struct sk_buff *skb, netdev_features_t features)
 		}
 
 skip_fraglist:
+		skb_zerocopy_clone(nskb, skb);
 		nskb->data_len = len - hsize;
 		nskb->len += nskb->data_len;
 		nskb->truesize += nskb->data_len;
@@ -3179,6 +3208,270 @@ int sock_queue_err_skb(struct sock *sk, struct sk_buff *skb)
 }
 EXPORT_SYMBOL(sock_queue_err_skb);
 
+/*
+ * MSG_ZEROCOPY support.
+ *
+ * Each zerocopy send gets an id from sk->sk_zckey.  Consecutive sends
+ * whose data ends up in the same skb share one struct sock_zerocopy
+ * covering a range of ids, which keeps the number of completions (and
+ * error queue entries) down for streams of small sends.
+ */
+static bool sock_zerocopy_extend(struct sock_zerocopy *uz, struct sock *sk,
+				 bool copied)
+{
+	if (uz->sk != sk || uz->copied != copied)
+		return false;
+	if (uz->id + uz->len != sk->sk_zckey || uz->len == USHRT_MAX)
+		return false;
+
+	uz->len++;
+	sk->sk_zckey++;
+	sock_zerocopy_get(uz);
+	return true;
+}
+
+/**
+ *	sock_zerocopy_alloc - get completion state for a MSG_ZEROCOPY send
+ *	@sk: sending socket, locked by the caller
+ *	@skb: last skb of the send queue, or %NULL
+ *
+ *	Extends the state of the previous send when it is still attached to
+ *	@skb, otherwise allocates a new one.  The notification skb is
+ *	allocated up front and charged to the socket option memory, so the
+ *	completion can always be reported.  The caller owns one reference
+ *	and must drop it with sock_zerocopy_put() or sock_zerocopy_put_abort().
+ */
+struct sock_zerocopy *sock_zerocopy_alloc(struct sock *sk, struct sk_buff *skb)
+{
+	struct sock_zerocopy *uz = skb ? skb_sock_zerocopy(skb) : NULL;
+	struct sk_buff *notify;
+
+	if (uz && sock_zerocopy_extend(uz, sk, false))
+		return uz;
+
+	if (atomic_read(&sk->sk_omem_alloc) > sysctl_optmem_max)
+		return NULL;
+
+	notify = alloc_skb(0, sk->sk_allocation);
+	if (!notify)
+		return NULL;
+
+	uz = kmalloc(sizeof(*uz), sk->sk_allocation);
+	if (!uz) {
+		kfree_skb(notify);
+		return NULL;
+	}
+	atomic_add(notify->truesize, &sk->sk_omem_alloc);
+
+	uz->ubuf.callback = sock_zerocopy_callback;
+	uz->ubuf.arg = uz;
+	uz->ubuf.desc = 0;
+	uz->sk = sk;
+	uz->notify = notify;
+	atomic_set(&uz->refcnt, 1);
+	uz->id = sk->sk_zckey++;
+	uz->len = 1;
+	uz->copied = false;
+	sock_hold(sk);
+
+	return uz;
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_alloc);
+
+/* Merge into the last queued notification if the ranges are adjacent */
+static bool sock_zerocopy_notify_extend(struct sk_buff *tail,
+					struct sock_zerocopy *uz)
+{
+	struct sock_exterr_skb *serr = SKB_EXT_ERR(tail);
+	u32 old_hi = serr->ee.ee_data;
+
+	if (serr->ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+	    serr->ee.ee_code != (uz->copied ? SO_EE_CODE_ZEROCOPY_COPIED : 0))
+		return false;
+	if (old_hi + 1 != uz->id)
+		return false;
+
+	serr->ee.ee_data += uz->len;
+	return true;
+}
+
+static void sock_zerocopy_notify(struct sock_zerocopy *uz)
+{
+	struct sk_buff_head *q;
+	struct sock_exterr_skb *serr;
+	struct sk_buff *skb = uz->notify;
+	struct sock *sk = uz->sk;
+	unsigned long flags;
+
+	atomic_sub(skb->truesize, &sk->sk_omem_alloc);
+
+	serr = SKB_EXT_ERR(skb);
+	memset(serr, 0, sizeof(*serr));
+	serr->ee.ee_errno = 0;
+	serr->ee.ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+	serr->ee.ee_info = uz->id;
+	serr->ee.ee_data = uz->id + uz->len - 1;
+	if (uz->copied)
+		serr->ee.ee_code = SO_EE_CODE_ZEROCOPY_COPIED;
+
+	q = &sk->sk_error_queue;
+	spin_lock_irqsave(&q->lock, flags);
+	if (skb_queue_empty(q) ||
+	    !sock_zerocopy_notify_extend(skb_peek_tail(q), uz)) {
+		skb->sk = sk;
+		skb->destructor = sock_rmem_free;
+		atomic_add(skb->truesize, &sk->sk_rmem_alloc);
+		__skb_queue_tail(q, skb);
+		skb = NULL;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	if (!sock_flag(sk, SOCK_DEAD))
+		sk->sk_error_report(sk);
+
+	kfree_skb(skb);
+	sock_put(sk);
+	kfree(uz);
+}
+
+void sock_zerocopy_put(struct sock_zerocopy *uz)
+{
+	if (uz && atomic_dec_and_test(&uz->refcnt))
+		sock_zerocopy_notify(uz);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put);
+
+/**
+ *	sock_zerocopy_put_abort - drop the sender's reference after an error
+ *	@uz: state returned by sock_zerocopy_alloc()
+ *
+ *	If no data of this send was queued, give its id back instead of
+ *	reporting a completion for it.  Called with the socket locked.
+ */
+void sock_zerocopy_put_abort(struct sock_zerocopy *uz)
+{
+	struct sock *sk;
+
+	if (!uz)
+		return;
+
+	sk = uz->sk;
+	if (uz->id + uz->len == sk->sk_zckey) {
+		sk->sk_zckey--;
+		uz->len--;
+	}
+	if (!uz->len) {
+		/* nobody else can see it */
+		atomic_sub(uz->notify->truesize, &sk->sk_omem_alloc);
+		kfree_skb(uz->notify);
+		sock_put(sk);
+		kfree(uz);
+		return;
+	}
+	sock_zerocopy_put(uz);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put_abort);
+
+/* ubuf_info callback, run when an skb_shared_info drops its reference */
+void sock_zerocopy_callback(void *arg)
+{
+	struct ubuf_info *uarg = arg;
+
+	sock_zerocopy_put(container_of(uarg, struct sock_zerocopy, ubuf));
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_callback);
+
+static void skb_zerocopy_set(struct sk_buff *skb, struct sock_zerocopy *uz)
+{
+	sock_zerocopy_get(uz);
+	skb_shinfo(skb)->destructor_arg = &uz->ubuf;
+	skb_shinfo(skb)->tx_flags |= SKBTX_DEV_ZEROCOPY;
+}
+
+/**
+ *	skb_zerocopy_clone - share MSG_ZEROCOPY state with a new skb
+ *	@nskb: skb that took references to some of @orig's frags
+ *	@orig: source skb
+ *
+ *	Used where frags of a zerocopy skb end up in another skb_shared_info,
+ *	so that the sender is not told its pages are free while @nskb still
+ *	points to them.  Other ubuf_info users copy their frags instead.
+ */
+void skb_zerocopy_clone(struct sk_buff *nskb, struct sk_buff *orig)
+{
+	struct sock_zerocopy *uz = skb_sock_zerocopy(orig);
+
+	if (uz && !skb_sock_zerocopy(nskb) && skb_shinfo(nskb)->nr_frags)
+		skb_zerocopy_set(nskb, uz);
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_clone);
+
+/**
+ *	skb_zerocopy_iter_stream - append user pages to a stream skb
+ *	@sk: owning socket
+ *	@skb: skb at the tail of the send queue
+ *	@from: user buffer
+ *	@len: bytes wanted
+ *	@uz: completion state of this send
+ *
+ *	Pins the pages backing @from and adds them to @skb as frags instead
+ *	of copying the data, charging them to the socket like copied data.
+ *	Returns the number of bytes added, 0 if @skb has no free frag slot,
+ *	-EEXIST if @skb belongs to another send or -EFAULT.
+ */
+int skb_zerocopy_iter_stream(struct sock *sk, struct sk_buff *skb,
+			     unsigned char __user *from, int len,
+			     struct sock_zerocopy *uz)
+{
+	struct sock_zerocopy *orig = skb_sock_zerocopy(skb);
+	struct page *pages[MAX_SKB_FRAGS];
+	int i = skb_shinfo(skb)->nr_frags;
+	unsigned long addr = (unsigned long)from;
+	int off = offset_in_page(addr);
+	int n, npages, copied = 0;
+
+	if (orig ? orig != uz : skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY)
+		return -EEXIST;
+
+	if (i == MAX_SKB_FRAGS)
+		return 0;
+
+	npages = min_t(int, DIV_ROUND_UP(off + len, PAGE_SIZE),
+		       MAX_SKB_FRAGS - i);
+	npages = get_user_pages_fast(addr, npages, 0, pages);
+	if (npages <= 0)
+		return -EFAULT;
+
+	for (n = 0; n < npages && copied < len; n++) {
+		int size = min_t(int, len - copied, PAGE_SIZE - off);
+
+		if (i && skb_can_coalesce(skb, i, pages[n], off)) {
+			skb_frag_size_add(&skb_shinfo(skb)->frags[i - 1], size);
+			put_page(pages[n]);
+		} else if (i < MAX_SKB_FRAGS) {
+			skb_fill_page_desc(skb, i++, pages[n], off, size);
+		} else {
+			break;
+		}
+		copied += size;
+		off = 0;
+	}
+	while (n < npages)
+		put_page(pages[n++]);
+
+	skb->len += copied;
+	skb->data_len += copied;
+	skb->truesize += copied;
+	sk->sk_wmem_queued += copied;
+	sk_mem_charge(sk, copied);
+
+	if (copied && !orig)
+		skb_zerocopy_set(skb, uz);
+
+	return copied;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_iter_stream);
+
 void skb_tstamp_tx(struct sk_buff *orig_skb,
 		struct skb_shared_hwtstamps *hwtstamps)
 {
@@ -24,8 +24,14 @@
 #include <linux/proc_fs.h>
 #include <linux/err.h>
 #include <linux/cpumask.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
 
 #include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_tcpudp.h>
 #include <linux/netfilter_ipv4/ip_tables.h>
 #include <net/netfilter/nf_log.h>
 #include "../../netfilter/xt_repldata.h"
@@ -284,6 +290,430 @@ struct ipt_entry *ipt_next_entry(const struct ipt_entry *entry)
 	return (void *)entry + entry->next_offset;
 }
 
+/*
+ * Rule index.
+ *
+ * Long lists of rules that only match on a single source or destination
+ * address, optionally with a protocol and a destination port, e.g. a
+ * blocklist, make ipt_do_table() try every one of them in turn.  When a
+ * table is loaded, runs of at least index_min_rules such consecutive
+ * rules keyed on the same address field are compiled into a hash on
+ * that key.  The walk then goes straight to the first rule of the run
+ * which can match the packet, or past the run if none can.  The rules
+ * skipped could not have matched, and the rule landed on is evaluated
+ * as usual, so verdicts and counters are the same as with the linear
+ * walk; jumps into the middle of a run simply walk the rest of it.
+ */
+static unsigned int index_min_rules __read_mostly = 16;
+module_param(index_min_rules, uint, 0644);
+MODULE_PARM_DESC(index_min_rules, "Minimum number of consecutive address rules "
+		 "indexed when a table is loaded (0 disables the index)");
+
+enum {
+	IPT_INDEX_NONE,
+	IPT_INDEX_SRC,
+	IPT_INDEX_DST,
+};
+
+/* Rule entries are aligned to this in the table blob */
+#define IPT_INDEX_UNIT	__alignof__(struct ipt_entry)
+
+struct ipt_index_key {
+	__be32			addr;
+	__be16			dport;
+	u8			proto;		/* 0: any protocol */
+	u8			has_port;
+};
+
+struct ipt_index_slot {
+	struct ipt_index_key	key;
+	unsigned int		pos;		/* rule number within the run */
+	unsigned int		offset;		/* of that rule in the table */
+	unsigned int		next;		/* next slot + 1 in bucket, or 0 */
+};
+
+struct ipt_index_run {
+	unsigned int		start;		/* offset of the first rule */
+	unsigned int		end;		/* offset of the rule after it */
+	unsigned int		nrules;
+	u8			type;
+	bool			ports;		/* some rule matches a port */
+	unsigned int		hmask;
+	unsigned int		*buckets;
+	struct ipt_index_slot	*slots;
+};
+
+struct ipt_index {
+	unsigned long		*starts;	/* bitmap of run start offsets */
+	unsigned int		nruns;
+	struct ipt_index_run	runs[0];
+};
+
+struct ipt_index_stat {
+	unsigned int		lookups;
+	unsigned int		hits;
+	unsigned int		skipped;	/* rules not evaluated */
+	unsigned int		fallback;	/* packets walking the run */
+};
+
+static DEFINE_PER_CPU(struct ipt_index_stat, ipt_index_stats);
+
+static void *ipt_index_zalloc(size_t size)
+{
+	if (size <= PAGE_SIZE)
+		return kzalloc(size, GFP_KERNEL);
+	return vzalloc(size);
+}
+
+static void ipt_index_kvfree(void *p)
+{
+	if (is_vmalloc_addr(p))
+		vfree(p);
+	else
+		kfree(p);
+}
+
+static void ipt_index_free(struct ipt_index *idx)
+{
+	unsigned int i;
+
+	if (idx == NULL)
+		return;
+	for (i = 0; i < idx->nruns; i++) {
+		ipt_index_kvfree(idx->runs[i].buckets);
+		ipt_index_kvfree(idx->runs[i].slots);
+	}
+	ipt_index_kvfree(idx->starts);
+	ipt_index_kvfree(idx);
+}
+
+static void ipt_free_table_info(struct xt_table_info *info)
+{
+	ipt_index_free(info->index);
+	xt_free_table_info(info);
+}
+
+static inline u32
+ipt_index_hash(const struct ipt_index_key *k, unsigned int hmask)
+{
+	return jhash_3words((__force u32)k->addr, (__force u32)k->dport,
+			    k->proto << 8 | k->has_port, 0) & hmask;
+}
+
+static inline bool
+ipt_index_key_equal(const struct ipt_index_key *a,
+		    const struct ipt_index_key *b)
+{
+	return a->addr == b->addr && a->dport == b->dport &&
+	       a->proto == b->proto && a->has_port == b->has_port;
+}
+
+/* Returns the index type of a rule and fills in its key, or
+ * IPT_INDEX_NONE if the rule looks at anything else. */
+static int
+ipt_index_rule_key(const struct ipt_entry *e, struct ipt_index_key *k)
+{
+	static const unsigned char nomask[IFNAMSIZ];
+	const struct ipt_ip *ip = &e->ip;
+	const struct xt_entry_match *ematch;
+	unsigned int nmatches = 0;
+	int type;
+
+	if (ip->invflags || (ip->flags & ~IPT_F_GOTO) ||
+	    memcmp(ip->iniface_mask, nomask, IFNAMSIZ) != 0 ||
+	    memcmp(ip->outiface_mask, nomask, IFNAMSIZ) != 0)
+		return IPT_INDEX_NONE;
+
+	if (ip->smsk.s_addr == htonl(0xFFFFFFFF) && ip->dmsk.s_addr == 0) {
+		type = IPT_INDEX_SRC;
+		k->addr = ip->src.s_addr;
+	} else if (ip->dmsk.s_addr == htonl(0xFFFFFFFF) &&
+		   ip->smsk.s_addr == 0) {
+		type = IPT_INDEX_DST;
+		k->addr = ip->dst.s_addr;
+	} else {
+		return IPT_INDEX_NONE;
+	}
+
+	k->proto    = ip->proto;
+	k->has_port = 0;
+	k->dport    = 0;
+
+	/* At most a plain destination port match */
+	xt_ematch_foreach(ematch, e) {
+		const struct xt_match *match = ematch->u.kernel.match;
+
+		if (++nmatches > 1 || match->revision != 0)
+			return IPT_INDEX_NONE;
+		if (ip->proto == IPPROTO_TCP && strcmp(match->name, "tcp") == 0) {
+			const struct xt_tcp *tcpinfo = (const void *)ematch->data;
+
+			if (tcpinfo->spts[0] != 0 || tcpinfo->spts[1] != 0xFFFF ||
+			    tcpinfo->dpts[0] != tcpinfo->dpts[1] ||
+			    tcpinfo->option || tcpinfo->flg_mask ||
+			    tcpinfo->invflags)
+				return IPT_INDEX_NONE;
+			k->dport = htons(tcpinfo->dpts[0]);
+		} else if (ip->proto == IPPROTO_UDP &&
+			   strcmp(match->name, "udp") == 0) {
+			const struct xt_udp *udpinfo = (const void *)ematch->data;
+
+			if (udpinfo->spts[0] != 0 || udpinfo->spts[1] != 0xFFFF ||
+			    udpinfo->dpts[0] != udpinfo->dpts[1] ||
+			    udpinfo->invflags)
+				return IPT_INDEX_NONE;
+			k->dport = htons(udpinfo->dpts[0]);
+		} else {
+			return IPT_INDEX_NONE;
+		}
+		k->has_port = 1;
+	}
+	return type;
+}
+
+/* Finds the runs worth indexing; only counts them if @idx is NULL. */
+static unsigned int
+ipt_index_scan(const struct xt_table_info *info, const void *entry0,
+	       unsigned int min, struct ipt_index *idx)
+{
+	const struct ipt_entry *iter, *start = NULL;
+	struct ipt_index_key key;
+	unsigned int nruns = 0, len = 0;
+	int type, cur = IPT_INDEX_NONE;
+
+	/* Tables end with the error rule, so no run reaches the end */
+	xt_entry_foreach(iter, entry0, info->size) {
+		type = ipt_index_rule_key(iter, &key);
+		if (type != IPT_INDEX_NONE && type == cur) {
+			len++;
+			continue;
+		}
+		if (len >= min) {
+			if (idx != NULL) {
+				struct ipt_index_run *run = &idx->runs[nruns];
+
+				run->start  = (const void *)start - entry0;
+				run->end    = (const void *)iter - entry0;
+				run->nrules = len;
+				run->type   = cur;
+			}
+			nruns++;
+		}
+		cur   = type;
+		start = iter;
+		len   = type != IPT_INDEX_NONE;
+	}
+	return nruns;
+}
+
+static int ipt_index_fill(struct ipt_index_run *run, const void *entry0)
+{
+	const struct ipt_entry *e;
+	struct ipt_index_slot *slot;
+	struct ipt_index_key key;
+	unsigned int i, b, s, n = 0;
+
+	run->hmask   = roundup_pow_of_two(run->nrules) - 1;
+	run->buckets = ipt_index_zalloc((run->hmask + 1) *
+					sizeof(*run->buckets));
+	run->slots   = ipt_index_zalloc(run->nrules * sizeof(*run->slots));
+	if (run->buckets == NULL || run->slots == NULL)
+		return -ENOMEM;
+
+	e = entry0 + run->start;
+	for (i = 0; i < run->nrules; i++, e = ipt_next_entry(e)) {
+		ipt_index_rule_key(e, &key);
+		if (key.has_port)
+			run->ports = true;
+
+		b = ipt_index_hash(&key, run->hmask);
+		for (s = run->buckets[b]; s != 0; s = run->slots[s - 1].next)
+			if (ipt_index_key_equal(&run->slots[s - 1].key, &key))
+				break;
+		/* Shadowed by an earlier rule with the same key */
+		if (s != 0)
+			continue;
+
+		slot = &run->slots[n++];
+		slot->key    = key;
+		slot->pos    = i;
+		slot->offset = (const void *)e - entry0;
+		slot->next   = run->buckets[b];
+		run->buckets[b] = n;
+	}
+	return 0;
+}
+
+/* Builds the index of a translated table.  Failing to is not an error,
+ * the table is just walked rule by rule. */
+static void
+ipt_index_build(struct xt_table_info *info, const void *entry0)
+{
+	unsigned int min = index_min_rules;
+	struct ipt_index *idx;
+	unsigned int i, nruns;
+
+	if (min == 0)
+		return;
+	if (min < 2)
+		min = 2;
+
+	nruns = ipt_index_scan(info, entry0, min, NULL);
+	if (nruns == 0)
+		return;
+
+	idx = ipt_index_zalloc(sizeof(*idx) + nruns * sizeof(idx->runs[0]));
+	if (idx == NULL)
+		return;
+	idx->starts = ipt_index_zalloc(BITS_TO_LONGS(info->size /
+					IPT_INDEX_UNIT) * sizeof(long));
+	if (idx->starts == NULL)
+		goto err;
+
+	idx->nruns = ipt_index_scan(info, entry0, min, idx);
+	for (i = 0; i < idx->nruns; i++) {
+		if (ipt_index_fill(&idx->runs[i], entry0) != 0)
+			goto err;
+		__set_bit(idx->runs[i].start / IPT_INDEX_UNIT, idx->starts);
+	}
+
+	duprintf("ipt_index_build: %u runs\n", idx->nruns);
+	info->index = idx;
+	return;
+err:
+	ipt_index_free(idx);
+}
+
+static const struct ipt_index_slot *
+ipt_index_find(const struct ipt_index_run *run, const struct ipt_index_key *k,
+	       const struct ipt_index_slot *best)
+{
+	const struct ipt_index_slot *slot;
+	unsigned int s;
+
+	for (s = run->buckets[ipt_index_hash(k, run->hmask)]; s != 0;
+	     s = slot->next) {
+		slot = &run->slots[s - 1];
+		if (ipt_index_key_equal(&slot->key, k))
+			return (best == NULL || slot->pos < best->pos) ?
+				slot : best;
+	}
+	return best;
+}
+
+/* Returns the offset of the first rule of @run the packet can match, or
+ * of the rule after the run if there is none.  Returns @run->start when
+ * the rules have to be walked: the tcp and udp matches get to decide
+ * what to do with fragments and truncated headers. */
+static unsigned int
+ipt_index_lookup(const struct ipt_index_run *run, const struct sk_buff *skb,
+		 const struct iphdr *ip, const struct xt_action_param *par)
+{
+	struct ipt_index_stat *stat = &__get_cpu_var(ipt_index_stats);
+	const struct ipt_index_slot *best = NULL;
+	struct ipt_index_key key;
+
+	key.addr     = run->type == IPT_INDEX_SRC ? ip->saddr : ip->daddr;
+	key.proto    = ip->protocol;
+	key.has_port = 1;
+
+	if (run->ports &&
+	    (ip->protocol == IPPROTO_TCP || ip->protocol == IPPROTO_UDP)) {
+		unsigned int hlen = ip->protocol == IPPROTO_TCP ?
+				    sizeof(struct tcphdr) :
+				    sizeof(struct udphdr);
+		__be16 _ports[sizeof(struct tcphdr) / sizeof(__be16)];
+		const __be16 *ports;
+
+		ports = par->fragoff ? NULL :
+			skb_header_pointer(skb, par->thoff, hlen, _ports);
+		if (ports == NULL) {
+			stat->fallback++;
+			return run->start;
+		}
+		key.dport = ports[1];
+		best = ipt_index_find(run, &key, best);
+	}
+
+	key.has_port = 0;
+	key.dport    = 0;
+	best = ipt_index_find(run, &key, best);
+	if (key.proto != 0) {
+		key.proto = 0;
+		best = ipt_index_find(run, &key, best);
+	}
+
+	stat->lookups++;
+	if (best == NULL) {
+		stat->skipped += run->nrules;
+		return run->end;
+	}
+	stat->hits++;
+	stat->skipped += best->pos;
+	return best->offset;
+}
+
+/* Performance critical */
+static inline struct ipt_entry *
+ipt_index_skip(const struct ipt_index *idx, const struct sk_buff *skb,
+	       const struct iphdr *ip, const struct xt_action_param *par,
+	       const void *table_base, struct ipt_entry *e)
+{
+	unsigned int off = (void *)e - table_base, next, lo, hi, mid;
+
+	while (test_bit(off / IPT_INDEX_UNIT, idx->starts)) {
+		lo = 0;
+		hi = idx->nruns - 1;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (idx->runs[mid].start < off)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		next = ipt_index_lookup(&idx->runs[lo], skb, ip, par);
+		if (next == off)
+			break;
+		/* The rule after a run may start another one */
+		off = next;
+	}
+	return get_entry(table_base, off);
+}
+
+#ifdef CONFIG_PROC_FS
+static int ipt_index_stat_show(struct seq_file *seq, void *v)
+{
+	struct ipt_index_stat sum = {};
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct ipt_index_stat *st = &per_cpu(ipt_index_stats, cpu);
+
+		sum.lookups  += st->lookups;
+		sum.hits     += st->hits;
+		sum.skipped  += st->skipped;
+		sum.fallback += st->fallback;
+	}
+	seq_printf(seq, "lookups  hits  skipped  fallback\n"
+			"%u %u %u %u\n",
+		   sum.lookups, sum.hits, sum.skipped, sum.fallback);
+	return 0;
+}
+
+static int ipt_index_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ipt_index_stat_show, NULL);
+}
+
+static const struct file_operations ipt_index_stat_fops = {
+	.owner	 = THIS_MODULE,
+	.open	 = ipt_index_stat_open,
+	.read	 = seq_read,
+	.llseek	 = seq_lseek,
+	.release = single_release,
+};
+#endif /* CONFIG_PROC_FS */
+
 /* Returns one of the generic firewall policies, like NF_ACCEPT. */
 unsigned int
 ipt_do_table(struct sk_buff *skb,
@@ -301,6 +731,7 @@ ipt_do_table(struct sk_buff *skb,
 	struct ipt_entry *e, **jumpstack;
 	unsigned int *stackptr, origptr, cpu;
 	const struct xt_table_info *private;
+	const struct ipt_index *index;
 	struct xt_action_param acpar;
 	unsigned int addend;
 
@@ -331,6 +762,7 @@ ipt_do_table(struct sk_buff *skb,
 	jumpstack  = (struct ipt_entry **)private->jumpstack[cpu];
 	stackptr   = per_cpu_ptr(private->stackptr, cpu);
 	origptr    = *stackptr;
+	index      = private->index;
 
 	e = get_entry(table_base, private->hook_entry[hook]);
 
@@ -343,6 +775,9 @@ ipt_do_table(struct sk_buff *skb,
 		const struct xt_entry_match *ematch;
 
 		IP_NF_ASSERT(e);
+		if (index != NULL)
+			e = ipt_index_skip(index, skb, ip, &acpar,
+					   table_base, e);
 		if (!ip_packet_match(ip, indev, outdev,
 		    &e->ip, acpar.fragoff)) {
  no_match:
@@ -869,6 +1304,7 @@ translate_table(struct net *net, struct xt_table_info *newinfo, void *entry0,
 			memcpy(newinfo->entries[i], entry0, newinfo->size);
 	}
 
+	ipt_index_build(newinfo, entry0);
 	return ret;
 }
 
@@ -1225,7 +1661,7 @@ __do_replace(struct net *net, const char *name, unsigned int valid_hooks,
 	xt_entry_foreach(iter, loc_cpu_old_entry, oldinfo->size)
 		cleanup_entry(iter, net);
 
-	xt_free_table_info(oldinfo);
+	ipt_free_table_info(oldinfo);
 	if (copy_to_user(counters_ptr, counters,
 			 sizeof(struct xt_counters) * num_counters) != 0)
 		ret = -EFAULT;
@@ -1287,7 +1723,7 @@ do_replace(struct net *net, const void __user *user, unsigned int len)
 	xt_entry_foreach(iter, loc_cpu_entry, newinfo->size)
 		cleanup_entry(iter, net);
  free_newinfo:
-	xt_free_table_info(newinfo);
+	ipt_free_table_info(newinfo);
 	return ret;
 }
 
@@ -1758,7 +2194,7 @@ translate_compat_table(struct net *net,
 				break;
 			cleanup_entry(iter1, net);
 		}
-		xt_free_table_info(newinfo);
+		ipt_free_table_info(newinfo);
 		return ret;
 	}
 
@@ -1767,13 +2203,15 @@ translate_compat_table(struct net *net,
 		if (newinfo->entries[i] && newinfo->entries[i] != entry1)
 			memcpy(newinfo->entries[i], entry1, newinfo->size);
 
+	ipt_index_build(newinfo, entry1);
+
 	*pinfo = newinfo;
 	*pentry0 = entry1;
-	xt_free_table_info(info);
+	ipt_free_table_info(info);
 	return 0;
 
 free_newinfo:
-	xt_free_table_info(newinfo);
+	ipt_free_table_info(newinfo);
 out:
 	xt_entry_foreach(iter0, entry0, total_size) {
 		if (j-- == 0)
@@ -1837,7 +2275,7 @@ compat_do_replace(struct net *net, void __user *user, unsigned int len)
 	xt_entry_foreach(iter, loc_cpu_entry, newinfo->size)
 		cleanup_entry(iter, net);
  free_newinfo:
-	xt_free_table_info(newinfo);
+	ipt_free_table_info(newinfo);
 	return ret;
 }
 
@@ -2089,7 +2527,7 @@ struct xt_table *ipt_register_table(struct net *net,
 	return new_table;
 
 out_free:
-	xt_free_table_info(newinfo);
+	ipt_free_table_info(newinfo);
 out:
 	return ERR_PTR(ret);
 }
@@ -2109,7 +2547,7 @@ void ipt_unregister_table(struct net *net, struct xt_table *table)
 		cleanup_entry(iter, net);
 	if (private->number > private->initial_entries)
 		module_put(table_owner);
-	xt_free_table_info(private);
+	ipt_free_table_info(private);
 }
 
 /* Returns 1 if the type and code is matched by the range, 0 otherwise */
@@ -2242,9 +2680,21 @@ static int __init ip_tables_init(void)
 	if (ret < 0)
 		goto err5;
 
+#ifdef CONFIG_PROC_FS
+	if (!proc_create("ip_tables_index", S_IRUGO, init_net.proc_net_stat,
+			 &ipt_index_stat_fops)) {
+		ret = -ENOMEM;
+		goto err6;
+	}
+#endif
+
 	pr_info("(C) 2000-2006 Netfilter Core Team\n");
 	return 0;
 
+#ifdef CONFIG_PROC_FS
+err6:
+	nf_unregister_sockopt(&ipt_sockopts);
+#endif
 err5:
 	xt_unregister_matches(ipt_builtin_mt, ARRAY_SIZE(ipt_builtin_mt));
 err4:
@@ -2257,6 +2707,9 @@ err1:
 
 static void __exit ip_tables_fini(void)
 {
+#ifdef CONFIG_PROC_FS
+	remove_proc_entry("ip_tables_index", init_net.proc_net_stat);
+#endif
 	nf_unregister_sockopt(&ipt_sockopts);
 
 	xt_unregister_matches(ipt_builtin_mt, ARRAY_SIZE(ipt_builtin_mt));
@@ -266,6 +266,11 @@ void nf_conntrack_destroy(struct nf_conntrack *nfct)
 EXPORT_SYMBOL(nf_conntrack_destroy);
 #endif /* CONFIG_NF_CONNTRACK */
 
+#if IS_ENABLED(CONFIG_NF_FLOW_OFFLOAD)
+int (*nf_flow_offload_hook)(struct sk_buff *skb) __rcu __read_mostly;
+EXPORT_SYMBOL_GPL(nf_flow_offload_hook);
+#endif
+
 #ifdef CONFIG_PROC_FS
 struct proc_dir_entry *proc_net_netfilter;
 EXPORT_SYMBOL(proc_net_netfilter);
@@ -0,0 +1,527 @@
+/*
+ * Software flow offload: a fast path for forwarded IPv4 TCP and UDP
+ * connections which conntrack has seen established.
+ *
+ * Once a connection is promoted (see xt_FLOWOFFLOAD), packets of either
+ * direction are picked up in __netif_receive_skb(), get their NAT
+ * mangling and TTL decrement applied from the cached flow entry and are
+ * handed straight to the neighbour layer of the output route.  They do
+ * not traverse the netfilter hooks, so neither ip_tables nor conntrack
+ * sees them; conntrack only learns that the connection is still alive
+ * through the timeout that the garbage collector keeps pushing out.
+ *
+ * Packets the fast path cannot handle (fragments, IP options, TTL
+ * expiry, too big for the route MTU, TCP FIN/RST) take the normal
+ * path.  A flow is torn down after FLOW_OFFLOAD_TIMEOUT of inactivity,
+ * on FIN or RST, when its conntrack entry dies, when one of its routes
+ * becomes obsolete or when one of its devices goes down.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/netdevice.h>
+#include <linux/netfilter.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <net/ip.h>
+#include <net/route.h>
+#include <net/neighbour.h>
+#include <net/checksum.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_acct.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_conntrack_zones.h>
+#include <net/netfilter/nf_flow_offload.h>
+
+#define FLOW_OFFLOAD_HSIZE	4096
+
+static unsigned int max_flows __read_mostly = 65536;
+module_param(max_flows, uint, 0644);
+MODULE_PARM_DESC(max_flows, "Maximum number of offloaded flows");
+
+static struct hlist_head flow_offload_table[FLOW_OFFLOAD_HSIZE];
+static DEFINE_SPINLOCK(flow_offload_lock);
+static atomic_t flow_offload_count = ATOMIC_INIT(0);
+static u32 flow_offload_hash_rnd __read_mostly;
+static struct delayed_work flow_offload_gc_work;
+
+static u32 flow_offload_hash(__be32 saddr, __be32 daddr, __be16 sport,
+			     __be16 dport, u8 l4proto,
+			     const struct net_device *iif)
+{
+	return jhash_3words((__force u32)saddr, (__force u32)daddr,
+			    ((__force u32)sport << 16 | (__force u32)dport) ^
+			    l4proto ^ (u32)(unsigned long)iif,
+			    flow_offload_hash_rnd) & (FLOW_OFFLOAD_HSIZE - 1);
+}
+
+static u32 flow_offload_tuple_hash(const struct flow_offload_tuple *t)
+{
+	return flow_offload_hash(t->src_v4, t->dst_v4, t->src_port,
+				 t->dst_port, t->l4proto, t->iif);
+}
+
+static inline struct flow_offload *
+flow_offload_of(struct flow_offload_tuple_hash *th)
+{
+	return container_of(th, struct flow_offload,
+			    tuplehash[th->tuple.dir]);
+}
+
+static bool flow_offload_tuple_equal(const struct flow_offload_tuple *a,
+				     const struct flow_offload_tuple *b)
+{
+	return a->src_v4 == b->src_v4 && a->dst_v4 == b->dst_v4 &&
+	       a->src_port == b->src_port && a->dst_port == b->dst_port &&
+	       a->l4proto == b->l4proto && a->iif == b->iif;
+}
+
+/* Caller holds rcu_read_lock() or flow_offload_lock */
+static struct flow_offload_tuple_hash *
+flow_offload_lookup(const struct flow_offload_tuple *key)
+{
+	struct flow_offload_tuple_hash *th;
+	struct hlist_node *n;
+	u32 hash = flow_offload_tuple_hash(key);
+
+	hlist_for_each_entry_rcu(th, n, &flow_offload_table[hash], node) {
+		if (flow_offload_tuple_equal(&th->tuple, key))
+			return th;
+	}
+	return NULL;
+}
+
+static void flow_offload_fill_dir(struct flow_offload *flow,
+				  struct nf_conn *ct,
+				  enum ip_conntrack_dir dir,
+				  const struct net_device *iif,
+				  struct dst_entry *dst)
+{
+	struct flow_offload_tuple *ft = &flow->tuplehash[dir].tuple;
+	const struct nf_conntrack_tuple *t = &ct->tuplehash[dir].tuple;
+	const struct nf_conntrack_tuple *rt = &ct->tuplehash[!dir].tuple;
+
+	ft->dir		= dir;
+	ft->l4proto	= t->dst.protonum;
+	ft->src_v4	= t->src.u3.ip;
+	ft->dst_v4	= t->dst.u3.ip;
+	ft->src_port	= t->src.u.all;
+	ft->dst_port	= t->dst.u.all;
+
+	/* The packet leaves as the inverse of the other direction's tuple */
+	ft->nat_src_v4	 = rt->dst.u3.ip;
+	ft->nat_dst_v4	 = rt->src.u3.ip;
+	ft->nat_src_port = rt->dst.u.all;
+	ft->nat_dst_port = rt->src.u.all;
+
+	ft->iif		= iif;
+	ft->dst		= dst;
+	ft->mtu		= dst_mtu(dst);
+}
+
+static void flow_offload_free_rcu(struct rcu_head *head)
+{
+	struct flow_offload *flow = container_of(head, struct flow_offload,
+						 rcu_head);
+
+	dst_release(flow->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst);
+	dst_release(flow->tuplehash[IP_CT_DIR_REPLY].tuple.dst);
+	nf_ct_put(flow->ct);
+	kfree(flow);
+	atomic_dec(&flow_offload_count);
+}
+
+/* Caller holds flow_offload_lock */
+static void flow_offload_del(struct flow_offload *flow)
+{
+	hlist_del_rcu(&flow->tuplehash[IP_CT_DIR_ORIGINAL].node);
+	hlist_del_rcu(&flow->tuplehash[IP_CT_DIR_REPLY].node);
+	clear_bit(IPS_OFFLOAD_BIT, &flow->ct->status);
+	call_rcu(&flow->rcu_head, flow_offload_free_rcu);
+}
+
+static inline void flow_offload_teardown(struct flow_offload *flow)
+{
+	set_bit(FLOW_OFFLOAD_TEARDOWN, &flow->flags);
+}
+
+/**
+ * flow_offload_add - move an established connection to the fast path
+ * @ct: conntrack entry of the connection
+ * @ctinfo: conntrack state of @skb
+ * @skb: packet being forwarded, its route is used for its direction
+ * @in: device @skb was received on
+ * @out: device @skb is being forwarded to
+ *
+ * Must be called after routing, i.e. from the FORWARD hook, so that the
+ * output route and any NAT bindings of the connection are known.  The
+ * route for the other direction is looked up here.
+ */
+int flow_offload_add(struct nf_conn *ct, enum ip_conntrack_info ctinfo,
+		     const struct sk_buff *skb,
+		     const struct net_device *in,
+		     const struct net_device *out)
+{
+	enum ip_conntrack_dir dir = CTINFO2DIR(ctinfo);
+	struct net *net = dev_net(in);
+	struct nf_conn_help *help;
+	struct flow_offload *flow;
+	struct rtable *other;
+	int err;
+
+	if (nf_ct_l3num(ct) != NFPROTO_IPV4 || nf_ct_zone(ct))
+		return -EOPNOTSUPP;
+
+	switch (nf_ct_protonum(ct)) {
+	case IPPROTO_TCP:
+		if (ct->proto.tcp.state != TCP_CONNTRACK_ESTABLISHED)
+			return -EAGAIN;
+		break;
+	case IPPROTO_UDP:
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	/* Helpers and sequence adjustment need to see every packet */
+	help = nfct_help(ct);
+	if ((help && rcu_access_pointer(help->helper)) ||
+	    test_bit(IPS_SEQ_ADJUST_BIT, &ct->status) ||
+	    test_bit(IPS_FIXED_TIMEOUT_BIT, &ct->status))
+		return -EOPNOTSUPP;
+
+	if (!test_bit(IPS_SEEN_REPLY_BIT, &ct->status) ||
+	    !nf_ct_is_confirmed(ct) || nf_ct_is_dying(ct))
+		return -EAGAIN;
+
+	if (!skb_dst(skb) || skb_dst(skb)->dev != out)
+		return -EINVAL;
+
+	if (atomic_read(&flow_offload_count) >= max_flows)
+		return -ENOSPC;
+
+	/* Route back to where this packet came from, before NAT */
+	other = ip_route_output(net, ct->tuplehash[dir].tuple.src.u3.ip, 0,
+				RT_TOS(ip_hdr(skb)->tos), 0);
+	if (IS_ERR(other))
+		return PTR_ERR(other);
+	if (other->dst.dev != in || other->rt_type != RTN_UNICAST) {
+		/* asymmetric routing, let the slow path deal with it */
+		ip_rt_put(other);
+		return -EINVAL;
+	}
+
+	if (test_and_set_bit(IPS_OFFLOAD_BIT, &ct->status)) {
+		ip_rt_put(other);
+		return -EEXIST;
+	}
+
+	flow = kzalloc(sizeof(*flow), GFP_ATOMIC);
+	if (!flow) {
+		err = -ENOMEM;
+		goto err_flow;
+	}
+
+	atomic_inc(&ct->ct_general.use);
+	flow->ct = ct;
+	flow_offload_fill_dir(flow, ct, dir, in, dst_clone(skb_dst(skb)));
+	flow_offload_fill_dir(flow, ct, !dir, out, &other->dst);
+
+	/* Keep conntrack around for as long as it would have lived had it
+	 * kept seeing the packets.
+	 */
+	flow->ct_timeout = ct->timeout.expires - jiffies;
+	flow->timeout = jiffies + FLOW_OFFLOAD_TIMEOUT;
+
+	/* Conntrack misses the packets in between; don't let it drop the
+	 * ones it sees again because of an outdated window.
+	 */
+	if (nf_ct_protonum(ct) == IPPROTO_TCP) {
+		spin_lock_bh(&ct->lock);
+		ct->proto.tcp.seen[0].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+		ct->proto.tcp.seen[1].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+		spin_unlock_bh(&ct->lock);
+	}
+
+	spin_lock_bh(&flow_offload_lock);
+	if (flow_offload_lookup(&flow->tuplehash[IP_CT_DIR_ORIGINAL].tuple) ||
+	    flow_offload_lookup(&flow->tuplehash[IP_CT_DIR_REPLY].tuple)) {
+		spin_unlock_bh(&flow_offload_lock);
+		err = -EEXIST;
+		goto err_exists;
+	}
+	atomic_inc(&flow_offload_count);
+	hlist_add_head_rcu(&flow->tuplehash[IP_CT_DIR_ORIGINAL].node,
+		&flow_offload_table[flow_offload_tuple_hash(
+			&flow->tuplehash[IP_CT_DIR_ORIGINAL].tuple)]);
+	hlist_add_head_rcu(&flow->tuplehash[IP_CT_DIR_REPLY].node,
+		&flow_offload_table[flow_offload_tuple_hash(
+			&flow->tuplehash[IP_CT_DIR_REPLY].tuple)]);
+	spin_unlock_bh(&flow_offload_lock);
+	return 0;
+
+err_exists:
+	dst_release(flow->tuplehash[dir].tuple.dst);
+	kfree(flow);
+	nf_ct_put(ct);
+err_flow:
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+	ip_rt_put(other);
+	return err;
+}
+EXPORT_SYMBOL_GPL(flow_offload_add);
+
+static void flow_offload_nat_port(struct sk_buff *skb, __sum16 *check,
+				  __be16 *port, __be16 new)
+{
+	if (*port == new)
+		return;
+	if (check)
+		inet_proto_csum_replace2(check, skb, *port, new, 0);
+	*port = new;
+}
+
+static void flow_offload_nat_addr(struct sk_buff *skb, struct iphdr *iph,
+				  __sum16 *check, __be32 *addr, __be32 new)
+{
+	if (*addr == new)
+		return;
+	csum_replace4(&iph->check, *addr, new);
+	if (check)
+		inet_proto_csum_replace4(check, skb, *addr, new, 1);
+	*addr = new;
+}
+
+/* Returns true if the packet was consumed */
+static int flow_offload_ip_rx(struct sk_buff *skb)
+{
+	struct flow_offload_tuple_hash *th;
+	const struct flow_offload_tuple *t;
+	struct flow_offload_tuple key;
+	struct nf_conn_counter *acct;
+	struct flow_offload *flow;
+	struct dst_entry *dst;
+	struct neighbour *neigh;
+	struct net_device *outdev;
+	struct iphdr *iph;
+	__be16 *ports;
+	__sum16 *check;
+	unsigned int thoff, hdrsize;
+	u32 len;
+
+	if (skb->pkt_type != PACKET_HOST || skb_shared(skb))
+		return 0;
+
+	if (!pskb_may_pull(skb, sizeof(*iph)))
+		return 0;
+	iph = ip_hdr(skb);
+	if (iph->ihl != 5 || iph->version != 4 || ip_is_fragment(iph) ||
+	    iph->ttl <= 1 || ip_fast_csum((u8 *)iph, iph->ihl))
+		return 0;
+
+	len = ntohs(iph->tot_len);
+	if (skb->len < len || len < sizeof(*iph))
+		return 0;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		hdrsize = sizeof(struct tcphdr);
+		break;
+	case IPPROTO_UDP:
+		hdrsize = sizeof(struct udphdr);
+		break;
+	default:
+		return 0;
+	}
+	thoff = sizeof(*iph);
+	if (!pskb_may_pull(skb, thoff + hdrsize))
+		return 0;
+	iph = ip_hdr(skb);
+	ports = (__be16 *)(skb->data + thoff);
+
+	key.src_v4	= iph->saddr;
+	key.dst_v4	= iph->daddr;
+	key.src_port	= ports[0];
+	key.dst_port	= ports[1];
+	key.l4proto	= iph->protocol;
+	key.iif		= skb->dev;
+
+	th = flow_offload_lookup(&key);
+	if (!th)
+		return 0;
+	flow = flow_offload_of(th);
+	t = &th->tuple;
+
+	if (unlikely(test_bit(FLOW_OFFLOAD_TEARDOWN, &flow->flags)))
+		return 0;
+
+	if (iph->protocol == IPPROTO_TCP) {
+		struct tcphdr *tcph = (struct tcphdr *)ports;
+
+		/* let conntrack see the connection closing */
+		if (unlikely(tcph->fin || tcph->rst)) {
+			flow_offload_teardown(flow);
+			return 0;
+		}
+	}
+
+	if (len > t->mtu && !skb_is_gso(skb))
+		return 0;
+
+	dst = t->dst;
+	neigh = dst_get_neighbour_noref(dst);
+	if (unlikely(!neigh))
+		return 0;
+	outdev = dst->dev;
+
+	if (pskb_trim_rcsum(skb, len) ||
+	    !skb_make_writable(skb, thoff + hdrsize) ||
+	    skb_cow_head(skb, LL_RESERVED_SPACE(outdev)))
+		return 0;
+	iph = ip_hdr(skb);
+	ports = (__be16 *)(skb->data + thoff);
+
+	if (iph->protocol == IPPROTO_TCP) {
+		check = &((struct tcphdr *)ports)->check;
+	} else {
+		check = &((struct udphdr *)ports)->check;
+		if (!*check && skb->ip_summed != CHECKSUM_PARTIAL)
+			check = NULL;
+	}
+
+	flow_offload_nat_addr(skb, iph, check, &iph->saddr, t->nat_src_v4);
+	flow_offload_nat_addr(skb, iph, check, &iph->daddr, t->nat_dst_v4);
+	flow_offload_nat_port(skb, check, &ports[0], t->nat_src_port);
+	flow_offload_nat_port(skb, check, &ports[1], t->nat_dst_port);
+	if (check && iph->protocol == IPPROTO_UDP && !*check)
+		*check = CSUM_MANGLED_0;
+
+	ip_decrease_ttl(iph);
+
+	flow->timeout = jiffies + FLOW_OFFLOAD_TIMEOUT;
+	acct = nf_conn_acct_find(flow->ct);
+	if (acct) {
+		atomic64_inc(&acct[t->dir].packets);
+		atomic64_add(len, &acct[t->dir].bytes);
+	}
+
+	IP_INC_STATS_BH(dev_net(outdev), IPSTATS_MIB_OUTFORWDATAGRAMS);
+
+	skb->priority = rt_tos2priority(iph->tos);
+	skb->dev = outdev;
+	skb_dst_drop(skb);
+	skb_dst_set_noref(skb, dst);
+	neigh_output(neigh, skb);
+	return 1;
+}
+
+/* Sync conntrack timeouts and reap dead flows.  With @dev set, only
+ * flows using that device are removed, regardless of their state.
+ */
+static void flow_offload_gc(const struct net_device *dev, bool all)
+{
+	struct flow_offload_tuple_hash *th;
+	struct flow_offload *flow;
+	struct hlist_node *n, *next;
+	unsigned long expires;
+	unsigned int i;
+
+	spin_lock_bh(&flow_offload_lock);
+	for (i = 0; i < FLOW_OFFLOAD_HSIZE; i++) {
+		hlist_for_each_entry_safe(th, n, next, &flow_offload_table[i],
+					  node) {
+			const struct flow_offload_tuple *o, *r;
+
+			if (th->tuple.dir != IP_CT_DIR_ORIGINAL)
+				continue;
+			flow = flow_offload_of(th);
+			o = &flow->tuplehash[IP_CT_DIR_ORIGINAL].tuple;
+			r = &flow->tuplehash[IP_CT_DIR_REPLY].tuple;
+
+			if (all ||
+			    (dev && (o->iif == dev || r->iif == dev)) ||
+			    test_bit(FLOW_OFFLOAD_TEARDOWN, &flow->flags) ||
+			    time_after(jiffies, flow->timeout) ||
+			    nf_ct_is_dying(flow->ct) ||
+			    (o->dst->obsolete && !dst_check(o->dst, 0)) ||
+			    (r->dst->obsolete && !dst_check(r->dst, 0))) {
+				/* next may be our other direction */
+				if (next == &flow->tuplehash[IP_CT_DIR_REPLY].node)
+					next = next->next;
+				flow_offload_del(flow);
+				continue;
+			}
+
+			expires = flow->timeout - FLOW_OFFLOAD_TIMEOUT +
+				  flow->ct_timeout;
+			if (time_after(expires, flow->ct->timeout.expires))
+				mod_timer_pending(&flow->ct->timeout, expires);
+		}
+	}
+	spin_unlock_bh(&flow_offload_lock);
+}
+
+static void flow_offload_gc_worker(struct work_struct *work)
+{
+	flow_offload_gc(NULL, false);
+	schedule_delayed_work(&flow_offload_gc_work, HZ);
+}
+
+static int flow_offload_netdev_event(struct notifier_block *this,
+				     unsigned long event, void *ptr)
+{
+	struct net_device *dev = ptr;
+
+	if (event == NETDEV_DOWN || event == NETDEV_UNREGISTER)
+		flow_offload_gc(dev, false);
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block flow_offload_netdev_notifier = {
+	.notifier_call	= flow_offload_netdev_event,
+};
+
+static int __init flow_offload_init(void)
+{
+	int err;
+
+	get_random_bytes(&flow_offload_hash_rnd, sizeof(flow_offload_hash_rnd));
+
+	err = register_netdevice_notifier(&flow_offload_netdev_notifier);
+	if (err < 0)
+		return err;
+
+	INIT_DELAYED_WORK_DEFERRABLE(&flow_offload_gc_work,
+				     flow_offload_gc_worker);
+	schedule_delayed_work(&flow_offload_gc_work, HZ);
+
+	RCU_INIT_POINTER(nf_flow_offload_hook, flow_offload_ip_rx);
+	return 0;
+}
+
+static void __exit flow_offload_exit(void)
+{
+	RCU_INIT_POINTER(nf_flow_offload_hook, NULL);
+	synchronize_net();
+
+	cancel_delayed_work_sync(&flow_offload_gc_work);
+	unregister_netdevice_notifier(&flow_offload_netdev_notifier);
+	flow_offload_gc(NULL, true);
+	rcu_barrier();
+}
+
+module_init(flow_offload_init);
+module_exit(flow_offload_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Software fast path for established forwarded flows");
@@ -0,0 +1,55 @@
+/* This is a module which is used for moving established connections to
+ * the flow offload fast path, so that their remaining packets no longer
+ * traverse the netfilter hooks.
+ */
+#include <linux/module.h>
+#include <linux/skbuff.h>
+
+#include <linux/netfilter/x_tables.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_flow_offload.h>
+
+MODULE_DESCRIPTION("Xtables: Offloading established flows to the fast path");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("ipt_FLOWOFFLOAD");
+
+static unsigned int
+flowoffload_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+	enum ip_conntrack_info ctinfo;
+	struct nf_conn *ct;
+
+	ct = nf_ct_get(skb, &ctinfo);
+	if (ct == NULL || nf_ct_is_untracked(ct) ||
+	    test_bit(IPS_OFFLOAD_BIT, &ct->status))
+		return XT_CONTINUE;
+
+	/* Connections that can't be offloaded yet are retried with their
+	 * next packet; the rest of the ruleset applies in the meantime. */
+	flow_offload_add(ct, ctinfo, skb, par->in, par->out);
+
+	return XT_CONTINUE;
+}
+
+static struct xt_target flowoffload_tg_reg __read_mostly = {
+	.name     = "FLOWOFFLOAD",
+	.revision = 0,
+	.family   = NFPROTO_IPV4,
+	.target   = flowoffload_tg,
+	.table    = "filter",
+	.hooks    = 1 << NF_INET_FORWARD,
+	.me       = THIS_MODULE,
+};
+
+static int __init flowoffload_tg_init(void)
+{
+	return xt_register_target(&flowoffload_tg_reg);
+}
+
+static void __exit flowoffload_tg_exit(void)
+{
+	xt_unregister_target(&flowoffload_tg_reg);
+}
+
+module_init(flowoffload_tg_init);
+module_exit(flowoffload_tg_exit);
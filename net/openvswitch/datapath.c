@@ -176,6 +176,7 @@ void ovs_dp_process_received_packet(struct vport *p, struct sk_buff *skb)
 	struct dp_stats_percpu *stats;
 	struct sw_flow_key key;
 	u64 *stats_counter;
+	u32 n_mask_hit;
 	int error;
 	int key_len;
 
@@ -189,7 +190,8 @@ void ovs_dp_process_received_packet(struct vport *p, struct sk_buff *skb)
 	}
 
 	/* Look up flow. */
-	flow = ovs_flow_tbl_lookup(rcu_dereference(dp->table), &key, key_len);
+	flow = ovs_flow_tbl_lookup(rcu_dereference(dp->table), &key,
+				   &n_mask_hit);
 	if (unlikely(!flow)) {
 		struct dp_upcall_info upcall;
 
@@ -213,6 +215,7 @@ out:
 	/* Update datapath statistics. */
 	u64_stats_update_begin(&stats->sync);
 	(*stats_counter)++;
+	stats->n_mask_hit += n_mask_hit;
 	u64_stats_update_end(&stats->sync);
 }
 
@@ -351,7 +354,7 @@ static int queue_userspace_packet(int dp_ifindex, struct sk_buff *skb,
 	upcall->dp_ifindex = dp_ifindex;
 
 	nla = nla_nest_start(user_skb, OVS_PACKET_ATTR_KEY);
-	ovs_flow_to_nlattrs(upcall_info->key, user_skb);
+	ovs_flow_to_nlattrs(upcall_info->key, upcall_info->key, user_skb);
 	nla_nest_end(user_skb, nla);
 
 	if (upcall_info->userdata)
@@ -697,12 +700,16 @@ static struct genl_ops dp_packet_genl_ops[] = {
 	}
 };
 
-static void get_dp_stats(struct datapath *dp, struct ovs_dp_stats *stats)
+static void get_dp_stats(struct datapath *dp, struct ovs_dp_stats *stats,
+			 struct ovs_dp_megaflow_stats *mega_stats)
 {
 	int i;
 	struct flow_table *table = genl_dereference(dp->table);
 
+	memset(mega_stats, 0, sizeof(*mega_stats));
+
 	stats->n_flows = ovs_flow_tbl_count(table);
+	mega_stats->n_masks = ovs_flow_tbl_mask_count(table);
 
 	stats->n_hit = stats->n_missed = stats->n_lost = 0;
 	for_each_possible_cpu(i) {
@@ -720,6 +727,7 @@ static void get_dp_stats(struct datapath *dp, struct ovs_dp_stats *stats)
 		stats->n_hit += local_stats.n_hit;
 		stats->n_missed += local_stats.n_missed;
 		stats->n_lost += local_stats.n_lost;
+		mega_stats->n_mask_hit += local_stats.n_mask_hit;
 	}
 }
 
@@ -727,6 +735,7 @@ static const struct nla_policy flow_policy[OVS_FLOW_ATTR_MAX + 1] = {
 	[OVS_FLOW_ATTR_KEY] = { .type = NLA_NESTED },
 	[OVS_FLOW_ATTR_ACTIONS] = { .type = NLA_NESTED },
 	[OVS_FLOW_ATTR_CLEAR] = { .type = NLA_FLAG },
+	[OVS_FLOW_ATTR_MASK] = { .type = NLA_NESTED },
 };
 
 static struct genl_family dp_flow_genl_family = {
@@ -767,7 +776,15 @@ static int ovs_flow_cmd_fill_info(struct sw_flow *flow, struct datapath *dp,
 	nla = nla_nest_start(skb, OVS_FLOW_ATTR_KEY);
 	if (!nla)
 		goto nla_put_failure;
-	err = ovs_flow_to_nlattrs(&flow->key, skb);
+	err = ovs_flow_to_nlattrs(&flow->key, &flow->key, skb);
+	if (err)
+		goto error;
+	nla_nest_end(skb, nla);
+
+	nla = nla_nest_start(skb, OVS_FLOW_ATTR_MASK);
+	if (!nla)
+		goto nla_put_failure;
+	err = ovs_flow_to_nlattrs(&flow->key, &flow->mask->key, skb);
 	if (err)
 		goto error;
 	nla_nest_end(skb, nla);
@@ -823,6 +840,8 @@ static struct sk_buff *ovs_flow_cmd_alloc_info(struct sw_flow *flow)
 
 	/* OVS_FLOW_ATTR_KEY */
 	len = nla_total_size(FLOW_BUFSIZE);
+	/* OVS_FLOW_ATTR_MASK */
+	len += nla_total_size(FLOW_BUFSIZE);
 	/* OVS_FLOW_ATTR_ACTIONS */
 	len += nla_total_size(sf_acts->actions_len);
 	/* OVS_FLOW_ATTR_STATS */
@@ -862,6 +881,8 @@ static int ovs_flow_cmd_new_or_set(struct sk_buff *skb, struct genl_info *info)
 	struct sk_buff *reply;
 	struct datapath *dp;
 	struct flow_table *table;
+	struct sw_flow_mask mask;
+	struct sw_flow_key masked_key;
 	int error;
 	int key_len;
 
@@ -872,10 +893,17 @@ static int ovs_flow_cmd_new_or_set(struct sk_buff *skb, struct genl_info *info)
 	error = ovs_flow_from_nlattrs(&key, &key_len, a[OVS_FLOW_ATTR_KEY]);
 	if (error)
 		goto error;
+	error = ovs_flow_mask_from_nlattrs(&mask, &key, key_len,
+					   a[OVS_FLOW_ATTR_MASK]);
+	if (error)
+		goto error;
+	memset(&masked_key, 0, sizeof(masked_key));
+	ovs_flow_key_mask(&masked_key, &key, &mask);
 
 	/* Validate actions. */
 	if (a[OVS_FLOW_ATTR_ACTIONS]) {
-		error = validate_actions(a[OVS_FLOW_ATTR_ACTIONS], &key,  0);
+		error = validate_actions(a[OVS_FLOW_ATTR_ACTIONS],
+					 &masked_key, 0);
 		if (error)
 			goto error;
 	} else if (info->genlhdr->cmd == OVS_FLOW_CMD_NEW) {
@@ -889,7 +917,7 @@ static int ovs_flow_cmd_new_or_set(struct sk_buff *skb, struct genl_info *info)
 		goto error;
 
 	table = genl_dereference(dp->table);
-	flow = ovs_flow_tbl_lookup(table, &key, key_len);
+	flow = ovs_flow_tbl_lookup_exact(table, &masked_key, &mask);
 	if (!flow) {
 		struct sw_flow_actions *acts;
 
@@ -916,7 +944,7 @@ static int ovs_flow_cmd_new_or_set(struct sk_buff *skb, struct genl_info *info)
 			error = PTR_ERR(flow);
 			goto error;
 		}
-		flow->key = key;
+		flow->key = masked_key;
 		clear_stats(flow);
 
 		/* Obtain actions. */
@@ -927,8 +955,9 @@ static int ovs_flow_cmd_new_or_set(struct sk_buff *skb, struct genl_info *info)
 		rcu_assign_pointer(flow->sf_acts, acts);
 
 		/* Put flow in bucket. */
-		flow->hash = ovs_flow_hash(&key, key_len);
-		ovs_flow_tbl_insert(table, flow);
+		error = ovs_flow_tbl_insert(table, flow, &mask);
+		if (error)
+			goto error_free_flow;
 
 		reply = ovs_flow_cmd_build_info(flow, dp, info->snd_pid,
 						info->snd_seq,
@@ -1003,6 +1032,7 @@ static int ovs_flow_cmd_get(struct sk_buff *skb, struct genl_info *info)
 	struct sw_flow *flow;
 	struct datapath *dp;
 	struct flow_table *table;
+	struct sw_flow_mask mask;
 	int err;
 	int key_len;
 
@@ -1011,13 +1041,17 @@ static int ovs_flow_cmd_get(struct sk_buff *skb, struct genl_info *info)
 	err = ovs_flow_from_nlattrs(&key, &key_len, a[OVS_FLOW_ATTR_KEY]);
 	if (err)
 		return err;
+	err = ovs_flow_mask_from_nlattrs(&mask, &key, key_len,
+					 a[OVS_FLOW_ATTR_MASK]);
+	if (err)
+		return err;
 
 	dp = get_dp(ovs_header->dp_ifindex);
 	if (!dp)
 		return -ENODEV;
 
 	table = genl_dereference(dp->table);
-	flow = ovs_flow_tbl_lookup(table, &key, key_len);
+	flow = ovs_flow_tbl_lookup_exact(table, &key, &mask);
 	if (!flow)
 		return -ENOENT;
 
@@ -1038,6 +1072,7 @@ static int ovs_flow_cmd_del(struct sk_buff *skb, struct genl_info *info)
 	struct sw_flow *flow;
 	struct datapath *dp;
 	struct flow_table *table;
+	struct sw_flow_mask mask;
 	int err;
 	int key_len;
 
@@ -1046,13 +1081,17 @@ static int ovs_flow_cmd_del(struct sk_buff *skb, struct genl_info *info)
 	err = ovs_flow_from_nlattrs(&key, &key_len, a[OVS_FLOW_ATTR_KEY]);
 	if (err)
 		return err;
+	err = ovs_flow_mask_from_nlattrs(&mask, &key, key_len,
+					 a[OVS_FLOW_ATTR_MASK]);
+	if (err)
+		return err;
 
 	dp = get_dp(ovs_header->dp_ifindex);
 	if (!dp)
 		return -ENODEV;
 
 	table = genl_dereference(dp->table);
-	flow = ovs_flow_tbl_lookup(table, &key, key_len);
+	flow = ovs_flow_tbl_lookup_exact(table, &key, &mask);
 	if (!flow)
 		return -ENOENT;
 
@@ -1153,6 +1192,7 @@ static int ovs_dp_cmd_fill_info(struct datapath *dp, struct sk_buff *skb,
 {
 	struct ovs_header *ovs_header;
 	struct ovs_dp_stats dp_stats;
+	struct ovs_dp_megaflow_stats dp_megaflow_stats;
 	int err;
 
 	ovs_header = genlmsg_put(skb, pid, seq, &dp_datapath_genl_family,
@@ -1168,8 +1208,10 @@ static int ovs_dp_cmd_fill_info(struct datapath *dp, struct sk_buff *skb,
 	if (err)
 		goto nla_put_failure;
 
-	get_dp_stats(dp, &dp_stats);
+	get_dp_stats(dp, &dp_stats, &dp_megaflow_stats);
 	NLA_PUT(skb, OVS_DP_ATTR_STATS, sizeof(struct ovs_dp_stats), &dp_stats);
+	NLA_PUT(skb, OVS_DP_ATTR_MEGAFLOW_STATS,
+		sizeof(struct ovs_dp_megaflow_stats), &dp_megaflow_stats);
 
 	return genlmsg_end(skb, ovs_header);
 
@@ -226,6 +226,7 @@ struct sw_flow *ovs_flow_alloc(void)
 
 	spin_lock_init(&flow->lock);
 	flow->sf_acts = NULL;
+	flow->mask = NULL;
 
 	return flow;
 }
@@ -278,6 +279,14 @@ struct flow_table *ovs_flow_tbl_alloc(int new_size)
 		kfree(table);
 		return NULL;
 	}
+
+	table->mask_list = kmalloc(sizeof(struct list_head), GFP_KERNEL);
+	if (!table->mask_list) {
+		free_buckets(table->buckets);
+		kfree(table);
+		return NULL;
+	}
+	INIT_LIST_HEAD(table->mask_list);
 	table->n_buckets = new_size;
 	table->count = 0;
 	table->node_ver = 0;
@@ -309,6 +318,9 @@ void ovs_flow_tbl_destroy(struct flow_table *table)
 		}
 	}
 
+	WARN_ON(!list_empty(table->mask_list));
+	kfree(table->mask_list);
+
 skip_flows:
 	free_buckets(table->buckets);
 	kfree(table);
@@ -356,6 +368,15 @@ struct sw_flow *ovs_flow_tbl_next(struct flow_table *table, u32 *bucket, u32 *la
 	return NULL;
 }
 
+static void __flow_tbl_insert(struct flow_table *table, struct sw_flow *flow)
+{
+	struct hlist_head *head;
+
+	head = find_bucket(table, flow->hash);
+	hlist_add_head_rcu(&flow->hash_node[table->node_ver], head);
+	table->count++;
+}
+
 static void flow_table_copy_flows(struct flow_table *old, struct flow_table *new)
 {
 	int old_ver;
@@ -364,6 +385,10 @@ static void flow_table_copy_flows(struct flow_table *old, struct flow_table *new
 	old_ver = old->node_ver;
 	new->node_ver = !old_ver;
 
+	/* The flows keep their masks, so the mask list moves along. */
+	kfree(new->mask_list);
+	new->mask_list = old->mask_list;
+
 	/* Insert in new table. */
 	for (i = 0; i < old->n_buckets; i++) {
 		struct sw_flow *flow;
@@ -373,7 +398,7 @@ static void flow_table_copy_flows(struct flow_table *old, struct flow_table *new
 		head = flex_array_get(old->buckets, i);
 
 		hlist_for_each_entry(flow, n, head, hash_node[old_ver])
-			ovs_flow_tbl_insert(new, flow);
+			__flow_tbl_insert(new, flow);
 	}
 	old->keep_flows = true;
 }
@@ -401,11 +426,27 @@ struct flow_table *ovs_flow_tbl_expand(struct flow_table *table)
 	return __flow_tbl_rehash(table, table->n_buckets * 2);
 }
 
+static void flow_mask_del_ref(struct sw_flow_mask *mask, bool deferred)
+{
+	BUG_ON(!mask->ref_count);
+
+	if (--mask->ref_count)
+		return;
+
+	list_del_rcu(&mask->list);
+	if (deferred)
+		kfree_rcu(mask, rcu);
+	else
+		kfree(mask);
+}
+
 void ovs_flow_free(struct sw_flow *flow)
 {
 	if (unlikely(!flow))
 		return;
 
+	if (flow->mask)
+		flow_mask_del_ref(flow->mask, false);
 	kfree((struct sf_flow_acts __force *)flow->sf_acts);
 	kmem_cache_free(flow_cache, flow);
 }
@@ -422,6 +463,12 @@ static void rcu_free_flow_callback(struct rcu_head *rcu)
  * The caller must hold rcu_read_lock for this to be sensible. */
 void ovs_flow_deferred_free(struct sw_flow *flow)
 {
+	/* Mask reference counts are protected by genl_lock, which the RCU
+	 * callback does not hold, so drop the reference now. */
+	if (flow->mask) {
+		flow_mask_del_ref(flow->mask, true);
+		flow->mask = NULL;
+	}
 	call_rcu(&flow->rcu, rcu_free_flow_callback);
 }
 
@@ -773,34 +820,144 @@ u32 ovs_flow_hash(const struct sw_flow_key *key, int key_len)
 	return jhash2((u32 *)key, DIV_ROUND_UP(key_len, sizeof(u32)), 0);
 }
 
-struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *table,
-				struct sw_flow_key *key, int key_len)
+/**
+ * ovs_flow_key_mask - applies a mask to a flow key.
+ * @dst: receives the masked key.  Only the first @mask->key_len bytes,
+ * rounded up to a multiple of 4, are written.
+ * @src: key to mask.
+ * @mask: mask to apply.
+ */
+void ovs_flow_key_mask(struct sw_flow_key *dst, const struct sw_flow_key *src,
+		       const struct sw_flow_mask *mask)
+{
+	const u32 *m = (const u32 *)&mask->key;
+	const u32 *s = (const u32 *)src;
+	u32 *d = (u32 *)dst;
+	int i;
+
+	for (i = 0; i < DIV_ROUND_UP(mask->key_len, sizeof(u32)); i++)
+		d[i] = s[i] & m[i];
+}
+
+static bool flow_mask_equal(const struct sw_flow_mask *a,
+			    const struct sw_flow_mask *b)
+{
+	return a->key_len == b->key_len &&
+	       !memcmp(&a->key, &b->key,
+		       DIV_ROUND_UP(a->key_len, sizeof(u32)) * sizeof(u32));
+}
+
+static struct sw_flow_mask *flow_mask_find(const struct flow_table *table,
+					   const struct sw_flow_mask *mask)
+{
+	struct sw_flow_mask *m;
+
+	list_for_each_entry_rcu(m, table->mask_list, list) {
+		if (flow_mask_equal(m, mask))
+			return m;
+	}
+	return NULL;
+}
+
+static struct sw_flow *masked_flow_lookup(struct flow_table *table,
+					  const struct sw_flow_key *unmasked,
+					  const struct sw_flow_mask *mask)
 {
+	struct sw_flow_key masked_key;
 	struct sw_flow *flow;
 	struct hlist_node *n;
 	struct hlist_head *head;
 	u32 hash;
 
-	hash = ovs_flow_hash(key, key_len);
+	ovs_flow_key_mask(&masked_key, unmasked, mask);
+	hash = ovs_flow_hash(&masked_key, mask->key_len);
 
 	head = find_bucket(table, hash);
 	hlist_for_each_entry_rcu(flow, n, head, hash_node[table->node_ver]) {
+		if (flow->mask == mask && flow->hash == hash &&
+		    !memcmp(&flow->key, &masked_key, mask->key_len))
+			return flow;
+	}
+	return NULL;
+}
 
-		if (flow->hash == hash &&
-		    !memcmp(&flow->key, key, key_len)) {
+/**
+ * ovs_flow_tbl_lookup - finds the flow matching a packet.
+ * @table: flow table to search.
+ * @key: flow key extracted from the packet.
+ * @n_mask_hit: receives the number of masks tried.
+ *
+ * Every mask in use is applied to @key in turn and the masked key looked
+ * up among the flows using that mask.  Flows installed without a mask
+ * all share the exact-match mask for their key length.
+ */
+struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *table,
+				    const struct sw_flow_key *key,
+				    u32 *n_mask_hit)
+{
+	struct sw_flow_mask *mask;
+	struct sw_flow *flow;
+
+	*n_mask_hit = 0;
+	list_for_each_entry_rcu(mask, table->mask_list, list) {
+		(*n_mask_hit)++;
+		flow = masked_flow_lookup(table, key, mask);
+		if (flow)
 			return flow;
-		}
 	}
 	return NULL;
 }
 
-void ovs_flow_tbl_insert(struct flow_table *table, struct sw_flow *flow)
+/* Finds the flow installed with exactly @key and @mask.  Called with
+ * genl_lock. */
+struct sw_flow *ovs_flow_tbl_lookup_exact(struct flow_table *table,
+					  const struct sw_flow_key *key,
+					  const struct sw_flow_mask *mask)
 {
-	struct hlist_head *head;
+	struct sw_flow_mask *m;
 
-	head = find_bucket(table, flow->hash);
-	hlist_add_head_rcu(&flow->hash_node[table->node_ver], head);
-	table->count++;
+	m = flow_mask_find(table, mask);
+	if (!m)
+		return NULL;
+	return masked_flow_lookup(table, key, m);
+}
+
+/* Inserts @flow, whose key is already masked, using a copy of @new_mask
+ * shared with the other flows using the same mask.  Called with
+ * genl_lock. */
+int ovs_flow_tbl_insert(struct flow_table *table, struct sw_flow *flow,
+			const struct sw_flow_mask *new_mask)
+{
+	struct sw_flow_mask *mask;
+
+	mask = flow_mask_find(table, new_mask);
+	if (!mask) {
+		mask = kmalloc(sizeof(*mask), GFP_KERNEL);
+		if (!mask)
+			return -ENOMEM;
+		mask->ref_count = 0;
+		mask->key_len = new_mask->key_len;
+		mask->key = new_mask->key;
+		/* Older masks tend to be the busier ones, try them first. */
+		list_add_tail_rcu(&mask->list, table->mask_list);
+	}
+	mask->ref_count++;
+
+	flow->mask = mask;
+	flow->hash = ovs_flow_hash(&flow->key, mask->key_len);
+	__flow_tbl_insert(table, flow);
+	return 0;
+}
+
+/* Called with genl_lock. */
+int ovs_flow_tbl_mask_count(const struct flow_table *table)
+{
+	struct sw_flow_mask *mask;
+	int count = 0;
+
+	list_for_each_entry(mask, table->mask_list, list)
+		count++;
+	return count;
 }
 
 void ovs_flow_tbl_remove(struct flow_table *table, struct sw_flow *flow)
@@ -1124,6 +1281,224 @@ int ovs_flow_from_nlattrs(struct sw_flow_key *swkey, int *key_lenp,
 	return 0;
 }
 
+static bool is_all_zero(const void *p, size_t size)
+{
+	return !memchr_inv(p, 0, size);
+}
+
+/* The fields that decide how the rest of the key is laid out must be
+ * matched exactly by a mask that looks at that rest, otherwise a packet
+ * of a different shape could match the flow and get actions validated
+ * against another one. */
+static int flow_mask_validate(const struct sw_flow_key *key,
+			      const struct sw_flow_key *mask)
+{
+	if (mask->eth.type != htons(0xffff))
+		return -EINVAL;
+	if (mask->eth.tci && !(mask->eth.tci & htons(VLAN_TAG_PRESENT)))
+		return -EINVAL;
+
+	if (key->eth.type == htons(ETH_P_IP)) {
+		if (is_all_zero(&mask->ipv4.tp, sizeof(mask->ipv4.tp)))
+			return 0;
+	} else if (key->eth.type == htons(ETH_P_IPV6)) {
+		if (!is_all_zero(&mask->ipv6.nd, sizeof(mask->ipv6.nd)) &&
+		    mask->ipv6.tp.src != htons(0xffff))
+			return -EINVAL;
+		if (is_all_zero(&mask->ipv6.tp, sizeof(mask->ipv6.tp)) &&
+		    is_all_zero(&mask->ipv6.nd, sizeof(mask->ipv6.nd)))
+			return 0;
+	} else {
+		return 0;
+	}
+
+	/* Transport fields are matched. */
+	if (mask->ip.proto != 0xff || mask->ip.frag != 0xff)
+		return -EINVAL;
+	return 0;
+}
+
+/**
+ * ovs_flow_mask_from_nlattrs - parses Netlink attributes into a flow mask.
+ * @mask: receives the mask.
+ * @key: the flow key, as parsed by ovs_flow_from_nlattrs(), which decides
+ * how the mask attributes are interpreted.
+ * @key_len: number of bytes used in @key.
+ * @attr: Netlink attribute holding nested %OVS_KEY_ATTR_* Netlink attribute
+ * sequence in the same form as the key, or %NULL for an exact match.
+ *
+ * Fields whose attribute is missing from @attr are wildcarded.
+ */
+int ovs_flow_mask_from_nlattrs(struct sw_flow_mask *mask,
+			       const struct sw_flow_key *key, int key_len,
+			       const struct nlattr *attr)
+{
+	const struct nlattr *a[OVS_KEY_ATTR_MAX + 1];
+	struct sw_flow_key *m = &mask->key;
+	u32 attrs;
+	int err;
+
+	memset(m, 0, sizeof(*m));
+	mask->key_len = key_len;
+
+	if (!attr) {
+		memset(m, 0xff, key_len);
+		return 0;
+	}
+
+	err = parse_flow_nlattrs(attr, a, &attrs);
+	if (err)
+		return err;
+
+	if (attrs & (1 << OVS_KEY_ATTR_PRIORITY)) {
+		m->phy.priority = nla_get_u32(a[OVS_KEY_ATTR_PRIORITY]);
+		attrs &= ~(1 << OVS_KEY_ATTR_PRIORITY);
+	}
+	if (attrs & (1 << OVS_KEY_ATTR_IN_PORT)) {
+		m->phy.in_port = nla_get_u32(a[OVS_KEY_ATTR_IN_PORT]);
+		attrs &= ~(1 << OVS_KEY_ATTR_IN_PORT);
+	}
+	if (attrs & (1 << OVS_KEY_ATTR_ETHERNET)) {
+		const struct ovs_key_ethernet *eth_key;
+
+		eth_key = nla_data(a[OVS_KEY_ATTR_ETHERNET]);
+		memcpy(m->eth.src, eth_key->eth_src, ETH_ALEN);
+		memcpy(m->eth.dst, eth_key->eth_dst, ETH_ALEN);
+		attrs &= ~(1 << OVS_KEY_ATTR_ETHERNET);
+	}
+
+	if (key->eth.tci || key->eth.type == htons(ETH_P_8021Q)) {
+		/* Outer ethertype is always 802.1Q; the inner one and the
+		 * rest of the mask are in the encapsulation. */
+		attrs &= ~(1 << OVS_KEY_ATTR_ETHERTYPE);
+		if (attrs & (1 << OVS_KEY_ATTR_VLAN)) {
+			m->eth.tci = nla_get_be16(a[OVS_KEY_ATTR_VLAN]);
+			attrs &= ~(1 << OVS_KEY_ATTR_VLAN);
+		}
+		if (attrs & (1 << OVS_KEY_ATTR_ENCAP)) {
+			if (attrs != (1 << OVS_KEY_ATTR_ENCAP))
+				return -EINVAL;
+			err = parse_flow_nlattrs(a[OVS_KEY_ATTR_ENCAP], a,
+						 &attrs);
+			if (err)
+				return err;
+		}
+	}
+
+	if (attrs & (1 << OVS_KEY_ATTR_ETHERTYPE)) {
+		m->eth.type = nla_get_be16(a[OVS_KEY_ATTR_ETHERTYPE]);
+		attrs &= ~(1 << OVS_KEY_ATTR_ETHERTYPE);
+	} else if (key->eth.type == htons(ETH_P_802_2)) {
+		/* 802.2 frames are keyed by the absence of an ethertype. */
+		m->eth.type = htons(0xffff);
+	}
+
+	if (key->eth.type == htons(ETH_P_IP)) {
+		if (attrs & (1 << OVS_KEY_ATTR_IPV4)) {
+			const struct ovs_key_ipv4 *ipv4_key;
+
+			ipv4_key = nla_data(a[OVS_KEY_ATTR_IPV4]);
+			m->ip.proto = ipv4_key->ipv4_proto;
+			m->ip.tos = ipv4_key->ipv4_tos;
+			m->ip.ttl = ipv4_key->ipv4_ttl;
+			m->ip.frag = ipv4_key->ipv4_frag;
+			m->ipv4.addr.src = ipv4_key->ipv4_src;
+			m->ipv4.addr.dst = ipv4_key->ipv4_dst;
+			attrs &= ~(1 << OVS_KEY_ATTR_IPV4);
+		}
+		if (attrs & (1 << OVS_KEY_ATTR_TCP)) {
+			const struct ovs_key_tcp *tcp_key;
+
+			tcp_key = nla_data(a[OVS_KEY_ATTR_TCP]);
+			m->ipv4.tp.src = tcp_key->tcp_src;
+			m->ipv4.tp.dst = tcp_key->tcp_dst;
+			attrs &= ~(1 << OVS_KEY_ATTR_TCP);
+		} else if (attrs & (1 << OVS_KEY_ATTR_UDP)) {
+			const struct ovs_key_udp *udp_key;
+
+			udp_key = nla_data(a[OVS_KEY_ATTR_UDP]);
+			m->ipv4.tp.src = udp_key->udp_src;
+			m->ipv4.tp.dst = udp_key->udp_dst;
+			attrs &= ~(1 << OVS_KEY_ATTR_UDP);
+		} else if (attrs & (1 << OVS_KEY_ATTR_ICMP)) {
+			const struct ovs_key_icmp *icmp_key;
+
+			icmp_key = nla_data(a[OVS_KEY_ATTR_ICMP]);
+			m->ipv4.tp.src = htons(icmp_key->icmp_type);
+			m->ipv4.tp.dst = htons(icmp_key->icmp_code);
+			attrs &= ~(1 << OVS_KEY_ATTR_ICMP);
+		}
+	} else if (key->eth.type == htons(ETH_P_IPV6)) {
+		if (attrs & (1 << OVS_KEY_ATTR_IPV6)) {
+			const struct ovs_key_ipv6 *ipv6_key;
+
+			ipv6_key = nla_data(a[OVS_KEY_ATTR_IPV6]);
+			m->ipv6.label = ipv6_key->ipv6_label;
+			m->ip.proto = ipv6_key->ipv6_proto;
+			m->ip.tos = ipv6_key->ipv6_tclass;
+			m->ip.ttl = ipv6_key->ipv6_hlimit;
+			m->ip.frag = ipv6_key->ipv6_frag;
+			memcpy(&m->ipv6.addr.src, ipv6_key->ipv6_src,
+			       sizeof(m->ipv6.addr.src));
+			memcpy(&m->ipv6.addr.dst, ipv6_key->ipv6_dst,
+			       sizeof(m->ipv6.addr.dst));
+			attrs &= ~(1 << OVS_KEY_ATTR_IPV6);
+		}
+		if (attrs & (1 << OVS_KEY_ATTR_TCP)) {
+			const struct ovs_key_tcp *tcp_key;
+
+			tcp_key = nla_data(a[OVS_KEY_ATTR_TCP]);
+			m->ipv6.tp.src = tcp_key->tcp_src;
+			m->ipv6.tp.dst = tcp_key->tcp_dst;
+			attrs &= ~(1 << OVS_KEY_ATTR_TCP);
+		} else if (attrs & (1 << OVS_KEY_ATTR_UDP)) {
+			const struct ovs_key_udp *udp_key;
+
+			udp_key = nla_data(a[OVS_KEY_ATTR_UDP]);
+			m->ipv6.tp.src = udp_key->udp_src;
+			m->ipv6.tp.dst = udp_key->udp_dst;
+			attrs &= ~(1 << OVS_KEY_ATTR_UDP);
+		} else if (attrs & (1 << OVS_KEY_ATTR_ICMPV6)) {
+			const struct ovs_key_icmpv6 *icmpv6_key;
+
+			icmpv6_key = nla_data(a[OVS_KEY_ATTR_ICMPV6]);
+			m->ipv6.tp.src = htons(icmpv6_key->icmpv6_type);
+			m->ipv6.tp.dst = htons(icmpv6_key->icmpv6_code);
+			attrs &= ~(1 << OVS_KEY_ATTR_ICMPV6);
+		}
+		if (attrs & (1 << OVS_KEY_ATTR_ND)) {
+			const struct ovs_key_nd *nd_key;
+
+			nd_key = nla_data(a[OVS_KEY_ATTR_ND]);
+			memcpy(&m->ipv6.nd.target, nd_key->nd_target,
+			       sizeof(m->ipv6.nd.target));
+			memcpy(m->ipv6.nd.sll, nd_key->nd_sll, ETH_ALEN);
+			memcpy(m->ipv6.nd.tll, nd_key->nd_tll, ETH_ALEN);
+			attrs &= ~(1 << OVS_KEY_ATTR_ND);
+		}
+	} else if (key->eth.type == htons(ETH_P_ARP)) {
+		if (attrs & (1 << OVS_KEY_ATTR_ARP)) {
+			const struct ovs_key_arp *arp_key;
+
+			arp_key = nla_data(a[OVS_KEY_ATTR_ARP]);
+			m->ipv4.addr.src = arp_key->arp_sip;
+			m->ipv4.addr.dst = arp_key->arp_tip;
+			m->ip.proto = ntohs(arp_key->arp_op);
+			memcpy(m->ipv4.arp.sha, arp_key->arp_sha, ETH_ALEN);
+			memcpy(m->ipv4.arp.tha, arp_key->arp_tha, ETH_ALEN);
+			attrs &= ~(1 << OVS_KEY_ATTR_ARP);
+		}
+	}
+
+	if (attrs)
+		return -EINVAL;
+
+	/* Nothing past the key can be matched. */
+	memset((u8 *)m + key_len, 0, sizeof(*m) - key_len);
+
+	return flow_mask_validate(key, m);
+}
+
 /**
  * ovs_flow_metadata_from_nlattrs - parses Netlink attributes into a flow key.
  * @in_port: receives the extracted input port.
@@ -1169,27 +1544,41 @@ int ovs_flow_metadata_from_nlattrs(u32 *priority, u16 *in_port,
 	return 0;
 }
 
-int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey, struct sk_buff *skb)
+/**
+ * ovs_flow_to_nlattrs - formats a flow key or mask as Netlink attributes.
+ * @swkey: flow key, which decides which attributes are emitted.
+ * @output: values to emit, either @swkey itself or the flow's mask.
+ * @skb: message to append the attributes to.
+ */
+int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey,
+			const struct sw_flow_key *output, struct sk_buff *skb)
 {
+	bool is_mask = output != swkey;
 	struct ovs_key_ethernet *eth_key;
 	struct nlattr *nla, *encap;
 
-	if (swkey->phy.priority)
-		NLA_PUT_U32(skb, OVS_KEY_ATTR_PRIORITY, swkey->phy.priority);
+	if (output->phy.priority)
+		NLA_PUT_U32(skb, OVS_KEY_ATTR_PRIORITY, output->phy.priority);
 
-	if (swkey->phy.in_port != USHRT_MAX)
-		NLA_PUT_U32(skb, OVS_KEY_ATTR_IN_PORT, swkey->phy.in_port);
+	if (swkey->phy.in_port != USHRT_MAX) {
+		u32 in_port = output->phy.in_port;
+
+		if (is_mask && in_port == USHRT_MAX)
+			in_port = 0xffffffff;
+		NLA_PUT_U32(skb, OVS_KEY_ATTR_IN_PORT, in_port);
+	}
 
 	nla = nla_reserve(skb, OVS_KEY_ATTR_ETHERNET, sizeof(*eth_key));
 	if (!nla)
 		goto nla_put_failure;
 	eth_key = nla_data(nla);
-	memcpy(eth_key->eth_src, swkey->eth.src, ETH_ALEN);
-	memcpy(eth_key->eth_dst, swkey->eth.dst, ETH_ALEN);
+	memcpy(eth_key->eth_src, output->eth.src, ETH_ALEN);
+	memcpy(eth_key->eth_dst, output->eth.dst, ETH_ALEN);
 
 	if (swkey->eth.tci || swkey->eth.type == htons(ETH_P_8021Q)) {
-		NLA_PUT_BE16(skb, OVS_KEY_ATTR_ETHERTYPE, htons(ETH_P_8021Q));
-		NLA_PUT_BE16(skb, OVS_KEY_ATTR_VLAN, swkey->eth.tci);
+		NLA_PUT_BE16(skb, OVS_KEY_ATTR_ETHERTYPE,
+			     is_mask ? htons(0xffff) : htons(ETH_P_8021Q));
+		NLA_PUT_BE16(skb, OVS_KEY_ATTR_VLAN, output->eth.tci);
 		encap = nla_nest_start(skb, OVS_KEY_ATTR_ENCAP);
 		if (!swkey->eth.tci)
 			goto unencap;
@@ -1200,7 +1589,7 @@ int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey, struct sk_buff *skb)
 	if (swkey->eth.type == htons(ETH_P_802_2))
 		goto unencap;
 
-	NLA_PUT_BE16(skb, OVS_KEY_ATTR_ETHERTYPE, swkey->eth.type);
+	NLA_PUT_BE16(skb, OVS_KEY_ATTR_ETHERTYPE, output->eth.type);
 
 	if (swkey->eth.type == htons(ETH_P_IP)) {
 		struct ovs_key_ipv4 *ipv4_key;
@@ -1209,12 +1598,12 @@ int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey, struct sk_buff *skb)
 		if (!nla)
 			goto nla_put_failure;
 		ipv4_key = nla_data(nla);
-		ipv4_key->ipv4_src = swkey->ipv4.addr.src;
-		ipv4_key->ipv4_dst = swkey->ipv4.addr.dst;
-		ipv4_key->ipv4_proto = swkey->ip.proto;
-		ipv4_key->ipv4_tos = swkey->ip.tos;
-		ipv4_key->ipv4_ttl = swkey->ip.ttl;
-		ipv4_key->ipv4_frag = swkey->ip.frag;
+		ipv4_key->ipv4_src = output->ipv4.addr.src;
+		ipv4_key->ipv4_dst = output->ipv4.addr.dst;
+		ipv4_key->ipv4_proto = output->ip.proto;
+		ipv4_key->ipv4_tos = output->ip.tos;
+		ipv4_key->ipv4_ttl = output->ip.ttl;
+		ipv4_key->ipv4_frag = output->ip.frag;
 	} else if (swkey->eth.type == htons(ETH_P_IPV6)) {
 		struct ovs_key_ipv6 *ipv6_key;
 
@@ -1222,15 +1611,15 @@ int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey, struct sk_buff *skb)
 		if (!nla)
 			goto nla_put_failure;
 		ipv6_key = nla_data(nla);
-		memcpy(ipv6_key->ipv6_src, &swkey->ipv6.addr.src,
+		memcpy(ipv6_key->ipv6_src, &output->ipv6.addr.src,
 				sizeof(ipv6_key->ipv6_src));
-		memcpy(ipv6_key->ipv6_dst, &swkey->ipv6.addr.dst,
+		memcpy(ipv6_key->ipv6_dst, &output->ipv6.addr.dst,
 				sizeof(ipv6_key->ipv6_dst));
-		ipv6_key->ipv6_label = swkey->ipv6.label;
-		ipv6_key->ipv6_proto = swkey->ip.proto;
-		ipv6_key->ipv6_tclass = swkey->ip.tos;
-		ipv6_key->ipv6_hlimit = swkey->ip.ttl;
-		ipv6_key->ipv6_frag = swkey->ip.frag;
+		ipv6_key->ipv6_label = output->ipv6.label;
+		ipv6_key->ipv6_proto = output->ip.proto;
+		ipv6_key->ipv6_tclass = output->ip.tos;
+		ipv6_key->ipv6_hlimit = output->ip.ttl;
+		ipv6_key->ipv6_frag = output->ip.frag;
 	} else if (swkey->eth.type == htons(ETH_P_ARP)) {
 		struct ovs_key_arp *arp_key;
 
@@ -1239,11 +1628,11 @@ int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey, struct sk_buff *skb)
 			goto nla_put_failure;
 		arp_key = nla_data(nla);
 		memset(arp_key, 0, sizeof(struct ovs_key_arp));
-		arp_key->arp_sip = swkey->ipv4.addr.src;
-		arp_key->arp_tip = swkey->ipv4.addr.dst;
-		arp_key->arp_op = htons(swkey->ip.proto);
-		memcpy(arp_key->arp_sha, swkey->ipv4.arp.sha, ETH_ALEN);
-		memcpy(arp_key->arp_tha, swkey->ipv4.arp.tha, ETH_ALEN);
+		arp_key->arp_sip = output->ipv4.addr.src;
+		arp_key->arp_tip = output->ipv4.addr.dst;
+		arp_key->arp_op = htons(output->ip.proto);
+		memcpy(arp_key->arp_sha, output->ipv4.arp.sha, ETH_ALEN);
+		memcpy(arp_key->arp_tha, output->ipv4.arp.tha, ETH_ALEN);
 	}
 
 	if ((swkey->eth.type == htons(ETH_P_IP) ||
@@ -1258,11 +1647,11 @@ int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey, struct sk_buff *skb)
 				goto nla_put_failure;
 			tcp_key = nla_data(nla);
 			if (swkey->eth.type == htons(ETH_P_IP)) {
-				tcp_key->tcp_src = swkey->ipv4.tp.src;
-				tcp_key->tcp_dst = swkey->ipv4.tp.dst;
+				tcp_key->tcp_src = output->ipv4.tp.src;
+				tcp_key->tcp_dst = output->ipv4.tp.dst;
 			} else if (swkey->eth.type == htons(ETH_P_IPV6)) {
-				tcp_key->tcp_src = swkey->ipv6.tp.src;
-				tcp_key->tcp_dst = swkey->ipv6.tp.dst;
+				tcp_key->tcp_src = output->ipv6.tp.src;
+				tcp_key->tcp_dst = output->ipv6.tp.dst;
 			}
 		} else if (swkey->ip.proto == IPPROTO_UDP) {
 			struct ovs_key_udp *udp_key;
@@ -1272,11 +1661,11 @@ int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey, struct sk_buff *skb)
 				goto nla_put_failure;
 			udp_key = nla_data(nla);
 			if (swkey->eth.type == htons(ETH_P_IP)) {
-				udp_key->udp_src = swkey->ipv4.tp.src;
-				udp_key->udp_dst = swkey->ipv4.tp.dst;
+				udp_key->udp_src = output->ipv4.tp.src;
+				udp_key->udp_dst = output->ipv4.tp.dst;
 			} else if (swkey->eth.type == htons(ETH_P_IPV6)) {
-				udp_key->udp_src = swkey->ipv6.tp.src;
-				udp_key->udp_dst = swkey->ipv6.tp.dst;
+				udp_key->udp_src = output->ipv6.tp.src;
+				udp_key->udp_dst = output->ipv6.tp.dst;
 			}
 		} else if (swkey->eth.type == htons(ETH_P_IP) &&
 			   swkey->ip.proto == IPPROTO_ICMP) {
@@ -1286,8 +1675,8 @@ int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey, struct sk_buff *skb)
 			if (!nla)
 				goto nla_put_failure;
 			icmp_key = nla_data(nla);
-			icmp_key->icmp_type = ntohs(swkey->ipv4.tp.src);
-			icmp_key->icmp_code = ntohs(swkey->ipv4.tp.dst);
+			icmp_key->icmp_type = ntohs(output->ipv4.tp.src);
+			icmp_key->icmp_code = ntohs(output->ipv4.tp.dst);
 		} else if (swkey->eth.type == htons(ETH_P_IPV6) &&
 			   swkey->ip.proto == IPPROTO_ICMPV6) {
 			struct ovs_key_icmpv6 *icmpv6_key;
@@ -1297,21 +1686,21 @@ int ovs_flow_to_nlattrs(const struct sw_flow_key *swkey, struct sk_buff *skb)
 			if (!nla)
 				goto nla_put_failure;
 			icmpv6_key = nla_data(nla);
-			icmpv6_key->icmpv6_type = ntohs(swkey->ipv6.tp.src);
-			icmpv6_key->icmpv6_code = ntohs(swkey->ipv6.tp.dst);
+			icmpv6_key->icmpv6_type = ntohs(output->ipv6.tp.src);
+			icmpv6_key->icmpv6_code = ntohs(output->ipv6.tp.dst);
 
-			if (icmpv6_key->icmpv6_type == NDISC_NEIGHBOUR_SOLICITATION ||
-			    icmpv6_key->icmpv6_type == NDISC_NEIGHBOUR_ADVERTISEMENT) {
+			if (swkey->ipv6.tp.src == htons(NDISC_NEIGHBOUR_SOLICITATION) ||
+			    swkey->ipv6.tp.src == htons(NDISC_NEIGHBOUR_ADVERTISEMENT)) {
 				struct ovs_key_nd *nd_key;
 
 				nla = nla_reserve(skb, OVS_KEY_ATTR_ND, sizeof(*nd_key));
 				if (!nla)
 					goto nla_put_failure;
 				nd_key = nla_data(nla);
-				memcpy(nd_key->nd_target, &swkey->ipv6.nd.target,
+				memcpy(nd_key->nd_target, &output->ipv6.nd.target,
 							sizeof(nd_key->nd_target));
-				memcpy(nd_key->nd_sll, swkey->ipv6.nd.sll, ETH_ALEN);
-				memcpy(nd_key->nd_tll, swkey->ipv6.nd.tll, ETH_ALEN);
+				memcpy(nd_key->nd_sll, output->ipv6.nd.sll, ETH_ALEN);
+				memcpy(nd_key->nd_tll, output->ipv6.nd.tll, ETH_ALEN);
 			}
 		}
 	}
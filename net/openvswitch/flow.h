@@ -93,12 +93,29 @@ struct sw_flow_key {
 	};
 };
 
+/**
+ * struct sw_flow_mask - wildcard mask shared by the flows that use it
+ * @ref_count: Number of flows using this mask.  Protected by genl_lock.
+ * @rcu: RCU callback head for deferred destruction.
+ * @list: Element in the flow table's list of masks.
+ * @key_len: Number of bytes of the flow key the mask applies to.
+ * @key: The mask itself: set bits are matched, clear bits are wildcarded.
+ */
+struct sw_flow_mask {
+	int ref_count;
+	struct rcu_head rcu;
+	struct list_head list;
+	int key_len;
+	struct sw_flow_key key;
+};
+
 struct sw_flow {
 	struct rcu_head rcu;
 	struct hlist_node hash_node[2];
 	u32 hash;
 
-	struct sw_flow_key key;
+	struct sw_flow_key key;		/* Already masked with @mask. */
+	struct sw_flow_mask *mask;
 	struct sw_flow_actions __rcu *sf_acts;
 
 	spinlock_t lock;	/* Lock for values below. */
@@ -155,9 +172,15 @@ u64 ovs_flow_used_time(unsigned long flow_jiffies);
  */
 #define FLOW_BUFSIZE 132
 
-int ovs_flow_to_nlattrs(const struct sw_flow_key *, struct sk_buff *);
+int ovs_flow_to_nlattrs(const struct sw_flow_key *,
+			const struct sw_flow_key *output, struct sk_buff *);
 int ovs_flow_from_nlattrs(struct sw_flow_key *swkey, int *key_lenp,
 		      const struct nlattr *);
+int ovs_flow_mask_from_nlattrs(struct sw_flow_mask *mask,
+			       const struct sw_flow_key *key, int key_len,
+			       const struct nlattr *);
+void ovs_flow_key_mask(struct sw_flow_key *dst, const struct sw_flow_key *src,
+		       const struct sw_flow_mask *mask);
 int ovs_flow_metadata_from_nlattrs(u32 *priority, u16 *in_port,
 			       const struct nlattr *);
 
@@ -167,6 +190,8 @@ struct flow_table {
 	struct flex_array *buckets;
 	unsigned int count, n_buckets;
 	struct rcu_head rcu;
+	/* Masks in use, shared with the tables this one was rehashed from. */
+	struct list_head *mask_list;
 	int node_ver;
 	u32 hash_seed;
 	bool keep_flows;
@@ -183,13 +208,19 @@ static inline int ovs_flow_tbl_need_to_expand(struct flow_table *table)
 }
 
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *table,
-				    struct sw_flow_key *key, int len);
+				    const struct sw_flow_key *key,
+				    u32 *n_mask_hit);
+struct sw_flow *ovs_flow_tbl_lookup_exact(struct flow_table *table,
+					  const struct sw_flow_key *key,
+					  const struct sw_flow_mask *mask);
 void ovs_flow_tbl_destroy(struct flow_table *table);
 void ovs_flow_tbl_deferred_destroy(struct flow_table *table);
 struct flow_table *ovs_flow_tbl_alloc(int new_size);
 struct flow_table *ovs_flow_tbl_expand(struct flow_table *table);
 struct flow_table *ovs_flow_tbl_rehash(struct flow_table *table);
-void ovs_flow_tbl_insert(struct flow_table *table, struct sw_flow *flow);
+int ovs_flow_tbl_insert(struct flow_table *table, struct sw_flow *flow,
+			const struct sw_flow_mask *mask);
+int ovs_flow_tbl_mask_count(const struct flow_table *table);
 void ovs_flow_tbl_remove(struct flow_table *table, struct sw_flow *flow);
 u32 ovs_flow_hash(const struct sw_flow_key *key, int key_len);
 
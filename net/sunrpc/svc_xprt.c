@@ -16,6 +16,9 @@
 #include <linux/sunrpc/xprt.h>
 #include <linux/module.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/sunrpc.h>
+
 #define RPCDBG_FACILITY	RPCDBG_SVCXPRT
 
 static struct svc_deferred_req *svc_deferred_dequeue(struct svc_xprt *xprt);
@@ -38,6 +41,8 @@ static LIST_HEAD(svc_xprt_class_list);
 /* SMP locking strategy:
  *
  *	svc_pool->sp_lock protects most of the fields of that pool.
+ *	Transports are queued to a pool and idle threads are found
+ *	without it, see svc_xprt_enqueue.  Threads take it to dequeue.
  *	svc_serv->sv_lock protects sv_tempsocks, sv_permsocks, sv_tmpcnt.
  *	when both need to be taken (rare), svc_serv->sv_lock is first.
  *	BKL protects svc_serv->sv_nrthread.
@@ -157,7 +162,6 @@ void svc_xprt_init(struct net *net, struct svc_xprt_class *xcl,
 	kref_init(&xprt->xpt_ref);
 	xprt->xpt_server = serv;
 	INIT_LIST_HEAD(&xprt->xpt_list);
-	INIT_LIST_HEAD(&xprt->xpt_ready);
 	INIT_LIST_HEAD(&xprt->xpt_deferred);
 	INIT_LIST_HEAD(&xprt->xpt_users);
 	mutex_init(&xprt->xpt_mutex);
@@ -281,25 +285,6 @@ char *svc_print_addr(struct svc_rqst *rqstp, char *buf, size_t len)
 }
 EXPORT_SYMBOL_GPL(svc_print_addr);
 
-/*
- * Queue up an idle server thread.  Must have pool->sp_lock held.
- * Note: this is really a stack rather than a queue, so that we only
- * use as many different threads as we need, and the rest don't pollute
- * the cache.
- */
-static void svc_thread_enqueue(struct svc_pool *pool, struct svc_rqst *rqstp)
-{
-	list_add(&rqstp->rq_list, &pool->sp_threads);
-}
-
-/*
- * Dequeue an nfsd thread.  Must have pool->sp_lock held.
- */
-static void svc_thread_dequeue(struct svc_pool *pool, struct svc_rqst *rqstp)
-{
-	list_del(&rqstp->rq_list);
-}
-
 static bool svc_xprt_has_something_to_do(struct svc_xprt *xprt)
 {
 	if (xprt->xpt_flags & ((1<<XPT_CONN)|(1<<XPT_CLOSE)))
@@ -309,14 +294,39 @@ static bool svc_xprt_has_something_to_do(struct svc_xprt *xprt)
 	return false;
 }
 
+/*
+ * Wake up an idle thread of the pool.  The thread is claimed by setting
+ * RQ_BUSY, so that it is not woken again for another transport before
+ * it gets to run.  Must be called under rcu_read_lock().
+ */
+static struct svc_rqst *svc_pool_wake_idle_thread(struct svc_pool *pool)
+{
+	struct svc_rqst	*rqstp;
+
+	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
+		if (test_bit(RQ_BUSY, &rqstp->rq_flags) ||
+		    test_and_set_bit(RQ_BUSY, &rqstp->rq_flags))
+			continue;
+		wake_up(&rqstp->rq_wait);
+		return rqstp;
+	}
+	return NULL;
+}
+
 /*
  * Queue up a transport with data pending. If there are idle nfsd
  * processes, wake 'em up.
  *
+ * This runs for every packet received, often in softirq context, so it
+ * takes no lock: the transport is pushed onto sp_xprts_new and an idle
+ * thread, if any, is claimed and woken.  The thread then dequeues the
+ * transport itself, which need not be the one queued here.  The transport
+ * is queued before RQ_BUSY is looked at, and svc_recv clears RQ_BUSY
+ * before looking at the queue, so a thread cannot go to sleep with a
+ * transport queued and nobody to wake it.
  */
 void svc_xprt_enqueue(struct svc_xprt *xprt)
 {
-	struct svc_serv	*serv = xprt->xpt_server;
 	struct svc_pool *pool;
 	struct svc_rqst	*rqstp;
 	int cpu;
@@ -328,15 +338,10 @@ void svc_xprt_enqueue(struct svc_xprt *xprt)
 	pool = svc_pool_for_cpu(xprt->xpt_server, cpu);
 	put_cpu();
 
-	spin_lock_bh(&pool->sp_lock);
+	atomic_long_inc(&pool->sp_stats.packets);
 
-	if (!list_empty(&pool->sp_threads) &&
-	    !list_empty(&pool->sp_sockets))
-		printk(KERN_ERR
-		       "svc_xprt_enqueue: "
-		       "threads and transports both waiting??\n");
-
-	pool->sp_stats.packets++;
+	/* svc_close_all waits for a grace period to see us through */
+	rcu_read_lock();
 
 	/* Mark transport as busy. It will remain in this state until
 	 * the provider calls svc_xprt_received. We update XPT_BUSY
@@ -349,47 +354,63 @@ void svc_xprt_enqueue(struct svc_xprt *xprt)
 		goto out_unlock;
 	}
 
-	if (!list_empty(&pool->sp_threads)) {
-		rqstp = list_entry(pool->sp_threads.next,
-				   struct svc_rqst,
-				   rq_list);
+	xprt->xpt_qtime = ktime_get();
+	llist_add(&xprt->xpt_ready, &pool->sp_xprts_new);
+
+	rqstp = svc_pool_wake_idle_thread(pool);
+	if (rqstp) {
 		dprintk("svc: transport %p served by daemon %p\n",
 			xprt, rqstp);
-		svc_thread_dequeue(pool, rqstp);
-		if (rqstp->rq_xprt)
-			printk(KERN_ERR
-				"svc_xprt_enqueue: server %p, rq_xprt=%p!\n",
-				rqstp, rqstp->rq_xprt);
-		rqstp->rq_xprt = xprt;
-		svc_xprt_get(xprt);
-		rqstp->rq_reserved = serv->sv_max_mesg;
-		atomic_add(rqstp->rq_reserved, &xprt->xpt_reserved);
-		pool->sp_stats.threads_woken++;
-		wake_up(&rqstp->rq_wait);
+		atomic_long_inc(&pool->sp_stats.threads_woken);
 	} else {
 		dprintk("svc: transport %p put into queue\n", xprt);
-		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
-		pool->sp_stats.sockets_queued++;
+		atomic_long_inc(&pool->sp_stats.sockets_queued);
 	}
+	trace_svc_xprt_enqueue(xprt, pool, rqstp);
 
 out_unlock:
-	spin_unlock_bh(&pool->sp_lock);
+	rcu_read_unlock();
 }
 EXPORT_SYMBOL_GPL(svc_xprt_enqueue);
 
+static bool svc_xprt_pending(struct svc_pool *pool)
+{
+	return ACCESS_ONCE(pool->sp_xprts) != NULL ||
+		!llist_empty(&pool->sp_xprts_new);
+}
+
 /*
- * Dequeue the first transport.  Must be called with the pool->sp_lock held.
+ * Dequeue the oldest transport.  Transports are queued newest first on
+ * sp_xprts_new; once sp_xprts runs dry, the whole of sp_xprts_new is
+ * taken over and reversed into it.
  */
 static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 {
+	struct llist_node *node, *next, *list;
 	struct svc_xprt	*xprt;
 
-	if (list_empty(&pool->sp_sockets))
+	if (!svc_xprt_pending(pool))
 		return NULL;
 
-	xprt = list_entry(pool->sp_sockets.next,
-			  struct svc_xprt, xpt_ready);
-	list_del_init(&xprt->xpt_ready);
+	spin_lock_bh(&pool->sp_lock);
+	node = pool->sp_xprts;
+	if (!node) {
+		list = llist_del_all(&pool->sp_xprts_new);
+		while (list) {
+			next = list->next;
+			list->next = node;
+			node = list;
+			list = next;
+		}
+	}
+	if (node)
+		pool->sp_xprts = node->next;
+	spin_unlock_bh(&pool->sp_lock);
+
+	if (!node)
+		return NULL;
+	xprt = llist_entry(node, struct svc_xprt, xpt_ready);
+	trace_svc_xprt_dequeue(xprt);
 
 	dprintk("svc: transport %p dequeued, inuse=%d\n",
 		xprt, atomic_read(&xprt->xpt_ref.refcount));
@@ -486,19 +507,17 @@ void svc_wake_up(struct svc_serv *serv)
 	for (i = 0; i < serv->sv_nrpools; i++) {
 		pool = &serv->sv_pools[i];
 
-		spin_lock_bh(&pool->sp_lock);
-		if (!list_empty(&pool->sp_threads)) {
-			rqstp = list_entry(pool->sp_threads.next,
-					   struct svc_rqst,
-					   rq_list);
+		rcu_read_lock();
+		rqstp = svc_pool_wake_idle_thread(pool);
+		rcu_read_unlock();
+		if (rqstp) {
 			dprintk("svc: daemon %p woken up.\n", rqstp);
-			/*
-			svc_thread_dequeue(pool, rqstp);
-			rqstp->rq_xprt = NULL;
-			 */
-			wake_up(&rqstp->rq_wait);
+		} else {
+			/* have the next thread to wait skip its sleep */
+			set_bit(SP_TASK_PENDING, &pool->sp_flags);
+			smp_mb__after_clear_bit();
 		}
-		spin_unlock_bh(&pool->sp_lock);
+		trace_svc_wake_up(pool, rqstp);
 	}
 }
 EXPORT_SYMBOL_GPL(svc_wake_up);
@@ -571,6 +590,25 @@ static void svc_check_conn_limits(struct svc_serv *serv)
 	}
 }
 
+static bool svc_thread_should_sleep(struct svc_rqst *rqstp)
+{
+	struct svc_pool *pool = rqstp->rq_pool;
+
+	/* did someone call svc_wake_up? */
+	if (test_and_clear_bit(SP_TASK_PENDING, &pool->sp_flags))
+		return false;
+
+	/* was a transport queued? */
+	if (svc_xprt_pending(pool))
+		return false;
+
+	/* are we shutting down? */
+	if (signalled() || kthread_should_stop())
+		return false;
+
+	return true;
+}
+
 /*
  * Receive the next request on any transport.  This code is carefully
  * organised not to touch any cachelines in the shared svc_serv
@@ -638,14 +676,8 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 	 */
 	rqstp->rq_chandle.thread_wait = 5*HZ;
 
-	spin_lock_bh(&pool->sp_lock);
 	xprt = svc_xprt_dequeue(pool);
 	if (xprt) {
-		rqstp->rq_xprt = xprt;
-		svc_xprt_get(xprt);
-		rqstp->rq_reserved = serv->sv_max_mesg;
-		atomic_add(rqstp->rq_reserved, &xprt->xpt_reserved);
-
 		/* As there is a shortage of threads and this request
 		 * had to be queued, don't allow the thread to wait so
 		 * long for cache updates.
@@ -653,43 +685,37 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 		rqstp->rq_chandle.thread_wait = 1*HZ;
 	} else {
 		/* No data pending. Go to sleep */
-		svc_thread_enqueue(pool, rqstp);
 
 		/*
 		 * We have to be able to interrupt this wait
 		 * to bring down the daemons ...
 		 */
 		set_current_state(TASK_INTERRUPTIBLE);
+		add_wait_queue(&rqstp->rq_wait, &wait);
 
 		/*
-		 * checking kthread_should_stop() here allows us to avoid
-		 * locking and signalling when stopping kthreads that call
-		 * svc_recv. If the thread has already been woken up, then
-		 * we can exit here without sleeping. If not, then it
-		 * it'll be woken up quickly during the schedule_timeout
+		 * From here on svc_xprt_enqueue and svc_wake_up may claim
+		 * this thread; their wake_up finds it on rq_wait already.
 		 */
-		if (kthread_should_stop()) {
-			set_current_state(TASK_RUNNING);
-			spin_unlock_bh(&pool->sp_lock);
-			return -EINTR;
-		}
-
-		add_wait_queue(&rqstp->rq_wait, &wait);
-		spin_unlock_bh(&pool->sp_lock);
+		smp_mb__before_clear_bit();
+		clear_bit(RQ_BUSY, &rqstp->rq_flags);
+		smp_mb__after_clear_bit();
 
-		time_left = schedule_timeout(timeout);
+		time_left = 1;
+		if (svc_thread_should_sleep(rqstp))
+			time_left = schedule_timeout(timeout);
+		else
+			__set_current_state(TASK_RUNNING);
+		remove_wait_queue(&rqstp->rq_wait, &wait);
 
 		try_to_freeze();
 
-		spin_lock_bh(&pool->sp_lock);
-		remove_wait_queue(&rqstp->rq_wait, &wait);
-		if (!time_left)
-			pool->sp_stats.threads_timedout++;
-
-		xprt = rqstp->rq_xprt;
+		set_bit(RQ_BUSY, &rqstp->rq_flags);
+		smp_mb__after_clear_bit();
+		xprt = svc_xprt_dequeue(pool);
 		if (!xprt) {
-			svc_thread_dequeue(pool, rqstp);
-			spin_unlock_bh(&pool->sp_lock);
+			if (!time_left)
+				atomic_long_inc(&pool->sp_stats.threads_timedout);
 			dprintk("svc: server %p, no data yet\n", rqstp);
 			if (signalled() || kthread_should_stop())
 				return -EINTR;
@@ -697,7 +723,10 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 				return -EAGAIN;
 		}
 	}
-	spin_unlock_bh(&pool->sp_lock);
+	rqstp->rq_xprt = xprt;
+	svc_xprt_get(xprt);
+	rqstp->rq_reserved = serv->sv_max_mesg;
+	atomic_add(rqstp->rq_reserved, &xprt->xpt_reserved);
 
 	len = 0;
 	if (test_bit(XPT_CLOSE, &xprt->xpt_flags)) {
@@ -894,7 +923,6 @@ static void svc_delete_xprt(struct svc_xprt *xprt)
 	spin_lock_bh(&serv->sv_lock);
 	if (!test_and_set_bit(XPT_DETACHED, &xprt->xpt_flags))
 		list_del_init(&xprt->xpt_list);
-	BUG_ON(!list_empty(&xprt->xpt_ready));
 	if (test_bit(XPT_TEMP, &xprt->xpt_flags))
 		serv->sv_tmpcnt--;
 	spin_unlock_bh(&serv->sv_lock);
@@ -942,21 +970,20 @@ void svc_close_all(struct svc_serv *serv)
 	svc_close_list(&serv->sv_tempsocks);
 	svc_close_list(&serv->sv_permsocks);
 
+	/*
+	 * svc_xprt_enqueue will not queue any of them now that they are
+	 * all marked busy, but may still be queueing one it marked busy
+	 * before we did; wait for it. After that, the pool queues will
+	 * stay empty once drained.
+	 */
+	synchronize_rcu();
+
 	for (i = 0; i < serv->sv_nrpools; i++) {
 		pool = &serv->sv_pools[i];
-
-		spin_lock_bh(&pool->sp_lock);
-		while (!list_empty(&pool->sp_sockets)) {
-			xprt = list_first_entry(&pool->sp_sockets, struct svc_xprt, xpt_ready);
-			list_del_init(&xprt->xpt_ready);
-		}
-		spin_unlock_bh(&pool->sp_lock);
+		while (svc_xprt_dequeue(pool))
+			;
 	}
-	/*
-	 * At this point the sp_sockets lists will stay empty, since
-	 * svc_enqueue will not add new entries without taking the
-	 * sp_lock and checking XPT_BUSY.
-	 */
+
 	list_for_each_entry_safe(xprt, tmp, &serv->sv_tempsocks, xpt_list)
 		svc_delete_xprt(xprt);
 	list_for_each_entry_safe(xprt, tmp, &serv->sv_permsocks, xpt_list)
@@ -1234,10 +1261,10 @@ static int svc_pool_stats_show(struct seq_file *m, void *p)
 
 	seq_printf(m, "%u %lu %lu %lu %lu\n",
 		pool->sp_id,
-		pool->sp_stats.packets,
-		pool->sp_stats.sockets_queued,
-		pool->sp_stats.threads_woken,
-		pool->sp_stats.threads_timedout);
+		atomic_long_read(&pool->sp_stats.packets),
+		atomic_long_read(&pool->sp_stats.sockets_queued),
+		atomic_long_read(&pool->sp_stats.threads_woken),
+		atomic_long_read(&pool->sp_stats.threads_timedout));
 
 	return 0;
 }
@@ -0,0 +1,625 @@
+/*
+ * FUSE multi-queue benchmark
+ *
+ * A minimal passthrough filesystem talking the raw /dev/fuse protocol,
+ * together with a load generator, to compare a single shared request
+ * queue against per-CPU queues set up with FUSE_DEV_IOC_CLONE_CPU.
+ *
+ * The daemon mirrors the top level of BACKING_DIR (no subdirectories,
+ * no directory listing) and opens files with FOPEN_DIRECT_IO, so every
+ * read(2) on the mount turns into a FUSE_READ request.  The load
+ * generator then runs one reader per job, each pinned to a CPU, doing
+ * random reads of FILE for the given time.
+ *
+ *   fuse-mq-bench [-m] [-j JOBS] [-t SECS] [-b BLKSIZE] \
+ *		BACKING_DIR MOUNTPOINT FILE
+ *
+ *   -m	serve requests from per-CPU cloned device files (default: all
+ *	daemon threads read the single device file passed to mount)
+ *   -j	number of daemon threads and load jobs (default: online CPUs)
+ *   -t	run time in seconds (default: 10)
+ *   -b	read size in bytes (default: 4096)
+ *
+ * Must be run as root.
+ *
+ * This program can be distributed under the terms of the GNU GPL.
+ */
+
+#define _GNU_SOURCE
+
+/* Linux */
+#include <linux/types.h>
+#include <linux/fuse.h>
+
+/* Unix */
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+/* C */
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_WRITE	(128 * 1024)
+#define BUF_SIZE	(MAX_WRITE + 4096)
+#define MAX_NODES	1024
+#define TIMEOUT		3600
+
+struct worker {
+	pthread_t thread;
+	int fd;
+	int cpu;
+	unsigned long reqs;
+};
+
+struct job {
+	pthread_t thread;
+	int cpu;
+	unsigned long ops;
+};
+
+static int backing_fd;
+static const char *mountpoint;
+static const char *bench_file;
+static size_t blksize = 4096;
+static off_t file_size;
+static volatile int stop;
+
+/* nodeid N + 2 names nodes[N] in the backing directory */
+static char *nodes[MAX_NODES];
+static int nr_nodes;
+static pthread_mutex_t nodes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int node_id(const char *name, __u64 *nodeid)
+{
+	int i, err = 0;
+
+	pthread_mutex_lock(&nodes_lock);
+	for (i = 0; i < nr_nodes; i++)
+		if (strcmp(nodes[i], name) == 0)
+			break;
+	if (i == nr_nodes) {
+		if (nr_nodes == MAX_NODES)
+			err = -ENFILE;
+		else if (!(nodes[nr_nodes] = strdup(name)))
+			err = -ENOMEM;
+		else
+			nr_nodes++;
+	}
+	pthread_mutex_unlock(&nodes_lock);
+
+	*nodeid = i + 2;
+	return err;
+}
+
+static const char *node_name(__u64 nodeid)
+{
+	const char *name = NULL;
+
+	pthread_mutex_lock(&nodes_lock);
+	if (nodeid >= 2 && nodeid - 2 < nr_nodes)
+		name = nodes[nodeid - 2];
+	pthread_mutex_unlock(&nodes_lock);
+
+	return name;
+}
+
+static int node_stat(__u64 nodeid, struct stat *st)
+{
+	const char *name;
+
+	if (nodeid == FUSE_ROOT_ID)
+		return fstat(backing_fd, st) ? -errno : 0;
+
+	name = node_name(nodeid);
+	if (!name)
+		return -ESTALE;
+
+	return fstatat(backing_fd, name, st, AT_SYMLINK_NOFOLLOW) ? -errno : 0;
+}
+
+static void fill_attr(struct fuse_attr *attr, __u64 nodeid,
+		      const struct stat *st)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->size = st->st_size;
+	attr->blocks = st->st_blocks;
+	attr->atime = st->st_atim.tv_sec;
+	attr->mtime = st->st_mtim.tv_sec;
+	attr->ctime = st->st_ctim.tv_sec;
+	attr->atimensec = st->st_atim.tv_nsec;
+	attr->mtimensec = st->st_mtim.tv_nsec;
+	attr->ctimensec = st->st_ctim.tv_nsec;
+	attr->mode = st->st_mode;
+	attr->nlink = st->st_nlink;
+	attr->uid = st->st_uid;
+	attr->gid = st->st_gid;
+	attr->rdev = st->st_rdev;
+	attr->blksize = st->st_blksize;
+}
+
+static int reply(int fd, __u64 unique, int error, const void *arg,
+		 size_t argsize)
+{
+	struct fuse_out_header out;
+	struct iovec iov[2];
+	int count = 1;
+
+	out.unique = unique;
+	out.error = error;
+	out.len = sizeof(out);
+	iov[0].iov_base = &out;
+	iov[0].iov_len = sizeof(out);
+	if (!error && argsize) {
+		iov[1].iov_base = (void *) arg;
+		iov[1].iov_len = argsize;
+		out.len += argsize;
+		count++;
+	}
+
+	/* ENOENT: the request was interrupted and is gone */
+	if (writev(fd, iov, count) == -1 && errno != ENOENT) {
+		perror("fuse-mq-bench: writing reply");
+		return -errno;
+	}
+
+	return 0;
+}
+
+static void do_init(int fd, struct fuse_in_header *in, void *arg)
+{
+	struct fuse_init_in *init = arg;
+	struct fuse_init_out out;
+
+	if (init->major != FUSE_KERNEL_VERSION) {
+		reply(fd, in->unique, -EPROTO, NULL, 0);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = FUSE_KERNEL_MINOR_VERSION;
+	out.max_readahead = init->max_readahead;
+	out.flags = init->flags & FUSE_BIG_WRITES;
+	out.max_background = 64;
+	out.congestion_threshold = 48;
+	out.max_write = MAX_WRITE;
+	reply(fd, in->unique, 0, &out, sizeof(out));
+}
+
+static void do_lookup(int fd, struct fuse_in_header *in, const char *name)
+{
+	struct fuse_entry_out out;
+	struct stat st;
+	__u64 nodeid;
+	int err;
+
+	err = -ENOENT;
+	if (in->nodeid != FUSE_ROOT_ID || strchr(name, '/'))
+		goto out_err;
+
+	if (fstatat(backing_fd, name, &st, AT_SYMLINK_NOFOLLOW)) {
+		err = -errno;
+		goto out_err;
+	}
+	err = node_id(name, &nodeid);
+	if (err)
+		goto out_err;
+
+	memset(&out, 0, sizeof(out));
+	out.nodeid = nodeid;
+	out.entry_valid = TIMEOUT;
+	out.attr_valid = TIMEOUT;
+	fill_attr(&out.attr, nodeid, &st);
+	reply(fd, in->unique, 0, &out, sizeof(out));
+	return;
+
+ out_err:
+	reply(fd, in->unique, err, NULL, 0);
+}
+
+static void do_getattr(int fd, struct fuse_in_header *in)
+{
+	struct fuse_attr_out out;
+	struct stat st;
+	int err;
+
+	err = node_stat(in->nodeid, &st);
+	if (err) {
+		reply(fd, in->unique, err, NULL, 0);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.attr_valid = TIMEOUT;
+	fill_attr(&out.attr, in->nodeid, &st);
+	reply(fd, in->unique, 0, &out, sizeof(out));
+}
+
+static void do_open(int fd, struct fuse_in_header *in, void *arg)
+{
+	struct fuse_open_in *open_in = arg;
+	struct fuse_open_out out;
+	const char *name;
+	int file;
+
+	name = node_name(in->nodeid);
+	if (!name) {
+		reply(fd, in->unique, -EISDIR, NULL, 0);
+		return;
+	}
+
+	file = openat(backing_fd, name,
+		      open_in->flags & ~(O_CREAT | O_EXCL | O_NOCTTY));
+	if (file == -1) {
+		reply(fd, in->unique, -errno, NULL, 0);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.fh = file;
+	out.open_flags = FOPEN_DIRECT_IO;
+	reply(fd, in->unique, 0, &out, sizeof(out));
+}
+
+static void do_read(int fd, struct fuse_in_header *in, void *arg, char *buf)
+{
+	struct fuse_read_in *read_in = arg;
+	size_t size = read_in->size;
+	ssize_t res;
+
+	if (size > BUF_SIZE)
+		size = BUF_SIZE;
+
+	res = pread(read_in->fh, buf, size, read_in->offset);
+	if (res == -1)
+		reply(fd, in->unique, -errno, NULL, 0);
+	else
+		reply(fd, in->unique, 0, buf, res);
+}
+
+static void do_write(int fd, struct fuse_in_header *in, void *arg)
+{
+	struct fuse_write_in *write_in = arg;
+	struct fuse_write_out out;
+	ssize_t res;
+
+	res = pwrite(write_in->fh, write_in + 1, write_in->size,
+		     write_in->offset);
+	if (res == -1) {
+		reply(fd, in->unique, -errno, NULL, 0);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.size = res;
+	reply(fd, in->unique, 0, &out, sizeof(out));
+}
+
+static void do_statfs(int fd, struct fuse_in_header *in)
+{
+	struct fuse_statfs_out out;
+	struct statvfs sv;
+
+	if (fstatvfs(backing_fd, &sv)) {
+		reply(fd, in->unique, -errno, NULL, 0);
+		return;
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.st.blocks = sv.f_blocks;
+	out.st.bfree = sv.f_bfree;
+	out.st.bavail = sv.f_bavail;
+	out.st.files = sv.f_files;
+	out.st.ffree = sv.f_ffree;
+	out.st.bsize = sv.f_bsize;
+	out.st.namelen = sv.f_namemax;
+	out.st.frsize = sv.f_frsize;
+	reply(fd, in->unique, 0, &out, sizeof(out));
+}
+
+static void handle_request(int fd, char *req, char *buf)
+{
+	struct fuse_in_header *in = (struct fuse_in_header *) req;
+	void *arg = in + 1;
+
+	switch (in->opcode) {
+	case FUSE_INIT:
+		do_init(fd, in, arg);
+		break;
+	case FUSE_LOOKUP:
+		do_lookup(fd, in, arg);
+		break;
+	case FUSE_GETATTR:
+		do_getattr(fd, in);
+		break;
+	case FUSE_OPEN:
+		do_open(fd, in, arg);
+		break;
+	case FUSE_READ:
+		do_read(fd, in, arg, buf);
+		break;
+	case FUSE_WRITE:
+		do_write(fd, in, arg);
+		break;
+	case FUSE_STATFS:
+		do_statfs(fd, in);
+		break;
+	case FUSE_RELEASE:
+		close(((struct fuse_release_in *) arg)->fh);
+		reply(fd, in->unique, 0, NULL, 0);
+		break;
+	case FUSE_FSYNC:
+		if (fsync(((struct fuse_fsync_in *) arg)->fh))
+			reply(fd, in->unique, -errno, NULL, 0);
+		else
+			reply(fd, in->unique, 0, NULL, 0);
+		break;
+	case FUSE_FLUSH:
+	case FUSE_DESTROY:
+		reply(fd, in->unique, 0, NULL, 0);
+		break;
+	case FUSE_FORGET:
+	case FUSE_BATCH_FORGET:
+	case FUSE_INTERRUPT:
+		/* no reply */
+		break;
+	default:
+		reply(fd, in->unique, -ENOSYS, NULL, 0);
+		break;
+	}
+}
+
+static int pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *worker_fn(void *data)
+{
+	struct worker *w = data;
+	char *req, *buf;
+	ssize_t res;
+
+	if (w->cpu >= 0)
+		pin_to_cpu(w->cpu);
+
+	req = malloc(BUF_SIZE);
+	buf = malloc(BUF_SIZE);
+	if (!req || !buf) {
+		fprintf(stderr, "fuse-mq-bench: out of memory\n");
+		exit(1);
+	}
+
+	for (;;) {
+		res = read(w->fd, req, BUF_SIZE);
+		if (res == -1) {
+			/* ENOENT: interrupted request */
+			if (errno == EINTR || errno == EAGAIN || errno == ENOENT)
+				continue;
+			/* ENODEV: filesystem unmounted */
+			if (errno != ENODEV)
+				perror("fuse-mq-bench: reading request");
+			break;
+		}
+		if (res < sizeof(struct fuse_in_header)) {
+			fprintf(stderr, "fuse-mq-bench: short read on device\n");
+			break;
+		}
+		handle_request(w->fd, req, buf);
+		w->reqs++;
+	}
+
+	free(req);
+	free(buf);
+	return NULL;
+}
+
+static void *job_fn(void *data)
+{
+	struct job *j = data;
+	unsigned int seed = j->cpu;
+	off_t nblocks = file_size / blksize;
+	char path[PATH_MAX];
+	char *buf;
+	int fd;
+
+	pin_to_cpu(j->cpu);
+
+	snprintf(path, sizeof(path), "%s/%s", mountpoint, bench_file);
+	fd = open(path, O_RDONLY);
+	buf = malloc(blksize);
+	if (fd == -1 || !buf) {
+		perror(path);
+		exit(1);
+	}
+
+	while (!stop) {
+		off_t off = nblocks ? (rand_r(&seed) % nblocks) * blksize : 0;
+
+		if (pread(fd, buf, blksize, off) == -1) {
+			perror("fuse-mq-bench: pread");
+			break;
+		}
+		j->ops++;
+	}
+
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static int clone_dev(int mount_fd, int cpu)
+{
+	struct fuse_dev_clone clone;
+	int fd;
+
+	fd = open("/dev/fuse", O_RDWR);
+	if (fd == -1) {
+		perror("fuse-mq-bench: opening /dev/fuse");
+		return -1;
+	}
+
+	clone.fd = mount_fd;
+	clone.cpu = cpu;
+	if (ioctl(fd, FUSE_DEV_IOC_CLONE_CPU, &clone) == -1) {
+		perror("fuse-mq-bench: FUSE_DEV_IOC_CLONE_CPU");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: fuse-mq-bench [-m] [-j JOBS] [-t SECS] "
+		"[-b BLKSIZE] BACKING_DIR MOUNTPOINT FILE\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int njobs = ncpus, secs = 10, multiqueue = 0;
+	struct worker *workers;
+	struct job *jobs;
+	unsigned long total = 0, reqs = 0;
+	struct timeval start, end;
+	struct stat st;
+	char opts[128];
+	double elapsed;
+	int mount_fd, nworkers, i, c;
+
+	while ((c = getopt(argc, argv, "mj:t:b:")) != -1) {
+		switch (c) {
+		case 'm':
+			multiqueue = 1;
+			break;
+		case 'j':
+			njobs = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'b':
+			blksize = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 3 || njobs <= 0 || secs <= 0 || !blksize ||
+	    blksize > MAX_WRITE)
+		usage();
+
+	mountpoint = argv[optind + 1];
+	bench_file = argv[optind + 2];
+
+	backing_fd = open(argv[optind], O_RDONLY | O_DIRECTORY);
+	if (backing_fd == -1) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (fstatat(backing_fd, bench_file, &st, 0) || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "fuse-mq-bench: %s is not a regular file in %s\n",
+			bench_file, argv[optind]);
+		return 1;
+	}
+	file_size = st.st_size;
+
+	mount_fd = open("/dev/fuse", O_RDWR);
+	if (mount_fd == -1) {
+		perror("fuse-mq-bench: opening /dev/fuse");
+		return 1;
+	}
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0,allow_other",
+		 mount_fd);
+	if (mount("fuse-mq-bench", mountpoint, "fuse", MS_NOSUID | MS_NODEV,
+		  opts)) {
+		perror("fuse-mq-bench: mount");
+		return 1;
+	}
+
+	/*
+	 * One extra thread always serves the device file passed to mount:
+	 * it gets INIT and all requests from CPUs without a bound queue.
+	 */
+	nworkers = njobs + 1;
+	workers = calloc(nworkers, sizeof(*workers));
+	jobs = calloc(njobs, sizeof(*jobs));
+	if (!workers || !jobs) {
+		fprintf(stderr, "fuse-mq-bench: out of memory\n");
+		goto out_umount;
+	}
+
+	workers[0].fd = mount_fd;
+	workers[0].cpu = -1;
+	for (i = 1; i < nworkers; i++) {
+		int cpu = (i - 1) % ncpus;
+
+		workers[i].cpu = cpu;
+		if (!multiqueue) {
+			workers[i].fd = mount_fd;
+			continue;
+		}
+		workers[i].fd = clone_dev(mount_fd,
+					  i <= ncpus ? cpu : FUSE_DEV_CLONE_NOCPU);
+		if (workers[i].fd == -1)
+			goto out_umount;
+	}
+	for (i = 0; i < nworkers; i++)
+		pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < njobs; i++) {
+		jobs[i].cpu = i % ncpus;
+		pthread_create(&jobs[i].thread, NULL, job_fn, &jobs[i]);
+	}
+	sleep(secs);
+	stop = 1;
+	for (i = 0; i < njobs; i++) {
+		pthread_join(jobs[i].thread, NULL);
+		total += jobs[i].ops;
+	}
+	gettimeofday(&end, NULL);
+
+	umount2(mountpoint, MNT_DETACH);
+	for (i = 0; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		reqs += workers[i].reqs;
+		if (workers[i].fd != mount_fd)
+			close(workers[i].fd);
+	}
+	close(mount_fd);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1e6;
+	printf("%s queue, %d jobs, %zu byte reads: %lu ops in %.2fs, "
+	       "%.0f ops/s (%lu requests served)\n",
+	       multiqueue ? "per-CPU" : "single", njobs, blksize, total,
+	       elapsed, total / elapsed, reqs);
+
+	return 0;
+
+ out_umount:
+	umount2(mountpoint, MNT_DETACH);
+	return 1;
+}
@@ -0,0 +1,201 @@
+/*
+ * Count how many epoll wakeups it takes to accept one connection when
+ * several threads, each with its own epoll instance, watch the same
+ * listening socket.
+ *
+ * Usage: epoll_exclusive [threads] [connections]
+ *
+ * The run is done twice, once with plain EPOLLIN and once with
+ * EPOLLIN | EPOLLEXCLUSIVE.  Connections are made one at a time, so that
+ * every one of them is a separate event: without EPOLLEXCLUSIVE each of
+ * them wakes every thread, with it only one thread should wake up.  The
+ * test fails if exclusive mode does not cut the wakeups per accept.
+ *
+ * A woken thread that finds the connection already accepted goes back to
+ * sleep inside epoll_wait() without returning, so wakeups are counted as
+ * the voluntary context switches of the threads rather than as returns
+ * from epoll_wait().
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE	(1 << 28)
+#endif
+
+#define MAX_THREADS	64
+
+static int listen_fd;
+static int stop_fd;
+static unsigned long wakeups;
+static unsigned long accepts;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static long nvcsw(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_THREAD, &ru))
+		die("getrusage");
+	return ru.ru_nvcsw;
+}
+
+static void *worker(void *arg)
+{
+	int epfd = (long)arg;
+	struct epoll_event ev;
+	long start = nvcsw();
+	int fd;
+
+	for (;;) {
+		if (epoll_wait(epfd, &ev, 1, -1) <= 0)
+			continue;
+		if (ev.data.fd == stop_fd)
+			break;
+
+		fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+		if (fd >= 0) {
+			__sync_fetch_and_add(&accepts, 1);
+			close(fd);
+		}
+	}
+
+	/* every sleep was ended by a wakeup, the last one by stop_fd */
+	__sync_fetch_and_add(&wakeups, nvcsw() - start - 1);
+	close(epfd);
+	return NULL;
+}
+
+/* Returns wakeups per accepted connection, or a negative value if the
+ * epoll flags are not supported.
+ */
+static double run(int nthreads, int nconn, unsigned int events,
+		  struct sockaddr_in *addr)
+{
+	pthread_t threads[MAX_THREADS];
+	struct epoll_event ev;
+	struct timespec ts = { 0, 1000000 };
+	int i, fd, epfd, waited;
+
+	wakeups = accepts = 0;
+	stop_fd = eventfd(0, EFD_NONBLOCK);
+	if (stop_fd < 0)
+		die("eventfd");
+
+	for (i = 0; i < nthreads; i++) {
+		epfd = epoll_create1(0);
+		if (epfd < 0)
+			die("epoll_create1");
+		memset(&ev, 0, sizeof(ev));
+		ev.events = events;
+		ev.data.fd = listen_fd;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev)) {
+			if (errno == EINVAL && i == 0) {
+				close(epfd);
+				close(stop_fd);
+				return -1;
+			}
+			die("epoll_ctl");
+		}
+		ev.events = EPOLLIN;
+		ev.data.fd = stop_fd;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, stop_fd, &ev))
+			die("epoll_ctl");
+		if (pthread_create(&threads[i], NULL, worker, (void *)(long)epfd))
+			die("pthread_create");
+	}
+
+	/* let every thread go to sleep in epoll_wait() */
+	sleep(1);
+
+	for (i = 0; i < nconn; i++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			die("socket");
+		if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)))
+			die("connect");
+		for (waited = 0; accepts <= (unsigned long)i && waited < 1000;
+		     waited++)
+			nanosleep(&ts, NULL);
+		close(fd);
+		/* give woken threads time to go back to sleep */
+		nanosleep(&ts, NULL);
+	}
+
+	if (eventfd_write(stop_fd, 1))
+		die("eventfd_write");
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	close(stop_fd);
+
+	if (!accepts)
+		return 0;
+	return (double)wakeups / accepts;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int nthreads = 8, nconn = 200;
+	double shared, exclusive;
+
+	if (argc > 1)
+		nthreads = atoi(argv[1]);
+	if (argc > 2)
+		nconn = atoi(argv[2]);
+	if (nthreads < 2 || nthreads > MAX_THREADS || nconn < 1) {
+		fprintf(stderr, "usage: %s [threads (2-%d)] [connections]\n",
+			argv[0], MAX_THREADS);
+		return 1;
+	}
+
+	listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (listen_fd < 0)
+		die("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)))
+		die("bind");
+	if (getsockname(listen_fd, (struct sockaddr *)&addr, &len))
+		die("getsockname");
+	if (listen(listen_fd, 1024))
+		die("listen");
+
+	shared = run(nthreads, nconn, EPOLLIN, &addr);
+	printf("epoll_exclusive: %d threads, shared: %.2f wakeups/accept\n",
+	       nthreads, shared);
+
+	exclusive = run(nthreads, nconn, EPOLLIN | EPOLLEXCLUSIVE, &addr);
+	if (exclusive < 0) {
+		printf("epoll_exclusive: EPOLLEXCLUSIVE not supported, skipping\n");
+		return 0;
+	}
+	printf("epoll_exclusive: %d threads, exclusive: %.2f wakeups/accept\n",
+	       nthreads, exclusive);
+
+	if (exclusive >= shared) {
+		printf("epoll_exclusive: [FAIL]\n");
+		return 1;
+	}
+	printf("epoll_exclusive: [PASS]\n");
+	return 0;
+}
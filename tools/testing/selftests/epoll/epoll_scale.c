@@ -0,0 +1,149 @@
+/*
+ * Measure how many events per second a single epoll instance delivers
+ * when it is shared by a growing number of threads.
+ *
+ * Usage: epoll_scale [seconds] [max-threads] [fds]
+ *
+ * All the eventfds are registered edge triggered in one epoll set, which
+ * is the usual layout of an event loop served by a pool of threads.  For
+ * every waiter thread there is a writer thread that keeps signalling
+ * eventfds picked at random, so ready events arrive from several CPUs at
+ * once while the waiters collect them in batches.  Each delivered event
+ * is consumed by reading the eventfd.  The run is repeated for 1, 2, 4,
+ * ... waiters up to max-threads; any serialisation of the ready list shows
+ * up as a rate that stops growing with the number of threads.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define MAX_THREADS	64
+#define BATCH		64
+
+static int epfd;
+static int *fds;
+static int nfds;
+static volatile int stop;
+static unsigned long events;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void *waiter(void *arg)
+{
+	struct epoll_event ev[BATCH];
+	unsigned long count = 0;
+	uint64_t val;
+	int i, n;
+
+	while (!stop) {
+		n = epoll_wait(epfd, ev, BATCH, 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die("epoll_wait");
+		}
+		for (i = 0; i < n; i++) {
+			if (read(ev[i].data.fd, &val, sizeof(val)) == sizeof(val))
+				count++;
+		}
+	}
+
+	__sync_fetch_and_add(&events, count);
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	unsigned int seed = (unsigned long)arg;
+
+	while (!stop) {
+		if (eventfd_write(fds[rand_r(&seed) % nfds], 1))
+			die("eventfd_write");
+	}
+	return NULL;
+}
+
+static unsigned long run(int nthreads, int secs)
+{
+	pthread_t threads[2 * MAX_THREADS];
+	uint64_t val;
+	int i;
+
+	/* start with every eventfd idle */
+	for (i = 0; i < nfds; i++)
+		while (read(fds[i], &val, sizeof(val)) > 0)
+			;
+
+	stop = 0;
+	events = 0;
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[2 * i], NULL, waiter, NULL) ||
+		    pthread_create(&threads[2 * i + 1], NULL, writer,
+				   (void *)(long)(i + 1)))
+			die("pthread_create");
+	}
+
+	sleep(secs);
+	stop = 1;
+
+	for (i = 0; i < 2 * nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	return events / secs;
+}
+
+int main(int argc, char **argv)
+{
+	struct epoll_event ev;
+	int secs = 2, max_threads, i;
+
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN) / 2;
+	nfds = 1024;
+	if (argc > 1)
+		secs = atoi(argv[1]);
+	if (argc > 2)
+		max_threads = atoi(argv[2]);
+	if (argc > 3)
+		nfds = atoi(argv[3]);
+	if (max_threads < 1)
+		max_threads = 1;
+	if (secs < 1 || max_threads > MAX_THREADS || nfds < 1) {
+		fprintf(stderr, "usage: %s [seconds] [max-threads (1-%d)] [fds]\n",
+			argv[0], MAX_THREADS);
+		return 1;
+	}
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		die("epoll_create1");
+	fds = calloc(nfds, sizeof(*fds));
+	if (!fds)
+		die("calloc");
+	for (i = 0; i < nfds; i++) {
+		fds[i] = eventfd(0, EFD_NONBLOCK);
+		if (fds[i] < 0)
+			die("eventfd");
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.fd = fds[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev))
+			die("epoll_ctl");
+	}
+
+	for (i = 1; i <= max_threads; i *= 2)
+		printf("epoll_scale: %d threads, %d fds: %lu events/s\n",
+		       i, nfds, run(i, secs));
+
+	return 0;
+}
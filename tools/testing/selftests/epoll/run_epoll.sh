@@ -0,0 +1,8 @@
+#!/bin/bash
+#
+# Driver for the epoll selftests.
+
+cd $(dirname $0)
+
+./epoll_exclusive
+./epoll_scale
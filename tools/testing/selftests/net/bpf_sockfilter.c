@@ -0,0 +1,334 @@
+/*
+ * Load an eBPF socket filter that counts packets per IP protocol in a
+ * hash map, attach it to a loopback UDP socket with SO_ATTACH_BPF and
+ * check the count user space reads back with bpf(BPF_MAP_LOOKUP_ELEM).
+ *
+ * Also checks that the verifier rejects a program that reads an
+ * uninitialized register or dereferences a map lookup result without
+ * a NULL check, and exercises the array map from user space.
+ */
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/filter.h>
+
+#ifndef SO_ATTACH_BPF
+#define SO_ATTACH_BPF		44
+#endif
+#ifndef __NR_bpf
+# if defined(__x86_64__)
+#  define __NR_bpf		321
+# elif defined(__i386__)
+#  define __NR_bpf		357
+# elif defined(__arm__)
+#  define __NR_bpf		386
+# else
+#  define __NR_bpf		280
+# endif
+#endif
+
+/* The eBPF user ABI from include/linux/bpf.h */
+#define BPF_ALU64		0x07
+#define BPF_DW			0x18
+#define BPF_XADD		0xc0
+#define BPF_MOV			0xb0
+#define BPF_JNE			0x50
+#define BPF_CALL		0x80
+#define BPF_EXIT		0x90
+
+enum { BPF_MAP_CREATE, BPF_MAP_LOOKUP_ELEM, BPF_MAP_UPDATE_ELEM,
+       BPF_MAP_DELETE_ELEM, BPF_MAP_GET_NEXT_KEY, BPF_PROG_LOAD };
+enum { BPF_MAP_TYPE_UNSPEC, BPF_MAP_TYPE_HASH, BPF_MAP_TYPE_ARRAY };
+enum { BPF_PROG_TYPE_UNSPEC, BPF_PROG_TYPE_SOCKET_FILTER };
+enum { BPF_FUNC_unspec, BPF_FUNC_map_lookup_elem, BPF_FUNC_map_update_elem };
+
+#define BPF_PSEUDO_MAP_FD	1
+#define BPF_ANY			0
+
+struct bpf_insn {
+	uint8_t code;
+	uint8_t dst_reg:4;
+	uint8_t src_reg:4;
+	int16_t off;
+	int32_t imm;
+};
+
+union bpf_attr {
+	struct {
+		uint32_t map_type;
+		uint32_t key_size;
+		uint32_t value_size;
+		uint32_t max_entries;
+	};
+	struct {
+		uint32_t map_fd;
+		uint64_t key __attribute__((aligned(8)));
+		uint64_t value __attribute__((aligned(8)));
+		uint64_t flags;
+	};
+	struct {
+		uint32_t prog_type;
+		uint32_t insn_cnt;
+		uint64_t insns __attribute__((aligned(8)));
+		uint64_t license __attribute__((aligned(8)));
+		uint32_t log_level;
+		uint32_t log_size;
+		uint64_t log_buf __attribute__((aligned(8)));
+	};
+} __attribute__((aligned(8)));
+
+#define INSN(CODE, DST, SRC, OFF, IMM)					\
+	((struct bpf_insn) { .code = CODE, .dst_reg = DST, .src_reg = SRC, \
+			     .off = OFF, .imm = IMM })
+#define MOV64_REG(DST, SRC)	INSN(BPF_ALU64 | BPF_MOV | BPF_X, DST, SRC, 0, 0)
+#define MOV64_IMM(DST, IMM)	INSN(BPF_ALU64 | BPF_MOV | BPF_K, DST, 0, 0, IMM)
+#define ADD64_IMM(DST, IMM)	INSN(BPF_ALU64 | BPF_ADD | BPF_K, DST, 0, 0, IMM)
+#define LD_MAP_FD(DST, FD)						\
+	INSN(BPF_LD | BPF_DW | BPF_IMM, DST, BPF_PSEUDO_MAP_FD, 0, FD),	\
+	INSN(0, 0, 0, 0, 0)
+#define LD_ABS_B(OFF)		INSN(BPF_LD | BPF_B | BPF_ABS, 0, 0, 0, OFF)
+#define STX_MEM(SZ, DST, SRC, OFF) INSN(BPF_STX | SZ | BPF_MEM, DST, SRC, OFF, 0)
+#define ST_MEM(SZ, DST, OFF, IMM) INSN(BPF_ST | SZ | BPF_MEM, DST, 0, OFF, IMM)
+#define LDX_MEM(SZ, DST, SRC, OFF) INSN(BPF_LDX | SZ | BPF_MEM, DST, SRC, OFF, 0)
+#define XADD64(DST, SRC, OFF)	INSN(BPF_STX | BPF_DW | BPF_XADD, DST, SRC, OFF, 0)
+#define JEQ_IMM(DST, IMM, OFF)	INSN(BPF_JMP | BPF_JEQ | BPF_K, DST, 0, OFF, IMM)
+#define JA(OFF)			INSN(BPF_JMP | BPF_JA, 0, 0, OFF, 0)
+#define CALL(FUNC)		INSN(BPF_JMP | BPF_CALL, 0, 0, 0, FUNC)
+#define EXIT()			INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+#define NR_PACKETS	100
+
+static char log_buf[65536];
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static int sys_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int map_create(int type, int key_size, int value_size, int entries)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = type;
+	attr.key_size = key_size;
+	attr.value_size = value_size;
+	attr.max_entries = entries;
+	return sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+static int map_op(int cmd, int fd, void *key, void *value, uint64_t flags)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = fd;
+	attr.key = (unsigned long)key;
+	attr.value = (unsigned long)value;
+	attr.flags = flags;
+	return sys_bpf(cmd, &attr);
+}
+
+static int prog_load(const struct bpf_insn *insns, int cnt)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+	attr.insns = (unsigned long)insns;
+	attr.insn_cnt = cnt;
+	attr.license = (unsigned long)"GPL";
+	attr.log_buf = (unsigned long)log_buf;
+	attr.log_size = sizeof(log_buf);
+	attr.log_level = 1;
+	log_buf[0] = 0;
+	return sys_bpf(BPF_PROG_LOAD, &attr);
+}
+
+static void test_verifier_rejects(int map_fd)
+{
+	struct bpf_insn uninit[] = {
+		MOV64_REG(0, 2),
+		EXIT(),
+	};
+	struct bpf_insn no_null_check[] = {
+		ST_MEM(BPF_W, 10, -4, 0),
+		MOV64_REG(2, 10),
+		ADD64_IMM(2, -4),
+		LD_MAP_FD(1, map_fd),
+		CALL(BPF_FUNC_map_lookup_elem),
+		LDX_MEM(BPF_DW, 0, 0, 0),
+		EXIT(),
+	};
+
+	if (prog_load(uninit, sizeof(uninit) / sizeof(uninit[0])) != -1 ||
+	    errno != EACCES) {
+		fprintf(stderr, "uninitialized register read was not rejected\n");
+		exit(1);
+	}
+	if (!log_buf[0]) {
+		fprintf(stderr, "verifier log is empty\n");
+		exit(1);
+	}
+	if (prog_load(no_null_check,
+		      sizeof(no_null_check) / sizeof(no_null_check[0])) != -1 ||
+	    errno != EACCES) {
+		fprintf(stderr, "unchecked map value access was not rejected\n");
+		exit(1);
+	}
+}
+
+static void test_array_map(void)
+{
+	uint32_t key;
+	uint64_t value;
+	int fd;
+
+	fd = map_create(BPF_MAP_TYPE_ARRAY, sizeof(key), sizeof(value), 4);
+	if (fd == -1)
+		die("array map create");
+
+	key = 1;
+	value = 42;
+	if (map_op(BPF_MAP_UPDATE_ELEM, fd, &key, &value, BPF_ANY))
+		die("array map update");
+	value = 0;
+	if (map_op(BPF_MAP_LOOKUP_ELEM, fd, &key, &value, 0) || value != 42) {
+		fprintf(stderr, "array map lookup returned %llu\n",
+			(unsigned long long)value);
+		exit(1);
+	}
+	if (map_op(BPF_MAP_DELETE_ELEM, fd, &key, NULL, 0) != -1 ||
+	    errno != EINVAL) {
+		fprintf(stderr, "array map element was deleted\n");
+		exit(1);
+	}
+	key = 4;
+	if (map_op(BPF_MAP_UPDATE_ELEM, fd, &key, &value, BPF_ANY) != -1 ||
+	    errno != E2BIG) {
+		fprintf(stderr, "array map update out of range succeeded\n");
+		exit(1);
+	}
+	close(fd);
+}
+
+int main(void)
+{
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	uint32_t key, next_key;
+	uint64_t count;
+	int map_fd, prog_fd, tx, rx, i, nkeys;
+	char pkt[64];
+
+	map_fd = map_create(BPF_MAP_TYPE_HASH, sizeof(key), sizeof(count), 256);
+	if (map_fd == -1) {
+		if (errno == ENOSYS || errno == EPERM) {
+			printf("bpf_sockfilter: bpf() not available, skipping\n");
+			return 0;
+		}
+		die("hash map create");
+	}
+
+	/* count[ip->protocol]++ and accept the whole packet */
+	struct bpf_insn prog[] = {
+		MOV64_REG(6, 1),
+		LD_ABS_B(SKF_NET_OFF + 9),
+		STX_MEM(BPF_W, 10, 0, -4),
+		MOV64_REG(2, 10),
+		ADD64_IMM(2, -4),
+		LD_MAP_FD(1, map_fd),
+		CALL(BPF_FUNC_map_lookup_elem),
+		JEQ_IMM(0, 0, 3),
+		MOV64_IMM(1, 1),
+		XADD64(0, 1, 0),
+		JA(9),
+		/* first packet of this protocol */
+		ST_MEM(BPF_DW, 10, -16, 1),
+		LD_MAP_FD(1, map_fd),
+		MOV64_REG(2, 10),
+		ADD64_IMM(2, -4),
+		MOV64_REG(3, 10),
+		ADD64_IMM(3, -16),
+		MOV64_IMM(4, BPF_ANY),
+		CALL(BPF_FUNC_map_update_elem),
+		MOV64_IMM(0, -1),
+		EXIT(),
+	};
+
+	prog_fd = prog_load(prog, sizeof(prog) / sizeof(prog[0]));
+	if (prog_fd == -1) {
+		fprintf(stderr, "%s", log_buf);
+		die("prog load");
+	}
+
+	rx = socket(AF_INET, SOCK_DGRAM, 0);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rx == -1 || tx == -1)
+		die("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(rx, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(rx, (struct sockaddr *)&addr, &alen))
+		die("bind");
+	if (setsockopt(rx, SOL_SOCKET, SO_ATTACH_BPF, &prog_fd, sizeof(prog_fd)))
+		die("setsockopt SO_ATTACH_BPF");
+
+	memset(pkt, 0xaa, sizeof(pkt));
+	for (i = 0; i < NR_PACKETS; i++) {
+		if (sendto(tx, pkt, sizeof(pkt), 0, (struct sockaddr *)&addr,
+			   sizeof(addr)) != sizeof(pkt))
+			die("sendto");
+		if (recv(rx, pkt, sizeof(pkt), 0) != sizeof(pkt))
+			die("recv");
+	}
+
+	key = IPPROTO_UDP;
+	if (map_op(BPF_MAP_LOOKUP_ELEM, map_fd, &key, &count, 0))
+		die("hash map lookup");
+	if (count != NR_PACKETS) {
+		fprintf(stderr, "bpf_sockfilter: counted %llu of %d packets\n",
+			(unsigned long long)count, NR_PACKETS);
+		return 1;
+	}
+
+	/* the only key should be the UDP protocol */
+	key = -1;
+	nkeys = 0;
+	while (map_op(BPF_MAP_GET_NEXT_KEY, map_fd, &key, &next_key, 0) == 0) {
+		if (next_key != IPPROTO_UDP) {
+			fprintf(stderr, "unexpected key %u\n", next_key);
+			return 1;
+		}
+		key = next_key;
+		nkeys++;
+	}
+	if (nkeys != 1) {
+		fprintf(stderr, "found %d keys\n", nkeys);
+		return 1;
+	}
+
+	test_verifier_rejects(map_fd);
+	test_array_map();
+
+	printf("bpf_sockfilter: %llu packets counted [PASS]\n",
+	       (unsigned long long)count);
+	close(rx);
+	close(tx);
+	close(prog_fd);
+	close(map_fd);
+	return 0;
+}
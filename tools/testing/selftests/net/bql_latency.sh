@@ -0,0 +1,63 @@
+#!/bin/bash
+#
+# Measure round-trip latency through a loaded transmit queue with and
+# without byte queue limits.
+#
+# Usage: bql_latency.sh <iface> <peer-address> [seconds]
+#
+# A bulk TCP stream (iperf, or netperf if iperf is missing) is sent to
+# <peer-address> while ping measures the latency of small packets queued
+# behind it.  BQL is "disabled" by pinning limit_min of every tx queue of
+# <iface> to the maximum DQL limit, which is what the driver would see
+# without accounting.  Run as root; the peer must run an iperf/netperf
+# server.
+
+IFACE=$1
+PEER=$2
+SECS=${3:-10}
+DQL_MAX_LIMIT=1879048192	# (UINT_MAX / 2) - DQL_MAX_OBJECT
+
+if [ -z "$IFACE" -o -z "$PEER" ]; then
+	echo "usage: $0 <iface> <peer-address> [seconds]"
+	exit 1
+fi
+
+QUEUES=$(ls -d /sys/class/net/$IFACE/queues/tx-*/byte_queue_limits 2>/dev/null)
+if [ -z "$QUEUES" ]; then
+	echo "$IFACE: no byte_queue_limits in sysfs (CONFIG_BQL=n?), skipping"
+	exit 0
+fi
+
+if which iperf >/dev/null 2>&1; then
+	LOAD="iperf -c $PEER -t $((SECS + 2)) -P 4"
+elif which netperf >/dev/null 2>&1; then
+	LOAD="netperf -H $PEER -l $((SECS + 2)) -t TCP_STREAM"
+else
+	echo "neither iperf nor netperf found, skipping"
+	exit 0
+fi
+
+set_limit_min()
+{
+	for q in $QUEUES; do
+		echo $1 > $q/limit_min || exit 1
+	done
+}
+
+run()
+{
+	$LOAD >/dev/null 2>&1 &
+	load=$!
+	sleep 1
+	rtt=$(ping -q -i 0.05 -w $SECS $PEER | sed -n 's|^rtt.* = \(.*\) ms$|\1|p')
+	wait $load
+	echo "$1: rtt min/avg/max/mdev = $rtt ms"
+}
+
+saved=$(cat $(echo $QUEUES | cut -d' ' -f1)/limit_min)
+trap "set_limit_min $saved" EXIT
+
+set_limit_min $DQL_MAX_LIMIT
+run "without BQL"
+set_limit_min 0
+run "with BQL   "
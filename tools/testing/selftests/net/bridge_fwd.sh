@@ -0,0 +1,94 @@
+#!/bin/bash
+#
+# Measure how many packets per second a bridge forwards between two veth
+# ports.
+#
+# Usage: bridge_fwd.sh [seconds] [max-senders]
+#
+# A sender and a receiver namespace are each joined by a veth pair to a
+# bridge in a third namespace.  ct_flood in the sender namespace sends
+# small UDP packets to the receiver through the bridge, so that every
+# packet goes through fdb learning on the ingress port and an fdb lookup
+# for the egress port.  veth hands packets to the peer on the sending
+# CPU, so with several senders the bridge runs on several CPUs at once
+# and any serialisation in the fdb shows up as a rate that stops growing
+# with the number of senders.  The rate is taken from the receive
+# counter of the receiving veth.  Run as root.
+
+SECS=${1:-5}
+MAX_SENDERS=${2:-$(grep -c ^processor /proc/cpuinfo)}
+NS_TX=br_fwd_tx
+NS_BR=br_fwd_br
+NS_RX=br_fwd_rx
+
+cd $(dirname $0)
+
+if [ $(id -u) -ne 0 ]; then
+	echo "bridge_fwd: must be run as root, skipping"
+	exit 0
+fi
+if ! which ip >/dev/null 2>&1; then
+	echo "bridge_fwd: ip not found, skipping"
+	exit 0
+fi
+if [ ! -x ./ct_flood ]; then
+	echo "bridge_fwd: ct_flood not built, skipping"
+	exit 0
+fi
+
+cleanup()
+{
+	ip netns del $NS_TX 2>/dev/null
+	ip netns del $NS_BR 2>/dev/null
+	ip netns del $NS_RX 2>/dev/null
+}
+trap cleanup EXIT
+
+ip netns add $NS_TX || exit 1
+ip netns add $NS_BR || exit 1
+ip netns add $NS_RX || exit 1
+ip link add br_veth0 type veth peer name br_veth1 || exit 1
+ip link add br_veth2 type veth peer name br_veth3 || exit 1
+ip link set br_veth0 netns $NS_TX
+ip link set br_veth1 netns $NS_BR
+ip link set br_veth2 netns $NS_BR
+ip link set br_veth3 netns $NS_RX
+
+if ! ip netns exec $NS_BR ip link add br_fwd0 type bridge; then
+	echo "bridge_fwd: bridge not available, skipping"
+	exit 0
+fi
+ip netns exec $NS_BR ip link set br_veth1 master br_fwd0
+ip netns exec $NS_BR ip link set br_veth2 master br_fwd0
+ip netns exec $NS_BR ip link set br_veth1 up
+ip netns exec $NS_BR ip link set br_veth2 up
+ip netns exec $NS_BR ip link set br_fwd0 up
+
+ip netns exec $NS_TX ip addr add 10.98.0.1/24 dev br_veth0
+ip netns exec $NS_RX ip addr add 10.98.0.2/24 dev br_veth3
+ip netns exec $NS_TX ip link set br_veth0 up
+ip netns exec $NS_RX ip link set br_veth3 up
+
+# Wait for the bridge ports to reach the forwarding state.
+i=0
+while ! ip netns exec $NS_TX ping -c 1 -W 1 10.98.0.2 >/dev/null; do
+	i=$((i + 1))
+	if [ $i -ge 30 ]; then
+		echo "bridge_fwd: no connectivity through the bridge"
+		exit 1
+	fi
+done
+
+rx_packets()
+{
+	ip netns exec $NS_RX cat /sys/class/net/br_veth3/statistics/rx_packets
+}
+
+n=1
+while [ $n -le $MAX_SENDERS ]; do
+	before=$(rx_packets)
+	ip netns exec $NS_TX ./ct_flood 10.98.0.2 $SECS $n >/dev/null
+	after=$(rx_packets)
+	echo "bridge_fwd: $n senders: $(((after - before) / SECS)) forwarded packets/s"
+	n=$((n * 2))
+done
@@ -0,0 +1,103 @@
+#!/bin/bash
+#
+# Measure how many new connections per second conntrack can set up.
+#
+# Usage: conntrack_rate.sh [seconds] [max-senders]
+#
+# Two network namespaces are joined by a veth pair.  ct_flood in the
+# first one sends UDP packets with a new port pair each time to the
+# second one, where a conntrack match forces an entry to be created and
+# confirmed for every packet.  veth hands packets to the peer on the
+# sending CPU, so with several senders the connection setup runs on
+# several CPUs at once and any serialisation in conntrack shows up as a
+# rate that stops growing with the number of senders.  The rate is
+# taken from the insert counter in /proc/net/stat/nf_conntrack of the
+# receiving namespace.  Run as root.
+
+SECS=${1:-5}
+MAX_SENDERS=${2:-$(grep -c ^processor /proc/cpuinfo)}
+NS_TX=ct_rate_tx
+NS_RX=ct_rate_rx
+CT_MAX=/proc/sys/net/netfilter/nf_conntrack_max
+UDP_TIMEOUT=/proc/sys/net/netfilter/nf_conntrack_udp_timeout
+
+cd $(dirname $0)
+
+if [ $(id -u) -ne 0 ]; then
+	echo "conntrack_rate: must be run as root, skipping"
+	exit 0
+fi
+for tool in ip iptables; do
+	if ! which $tool >/dev/null 2>&1; then
+		echo "conntrack_rate: $tool not found, skipping"
+		exit 0
+	fi
+done
+if [ ! -x ./ct_flood ]; then
+	echo "conntrack_rate: ct_flood not built, skipping"
+	exit 0
+fi
+
+cleanup()
+{
+	ip netns del $NS_TX 2>/dev/null
+	ip netns del $NS_RX 2>/dev/null
+	[ -n "$saved_max" ] && echo $saved_max > $CT_MAX
+	[ -n "$saved_timeout" ] && echo $saved_timeout > $UDP_TIMEOUT
+}
+trap cleanup EXIT
+
+ip netns add $NS_TX || exit 1
+ip netns add $NS_RX || exit 1
+ip link add ct_veth0 type veth peer name ct_veth1 || exit 1
+ip link set ct_veth0 netns $NS_TX
+ip link set ct_veth1 netns $NS_RX
+ip netns exec $NS_TX ip addr add 10.99.0.1/24 dev ct_veth0
+ip netns exec $NS_RX ip addr add 10.99.0.2/24 dev ct_veth1
+ip netns exec $NS_TX ip link set ct_veth0 up
+ip netns exec $NS_RX ip link set ct_veth1 up
+ip netns exec $NS_TX ip link set lo up
+ip netns exec $NS_RX ip link set lo up
+
+# Only the receiver should track; keep the sender stateless.
+ip netns exec $NS_TX iptables -t raw -A OUTPUT -j NOTRACK || exit 1
+ip netns exec $NS_RX iptables -A INPUT -m conntrack --ctstate NEW -j ACCEPT \
+	|| exit 1
+# No ICMP port unreachable storm back to the sender.
+ip netns exec $NS_RX iptables -A OUTPUT -p icmp -j DROP
+
+if [ ! -f $CT_MAX ]; then
+	echo "conntrack_rate: nf_conntrack not loaded, skipping"
+	exit 0
+fi
+saved_max=$(cat $CT_MAX)
+saved_timeout=$(cat $UDP_TIMEOUT)
+# Keep the table from filling up so that early_drop stays out of it.
+echo 4194304 > $CT_MAX
+echo 1 > $UDP_TIMEOUT
+
+# Sum of the hex "insert" column (9th) over all CPUs.
+inserts()
+{
+	local sum=0 v
+
+	for v in $(ip netns exec $NS_RX awk 'NR > 1 { print $9 }' \
+		   /proc/net/stat/nf_conntrack); do
+		sum=$((sum + 16#$v))
+	done
+	echo $sum
+}
+
+# Warm up ARP and the conntrack module.
+ip netns exec $NS_TX ping -c 1 -W 1 10.99.0.2 >/dev/null
+
+n=1
+while [ $n -le $MAX_SENDERS ]; do
+	before=$(inserts)
+	ip netns exec $NS_TX ./ct_flood 10.99.0.2 $SECS $n >/dev/null
+	after=$(inserts)
+	echo "conntrack_rate: $n senders: $(((after - before) / SECS)) new connections/s"
+	n=$((n * 2))
+	# let the entries of the previous run time out
+	sleep 2
+done
@@ -0,0 +1,125 @@
+/*
+ * Send small UDP packets to an address, each with a port pair that has
+ * not been used recently, so that a stateful firewall on the receiving
+ * side has to set up a new connection for every packet.
+ *
+ * Usage: ct_flood <ipv4-address> [seconds] [senders]
+ *
+ * Every sender is a separate process on its own socket and walks all
+ * destination ports; once it has gone round it reopens the socket to
+ * get a fresh source port.  The total number of packets sent and the
+ * resulting rate are printed at the end.
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_SENDERS	256
+
+static volatile sig_atomic_t stop;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void on_alarm(int sig)
+{
+	stop = 1;
+}
+
+static unsigned long sender(struct sockaddr_in *dst)
+{
+	unsigned long sent = 0;
+	unsigned int port;
+	char payload[16] = "ct_flood";
+	int fd = -1;
+
+	while (!stop) {
+		if (fd >= 0)
+			close(fd);
+		fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (fd < 0)
+			die("socket");
+
+		for (port = 1; port < 65536 && !stop; port++) {
+			dst->sin_port = htons(port);
+			if (sendto(fd, payload, sizeof(payload), 0,
+				   (struct sockaddr *)dst, sizeof(*dst)) < 0)
+				continue;	/* ENOBUFS or ICMP errors */
+			sent++;
+		}
+	}
+	close(fd);
+	return sent;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in dst;
+	struct timespec start, end;
+	unsigned long total = 0, sent;
+	int seconds = 10, nr = 1, i, pfd[2];
+	double elapsed;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <ipv4-address> [seconds] [senders]\n",
+			argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		seconds = atoi(argv[2]);
+	if (argc > 3)
+		nr = atoi(argv[3]);
+	if (nr < 1 || nr > MAX_SENDERS || seconds < 1) {
+		fprintf(stderr, "bad senders or seconds\n");
+		return 1;
+	}
+
+	memset(&dst, 0, sizeof(dst));
+	dst.sin_family = AF_INET;
+	if (inet_pton(AF_INET, argv[1], &dst.sin_addr) != 1) {
+		fprintf(stderr, "bad address %s\n", argv[1]);
+		return 1;
+	}
+
+	if (pipe(pfd))
+		die("pipe");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr; i++) {
+		switch (fork()) {
+		case -1:
+			die("fork");
+		case 0:
+			close(pfd[0]);
+			signal(SIGALRM, on_alarm);
+			alarm(seconds);
+			sent = sender(&dst);
+			if (write(pfd[1], &sent, sizeof(sent)) != sizeof(sent))
+				die("write");
+			exit(0);
+		}
+	}
+	close(pfd[1]);
+
+	while (read(pfd[0], &sent, sizeof(sent)) == sizeof(sent))
+		total += sent;
+	while (wait(NULL) > 0)
+		;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("ct_flood: %d senders, %lu packets in %.2fs, %.0f pkts/s\n",
+	       nr, total, elapsed, total / elapsed);
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Send data over a loopback TCP connection with MSG_ZEROCOPY and check
+ * that every send is acknowledged exactly once on the error queue.
+ *
+ * Loopback hands packets to the receiver, so the kernel copies them and
+ * the notifications carry SO_EE_CODE_ZEROCOPY_COPIED; the id accounting
+ * is the same as on a real device.
+ */
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY		43
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY		0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY	5
+#endif
+
+#define NR_SENDS	1000
+#define SEND_SIZE	(64 * 1024)
+
+static char buf[SEND_SIZE];
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* Returns the number of sends completed by the notifications read */
+static unsigned int read_notifications(int fd, unsigned int *next)
+{
+	struct sock_extended_err *serr;
+	char control[128];
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	unsigned int done = 0;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+			if (errno == EAGAIN)
+				return done;
+			die("recvmsg errqueue");
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR)
+				continue;
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+			    serr->ee_errno != 0) {
+				fprintf(stderr, "unexpected notification\n");
+				exit(1);
+			}
+			if (serr->ee_info != *next || serr->ee_data < serr->ee_info) {
+				fprintf(stderr, "bad range %u-%u, expected %u\n",
+					serr->ee_info, serr->ee_data, *next);
+				exit(1);
+			}
+			done += serr->ee_data - serr->ee_info + 1;
+			*next = serr->ee_data + 1;
+		}
+	}
+}
+
+int main(void)
+{
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	unsigned int next = 0, completed = 0;
+	int lfd, tx, rx, one = 1, i;
+	struct pollfd pfd;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd == -1)
+		die("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(lfd, 1) ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &alen))
+		die("listen");
+
+	tx = socket(AF_INET, SOCK_STREAM, 0);
+	if (tx == -1)
+		die("socket");
+	if (setsockopt(tx, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))) {
+		if (errno == ENOPROTOOPT) {
+			printf("msg_zerocopy: SO_ZEROCOPY not supported, skipping\n");
+			return 0;
+		}
+		die("setsockopt SO_ZEROCOPY");
+	}
+	if (connect(tx, (struct sockaddr *)&addr, sizeof(addr)))
+		die("connect");
+	rx = accept(lfd, NULL, NULL);
+	if (rx == -1)
+		die("accept");
+
+	for (i = 0; i < NR_SENDS; i++) {
+		char sink[SEND_SIZE];
+		ssize_t ret;
+
+		ret = send(tx, buf, sizeof(buf), MSG_ZEROCOPY);
+		if (ret != sizeof(buf))
+			die("send");
+		while (ret > 0) {
+			ssize_t r = recv(rx, sink, ret, 0);
+
+			if (r <= 0)
+				die("recv");
+			ret -= r;
+		}
+		completed += read_notifications(tx, &next);
+	}
+
+	pfd.fd = tx;
+	pfd.events = 0;
+	while (completed < NR_SENDS) {
+		if (poll(&pfd, 1, 1000) != 1 || !(pfd.revents & POLLERR)) {
+			fprintf(stderr, "msg_zerocopy: %u of %u sends completed\n",
+				completed, NR_SENDS);
+			return 1;
+		}
+		completed += read_notifications(tx, &next);
+	}
+
+	printf("msg_zerocopy: %u sends completed [PASS]\n", completed);
+	close(rx);
+	close(tx);
+	close(lfd);
+	return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+#
+# Driver for the net selftests.  Benchmarks which need a peer or a
+# particular device take their arguments from the environment and are
+# skipped when those are not set.
+
+cd $(dirname $0)
+
+./msg_zerocopy
+./bpf_sockfilter
+./conntrack_rate.sh
+./bridge_fwd.sh
+
+if [ -n "$BQL_IFACE" -a -n "$BQL_PEER" ]; then
+	./bql_latency.sh $BQL_IFACE $BQL_PEER
+else
+	echo "bql_latency: set BQL_IFACE and BQL_PEER to run, skipping"
+fi